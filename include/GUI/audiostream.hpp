@@ -0,0 +1,25 @@
+#pragma once
+#include <SFML/Audio.hpp>
+#include <array>
+#include <atomic>
+
+#include "spu.hpp"
+
+#define AUDIO_CHUNK_SIZE (1024)  // Interleaved stereo samples handed to SFML per request, about 12ms
+
+// Plays the SPU output. SFML calls onGetData from its own thread, which is the only consumer of the SPU ring
+class AudioStream : public sf::SoundStream {
+  public:
+    AudioStream(Spu& spu);
+    ~AudioStream();
+
+    u64 underruns() const { return m_underruns.load(std::memory_order_relaxed); }
+
+  private:
+    bool onGetData(Chunk& data) override;
+    void onSeek(sf::Time) override {}
+
+    Spu& m_spu;
+    std::array<s16, AUDIO_CHUNK_SIZE> m_chunk{};
+    std::atomic<u64> m_underruns = 0;  // Written by the stream thread, read by the GUI
+};
@@ -1,6 +1,7 @@
 #pragma once
 #include <SFML/Graphics.hpp>
 
+#include "audiostream.hpp"
 #include "debuginfo.hpp"
 #include "disassembly.hpp"
 #include "emulator.hpp"
@@ -8,12 +9,17 @@
 #include "imgui.h"
 #include "logger.hpp"
 #include "memviewer.hpp"
+#include "perfoverlay.hpp"
 #include "regviewer.hpp"
 
 class GUI {
     sf::RenderWindow window;
     sf::Clock deltaClock;
-    sf::Texture display;
+    // Frames are uploaded into alternating textures, so the upload never waits on the one being drawn
+    sf::Texture displays[2];
+    u64 displayGenerations[2] = {};  // Framebuffer generation in each texture
+    int displayFront = 0;
+    sf::Sprite displaySprite;
     Emulator& emulator;
 
   public:
@@ -25,6 +31,7 @@ class GUI {
   private:
     void showMenuBar();
     void showDisplay();
+    void uploadDisplay();
     void drawGUI();
 
     bool m_showDemo = false;
@@ -33,4 +40,6 @@ class GUI {
     RegViewer m_regviewer{emulator};
     DebugInfo m_debuginfo{emulator};
     MemViewer m_memviewer{emulator};
+    PerfOverlay m_perfoverlay{emulator};
+    AudioStream m_audio{emulator.m_spu};
 };
\ No newline at end of file
@@ -0,0 +1,28 @@
+#pragma once
+#include <chrono>
+
+#include "emulator.hpp"
+
+// Small always-on-top window with emulation speed and renderer statistics, refreshed once per second
+class PerfOverlay {
+  public:
+    PerfOverlay(Emulator& emulator) : m_emulator(emulator) {}
+
+    void draw();
+    bool m_draw = false;
+
+  private:
+    void sample();
+
+    Emulator& m_emulator;
+
+    std::chrono::steady_clock::time_point m_lastSample = std::chrono::steady_clock::now();
+    u64 m_lastFrames = 0;
+    u64 m_lastHits = 0;
+    u64 m_lastMisses = 0;
+    u64 m_lastDirtyPages = 0;
+
+    double m_fps = 0.0;
+    double m_hitRate = 0.0;     // Texture cache hits over the last second, in percent
+    double m_dirtyPages = 0.0;  // RAM pages written per frame over the last second
+};
@@ -0,0 +1,11 @@
+#pragma once
+#include <string>
+
+#include "utils.hpp"
+
+// Micro-benchmarks, run from the headless runner with --bench <name>
+namespace Benchmark {
+
+int run(const std::string& name);
+
+}  // namespace Benchmark
@@ -0,0 +1,65 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <vector>
+
+#include "rasterizer.hpp"
+#include "texturecache.hpp"
+#include "threadpool.hpp"
+#include "utils.hpp"
+
+#define TILE_WIDTH (64)
+#define TILE_HEIGHT (32)
+#define TILES_X (VRAM_WIDTH / TILE_WIDTH)
+#define TILES_Y (VRAM_HEIGHT / TILE_HEIGHT)
+#define MAX_BATCH_SIZE (8192)  // Primitives
+
+// A primitive with the drawing environment it was submitted under
+struct DrawCommand {
+    enum class TYPE : u8 { TRIANGLE, RECTANGLE, LINE };
+
+    TYPE type;
+    DrawState state;
+    Primitive prim;
+    Vertex vertices[3];  // Rectangles use the first as their origin, lines the first two
+    s32 width = 0;
+    s32 height = 0;
+};
+
+// Sorts primitives into the VRAM tiles they touch and rasterizes the tiles in parallel.
+// Each tile draws its primitives in submission order, and the rasterizer computes every pixel from absolute
+// coordinates, so the result is identical to drawing everything serially. A primitive sampling a texture that the
+// batch has drawn to flushes the batch first, and so does one drawing over a 15bpp texture the batch samples.
+// Paletted primitives sample a decoded copy of their page and never need the second check
+class Binner {
+  public:
+    Binner(u16* vram) : m_vram(vram) {}
+
+    void setThreads(u32 threads) { m_pool.resize(threads); }
+    u32 threads() const { return m_pool.size(); }
+
+    void submit(DrawCommand command);
+    // Draw everything submitted so far
+    void flush();
+    // VRAM written by anything other than a primitive, after a flush
+    void invalidate(s32 left, s32 top, s32 right, s32 bottom) { m_textureCache.invalidate(left, top, right, bottom); }
+
+    const TextureCache& textureCache() const { return m_textureCache; }
+    // Pixels rasterized so far, only exact after a flush
+    u64 pixels() const { return m_pixels.load(std::memory_order_relaxed); }
+
+  private:
+    u32 draw(const DrawCommand& command, const ClipRect& clip);
+    const u16* cachedTexture(const Primitive& prim);
+
+    u16* m_vram;
+    ThreadPool m_pool;
+    TextureCache m_textureCache;
+
+    std::vector<DrawCommand> m_batch;
+    std::array<std::vector<u32>, TILES_X * TILES_Y> m_bins;
+    std::vector<u32> m_activeTiles;
+    ClipRect m_dirty = {VRAM_WIDTH, VRAM_HEIGHT, -1, -1};  // Bounds of everything in the batch
+    ClipRect m_reads = {VRAM_WIDTH, VRAM_HEIGHT, -1, -1};  // Bounds of the VRAM batched primitives sample directly
+    std::atomic<u64> m_pixels = 0;
+};
@@ -0,0 +1,135 @@
+#pragma once
+#include <array>
+#include <memory>
+
+#include "BitField.hpp"
+#include "disc.hpp"
+#include "scheduler.hpp"
+#include "utils.hpp"
+#include "xa.hpp"
+
+class Emulator;
+class Serializer;
+
+#define CDROM_FIFO_SIZE (16)
+#define CDROM_ACK_DELAY (25000)       // Cycles from a command to its first response
+#define CDROM_SECOND_DELAY (50000)    // Cycles from the first response of a command to its second one
+#define CDROM_INIT_DELAY (500000)     // Init and ReadTOC spin the disc up first
+#define CDROM_RETRY_DELAY (2000)      // Poll interval while the CPU hasn't acknowledged the last interrupt
+#define CDROM_SEEK_BASE (CPU_CLOCK / 100)
+#define CDROM_SEEK_FULL (CPU_CLOCK / 2)  // Extra time to cross the whole disc
+
+union CdromMode {
+    BitField<0, 1, u8> cdda;
+    BitField<1, 1, u8> autoPause;
+    BitField<2, 1, u8> report;
+    BitField<3, 1, u8> xaFilter;
+    BitField<4, 1, u8> ignoreBit;
+    BitField<5, 1, u8> wholeSector;  // Deliver 0x924 bytes from the header on instead of 0x800 of data
+    BitField<6, 1, u8> xaAdpcm;
+    BitField<7, 1, u8> doubleSpeed;
+    u8 r;
+};
+
+enum class DRIVE_STATE : u8 { IDLE, SEEKING, READING };
+
+#define CDROM_FAST_MULTIPLIER (8)  // Read speed multiplier the GUI toggles
+
+// Loading speed-ups, off by default. They only shorten the drive's timing, responses and interrupts arrive in the
+// same order as with real timing
+struct CdromSpeed {
+    u32 readMultiplier = 1;    // On top of the single or double speed the game selected, for data reads only
+    bool instantSeek = false;  // Seeks take a sector's time regardless of distance
+};
+
+// CD-ROM controller at 0x1f801800-0x1f801803. Commands are answered through the scheduler: the first response
+// after CDROM_ACK_DELAY, and a second one for commands that take longer. Only one interrupt is visible at a time,
+// later ones wait until the CPU acknowledges it
+class Cdrom {
+  public:
+    Cdrom(Emulator& emulator);
+
+    void reset();
+    void serialize(Serializer& s);
+
+    // Wider reads of the data port take that many bytes from the data FIFO, other wide reads go register by register
+    u32 read(u32 offset, u32 size = 1);
+    void write(u32 offset, u32 value);
+
+    // Sector data on DMA channel 3
+    void dmaRead(u32* data, u32 words);
+
+    // CD audio input of the SPU mixer, through the CD-ROM volume matrix
+    void readAudio(s32* left, s32* right, u32 count);
+
+    void insertDisc(std::unique_ptr<Disc> disc);
+    bool hasDisc() const { return m_disc != nullptr; }
+
+    // Scheduler events
+    void commandEvent();
+    void driveEvent();
+
+    CdromSpeed m_speed;
+
+  private:
+    struct Response {
+        u8 interrupt = 0;  // INT1-INT5, 0 if there is none
+        u8 size = 0;
+        std::array<u8, CDROM_FIFO_SIZE> data{};
+    };
+
+    u8 stat() const;
+    void execute();
+    void deliver(const Response& response);
+    void respond(u8 interrupt, std::initializer_list<u8> bytes);
+    void queueSecond(u8 interrupt, std::initializer_list<u8> bytes, u64 delay);
+    void error(u8 code);
+
+    void seek(bool thenRead);
+    void stopDrive();
+    bool fastReads() const;
+    u64 readCycles() const;
+    bool playAdpcm(const u8* sector);
+    void keepSectors();
+    u8 region() const;  // Reads the license sector, only while no other sector is in use
+
+    Emulator& m_emulator;
+    std::unique_ptr<Disc> m_disc;
+
+    u8 m_index = 0;
+    u8 m_irqEnable = 0;
+    u8 m_irqFlag = 0;
+
+    u8 m_command = 0;
+    bool m_commandPending = false;
+    std::array<u8, CDROM_FIFO_SIZE> m_params{};
+    u8 m_paramCount = 0;
+
+    Response m_response;
+    u8 m_responseIndex = 0;
+    Response m_second;  // Waiting for its delay, or for the last interrupt to be acknowledged
+
+    // The sector in the data FIFO points into the disc image
+    const u8* m_data = nullptr;
+    u32 m_dataSize = 0;
+    u32 m_dataIndex = 0;
+
+    CdromMode m_mode{};
+    DRIVE_STATE m_drive = DRIVE_STATE::IDLE;
+    bool m_motorOn = false;
+    bool m_readAfterSeek = false;
+    bool m_seekPending = false;  // Setloc target not reached yet
+    u32 m_seekTarget = 0;
+    u32 m_position = 0;
+    const u8* m_sector = nullptr;  // Last sector read
+    u32 m_sectorPosition = 0;      // Where m_sector and the sector of m_data were read, for save states
+    u32 m_dataPosition = 0;
+    u8 m_filterFile = 0;
+    u8 m_filterChannel = 0;
+    u8 m_region = 'A';
+
+    XaDecoder m_xa;
+    std::array<u8, 4> m_volumes{};  // Left to left, left to right, right to right, right to left
+    std::array<u8, 4> m_pendingVolumes{};
+    bool m_adpcmMuted = false;
+};
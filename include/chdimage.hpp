@@ -0,0 +1,78 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "disc.hpp"
+#include "mio/mio.hpp"
+#include "threadpool.hpp"
+
+#define CHD_CACHE_HUNKS (128)    // Decompressed hunks kept, about 2.4 MB with the usual 8 sector hunks
+#define CHD_PREFETCH_HUNKS (32)  // Hunks decompressed ahead of the read position
+#define CHD_FRAME_SIZE (2448)    // Sector plus subchannel data, the unit CD images are stored in
+
+// Compressed CD images in the CHD v5 format. The file is memory-mapped and split in hunks of a few sectors that
+// are compressed independently. Hunks go through an LRU cache of CHD_CACHE_HUNKS, so memory use doesn't depend on
+// the image size. A prefetch thread decompresses the hunks ahead of the last prefetch() hint on a thread pool.
+// Supports the zlib and LZMA codecs, sectors in hunks using other codecs fail to read
+class ChdImage : public Disc {
+  public:
+    ~ChdImage();
+
+    bool open(const std::string& path);
+
+    const u8* sector(u32 position) override;
+    void prefetch(u32 position) override;
+
+  private:
+    using Hunk = std::shared_ptr<const std::vector<u8>>;  // Sectors of a hunk, SECTOR_SIZE apart
+
+    struct MapEntry {
+        u8 compression = 0;
+        u32 length = 0;
+        u64 offset = 0;  // In the file, or the hunk it is a copy of
+    };
+
+    struct TrackData {
+        u32 frame = 0;         // Frame of index 1 in the image
+        u32 storedPregap = 0;  // Sectors of the pregap present in the image
+    };
+
+    bool readMap(const u8* header);
+    bool readTracks(u64 metaOffset);
+    s64 frameAt(u32 position) const;
+
+    Hunk hunk(u32 index);
+    Hunk cached(u32 index);
+    void insert(u32 index, const Hunk& hunk);
+    // Empty if the hunk can't be decompressed, it stays cached that way
+    std::vector<u8> decompress(u32 index);
+    bool decompressCd(u32 codec, const u8* source, u32 length, u8* sectors) const;
+    void swapAudio(u32 index, std::vector<u8>& sectors) const;
+
+    void prefetchLoop();
+
+    mio::ummap_source m_file;
+    std::array<u32, 4> m_codecs{};
+    u32 m_hunkBytes = 0;
+    u32 m_framesPerHunk = 0;
+    std::vector<MapEntry> m_map;
+    std::vector<TrackData> m_trackData;  // Parallel to m_tracks
+
+    std::mutex m_cacheMutex;
+    std::list<std::pair<u32, Hunk>> m_lru;  // Most recently used first
+    std::unordered_map<u32, std::list<std::pair<u32, Hunk>>::iterator> m_cache;
+    std::array<Hunk, 2> m_returned;  // Hunks of the last sectors handed out, kept alive if they get evicted
+    u32 m_returnedIndex = 0;
+
+    ThreadPool m_pool;
+    std::thread m_prefetcher;
+    std::atomic<u32> m_prefetchTarget = 0;  // Hunk index
+    std::atomic<bool> m_stop = false;
+};
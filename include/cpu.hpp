@@ -7,8 +7,10 @@
 #include "regs.hpp"
 
 class Emulator;
+class Serializer;
 
 #define START_PC (0xbfc00000)
+#define COP0_CAUSE (13)
 
 
 using Helpers::log;
@@ -24,9 +26,11 @@ class Cpu {
     void logMnemonic();
     void fetch();
     void reset();
+    void serialize(Serializer& s);
     void checkPendingLoad();
     void handleLoadDelay();
     void handleBranchDelay();
+    void handleInterrupt();
 
     inline void pendingLoad(u32 rt, u32 value) {
         m_regs.markWbIndex(rt);
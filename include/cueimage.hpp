@@ -0,0 +1,45 @@
+#pragma once
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "disc.hpp"
+#include "mio/mio.hpp"
+
+#define PREFETCH_SECTORS (256)  // About 3.4 seconds at double speed
+
+// BIN images described by a CUE sheet, or a single raw BIN. Every BIN file is memory-mapped, sectors point straight
+// into the mappings. A background thread touches the pages ahead of the last prefetch() hint, so reading them
+// later on the emulator thread doesn't fault on disk I/O
+class CueImage : public Disc {
+  public:
+    ~CueImage();
+
+    bool openCue(const std::string& path);
+    bool openBin(const std::string& path);
+
+    const u8* sector(u32 position) override;
+    void prefetch(u32 position) override;
+
+  private:
+    struct TrackData {
+        u32 file = 0;
+        u32 fileSector = 0;    // Sector of index 1 in the file
+        u32 storedPregap = 0;  // Sectors of the pregap present in the file
+    };
+
+    bool mapFile(const std::string& path);
+    void layout();
+    const u8* fileSector(u32 position) const;
+    void startPrefetcher();
+    void prefetchLoop();
+
+    std::vector<mio::ummap_source> m_files;
+    std::vector<TrackData> m_trackData;  // Parallel to m_tracks
+    std::vector<u32> m_cueGaps;          // PREGAP sectors per track, not stored in any file
+
+    std::thread m_prefetcher;
+    std::atomic<u32> m_prefetchTarget = 0;
+    std::atomic<bool> m_stop = false;
+};
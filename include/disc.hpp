@@ -0,0 +1,60 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "utils.hpp"
+
+#define SECTOR_SIZE (2352)  // Raw sector, sync and header included
+#define SECTORS_PER_SECOND (75)
+#define LEAD_IN_SECTORS (150)  // 00:02:00, the first sector of track 1
+
+enum class TRACK_TYPE : u8 { DATA, AUDIO };
+
+// Positions are absolute sector numbers, 00:00:00 being 0
+struct Track {
+    u32 number = 0;
+    TRACK_TYPE type = TRACK_TYPE::DATA;
+    u32 start = 0;   // Position of index 1
+    u32 length = 0;  // Sectors from index 1 to the end of the track
+    u32 pregap = 0;  // Sectors before index 1 that belong to this track
+};
+
+// A disc image. Sectors are raw 2352 byte sectors, handed out as pointers into the image instead of copies
+class Disc {
+  public:
+    virtual ~Disc() = default;
+
+    // Open a CUE sheet, a raw BIN image or a CHD. Returns nullptr and logs a warning if the image can't be used
+    static std::unique_ptr<Disc> open(const std::string& path);
+
+    // The sector at a position, or a sector of zeroes for gaps that aren't stored in the image. The pointer stays
+    // valid until two more sectors have been requested. nullptr if the image is damaged there
+    virtual const u8* sector(u32 position) = 0;
+    // Hint that sectors from this position on are about to be read
+    virtual void prefetch(u32) {}
+
+    const std::vector<Track>& tracks() const { return m_tracks; }
+    const Track* trackAt(u32 position) const;
+    u32 end() const;  // Position of the lead-out
+
+  protected:
+    std::vector<Track> m_tracks;
+};
+
+namespace CD {
+inline u8 toBcd(u32 value) { return u8((value / 10) << 4 | (value % 10)); }
+inline u32 fromBcd(u8 value) { return (value >> 4) * 10 + (value & 0xf); }
+
+inline u32 position(u32 minutes, u32 seconds, u32 sectors) {
+    return (minutes * 60 + seconds) * SECTORS_PER_SECOND + sectors;
+}
+
+struct Msf {
+    u8 minutes, seconds, sectors;  // BCD
+};
+inline Msf msf(u32 position) {
+    return {toBcd(position / (60 * SECTORS_PER_SECOND)), toBcd(position / SECTORS_PER_SECOND % 60),
+            toBcd(position % SECTORS_PER_SECOND)};
+}
+}  // namespace CD
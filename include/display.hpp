@@ -0,0 +1,36 @@
+#pragma once
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "utils.hpp"
+
+// The display area as shown on screen, RGBA8 with red in the lowest byte
+struct Framebuffer {
+    std::vector<u32> pixels;
+    u32 width = 0;
+    u32 height = 0;
+    u64 generation = 0;             // Bumped whenever the pixels change
+    std::vector<u64> rowGenerations;  // Generation each row last changed in
+
+    // Rows changed after a given generation, as [first, last). Empty when nothing changed
+    std::pair<u32, u32> changedRows(u64 since) const {
+        u32 first = height, last = 0;
+        for (u32 row = 0; row < height; row++) {
+            if (rowGenerations[row] > since) first = std::min(first, row), last = row + 1;
+        }
+        return {first, std::max(first, last)};
+    }
+};
+
+// Converts the display area out of VRAM. Uses AVX2 while it is the rasterizer backend
+namespace Display {
+// x is in halfwords, width in pixels. Reads wrap around the edges of VRAM
+void convert(const u16* vram, u32 x, u32 y, u32 width, u32 height, bool depth24, u32* rgba);
+
+// Row kernels. 24bpp sources are bytes and must be readable for 32 bytes past the last pixel
+void convertRow15Scalar(const u16* src, u32 count, u32* dst);
+void convertRow24Scalar(const u8* src, u32 count, u32* dst);
+void convertRow15AVX2(const u16* src, u32 count, u32* dst);
+void convertRow24AVX2(const u8* src, u32 count, u32* dst);
+}  // namespace Display
@@ -0,0 +1,70 @@
+#pragma once
+#include <array>
+
+#include "BitField.hpp"
+#include "utils.hpp"
+
+class Emulator;
+class Serializer;
+
+enum class DMA_CHANNEL : u32 { MDEC_IN, MDEC_OUT, GPU, CDROM, SPU, PIO, OTC };
+
+union ChannelControl {
+    BitField<0, 1, u32> fromRam;
+    BitField<1, 1, u32> decrement;
+    BitField<8, 1, u32> chopping;
+    BitField<9, 2, u32> syncMode;
+    BitField<24, 1, u32> busy;
+    BitField<28, 1, u32> trigger;
+    u32 r;
+};
+
+union InterruptRegister {
+    BitField<15, 1, u32> forceIrq;
+    BitField<16, 7, u32> channelEnable;
+    BitField<23, 1, u32> masterEnable;
+    BitField<24, 7, u32> channelFlags;
+    BitField<31, 1, u32> masterFlag;
+    u32 r;
+};
+
+struct DmaChannel {
+    u32 madr = 0;
+    u32 bcr = 0;
+    ChannelControl chcr{};
+};
+
+// DMA controller at 0x1f801080-0x1f8010ff.
+// Data moves in bulk as soon as a channel starts, completion is delivered later through the scheduler
+class Dma {
+  public:
+    Dma(Emulator& emulator) : m_emulator(emulator) {}
+
+    void reset();
+    void serialize(Serializer& s);
+
+    u32 read(u32 offset);
+    // Narrower writes only replace the bytes they cover
+    void write(u32 offset, u32 value, u32 size = 4);
+
+    void finishTransfer(u32 channel);
+
+    // A device has data for a channel that was started before it did
+    void requestTransfer(DMA_CHANNEL channel);
+
+  private:
+    enum SYNC_MODE { MANUAL, BLOCK, LINKED_LIST };
+
+    bool isActive(const DmaChannel& channel) const;
+    void startTransfer(u32 channel);
+    u32 blockTransfer(u32 channel);
+    u32 linkedListTransfer(u32 channel);
+    void clearOrderingTable(u32 address, u32 words);
+    void updateMasterFlag();
+
+    Emulator& m_emulator;
+    std::array<DmaChannel, 7> m_channels{};
+    u32 m_dpcr = 0x07654321;
+    InterruptRegister m_dicr{};
+    u8 m_waiting = 0;  // Channels started while their device had nothing to send
+};
@@ -2,9 +2,22 @@
 #include <array>
 #include <string>
 
+#include "cdrom.hpp"
 #include "cpu.hpp"
+#include "dma.hpp"
+#include "exe.hpp"
+#include "gpu.hpp"
+#include "io.hpp"
+#include "irq.hpp"
 #include "logger.hpp"
+#include "mdec.hpp"
 #include "mem.hpp"
+#include "rewind.hpp"
+#include "runahead.hpp"
+#include "savestate.hpp"
+#include "scheduler.hpp"
+#include "spu.hpp"
+#include "timers.hpp"
 #include "utils.hpp"
 
 class Memory;
@@ -13,14 +26,21 @@ class Logger;
 
 class Emulator {
   public:
-    static const int width = 160;
-    static const int height = 144;
-
     void reset();
     void step();
     void runFrame();
 
     void loadBios(const std::string& path);
+    void loadExe(const std::string& path);
+    void loadDisc(const std::string& path);
+
+    // Save states hold the whole machine, BIOS included, but not the disc or EXE file. Load states made with a
+    // disc after inserting the same one
+    void serialize(Serializer& s);
+    bool saveState(const std::string& path);
+    bool loadState(const std::string& path);
+
+    inline bool canRun() const { return m_biosLoaded || m_exeLoaded; }
 
     template <typename... Args>
     void log(const char* fmt, const Args&... args) {
@@ -38,16 +58,38 @@ class Emulator {
 
     bool isRunning = false;
     bool m_biosLoaded = false;
+    bool m_exeLoaded = false;
+    bool m_sideloadPending = false;
     bool m_break = false;
     u32 m_breakPc = 0xbfc00000;
-    std::array<u8, width * height * 4> framebuffer;  // An 160x144 RGBA framebuffer
     int framesPassed = 0;
 
-    Emulator() { framebuffer.fill(0xFF); }
-
+    Scheduler m_scheduler{*this};
     Memory m_mem{*this};
     Cpu m_cpu{*this};
+    InterruptController m_irq{*this};
+    Dma m_dma{*this};
+    Timers m_timers{*this};
+    Gpu m_gpu{*this};
+    Spu m_spu{*this};
+    Cdrom m_cdrom{*this};
+    Mdec m_mdec{*this};
+    IO m_io{*this};
+    Rewind m_rewind{*this};
+    RunAhead m_runAhead{*this};
     Logger m_logger;
 
     bool m_enableLog = false;
+
+  private:
+    void sideloadExe();
+
+    // Inject the EXE once the BIOS reaches the shell, skipping the boot animation
+    inline void checkSideload() {
+        if (m_sideloadPending && m_cpu.m_regs.pc == SHELL_ENTRY_PC) {
+            sideloadExe();
+        }
+    }
+
+    mio::ummap_source m_exeFile;
 };
\ No newline at end of file
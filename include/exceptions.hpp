@@ -2,6 +2,7 @@
 #include <cstddef>
 
 enum Exception : size_t {
+    Interrupt = 0x0,
     Syscall = 0x8,
     Break = 0x9,
     CopError = 0xB,
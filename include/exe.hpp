@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+#include <cstring>
+
+#include "utils.hpp"
+
+#define EXE_HEADER_SIZE (0x800)
+#define EXE_MAGIC "PS-X EXE"
+#define SHELL_ENTRY_PC (0x80030000)
+
+// Header of a PS-X EXE file. The text segment follows the 2kb header and is loaded at t_addr
+struct ExeHeader {
+    char magic[8];  // "PS-X EXE"
+    u32 text_off;
+    u32 data_off;
+    u32 pc0;     // Initial PC
+    u32 gp0;     // Initial GP
+    u32 t_addr;  // Text segment load address
+    u32 t_size;  // Text segment size, multiple of 2kb
+    u32 d_addr;
+    u32 d_size;
+    u32 b_addr;  // BSS segment, cleared before starting
+    u32 b_size;
+    u32 s_addr;  // Initial SP/FP base, ignored if zero
+    u32 s_size;
+    u32 saved[5];  // SP, FP, GP, RA, S0 saved by the BIOS Exec function
+    char marker[0x7b4];
+
+    bool valid() const { return std::memcmp(magic, EXE_MAGIC, sizeof(magic)) == 0; }
+};
+
+static_assert(offsetof(ExeHeader, pc0) == 0x10);
+static_assert(offsetof(ExeHeader, s_addr) == 0x30);
+static_assert(offsetof(ExeHeader, marker) == 0x4c);
+static_assert(sizeof(ExeHeader) == EXE_HEADER_SIZE);
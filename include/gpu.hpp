@@ -0,0 +1,129 @@
+#pragma once
+#include <vector>
+
+#include "BitField.hpp"
+#include "display.hpp"
+#include "recorder.hpp"
+#include "renderer.hpp"
+#include "utils.hpp"
+
+class Emulator;
+class Serializer;
+
+union GpuStatus {
+    BitField<0, 4, u32> texBaseX;
+    BitField<4, 1, u32> texBaseY;
+    BitField<5, 2, u32> semiMode;
+    BitField<7, 2, u32> texDepth;
+    BitField<9, 1, u32> dither;
+    BitField<10, 1, u32> drawToDisplay;
+    BitField<11, 1, u32> setMask;
+    BitField<12, 1, u32> checkMask;
+    BitField<13, 1, u32> interlaceField;
+    BitField<14, 1, u32> reverse;
+    BitField<15, 1, u32> texDisable;
+    BitField<16, 1, u32> hres2;
+    BitField<17, 2, u32> hres1;
+    BitField<19, 1, u32> vres;
+    BitField<20, 1, u32> pal;
+    BitField<21, 1, u32> colorDepth24;
+    BitField<22, 1, u32> interlace;
+    BitField<23, 1, u32> displayDisable;
+    BitField<24, 1, u32> irq;
+    BitField<25, 1, u32> dmaRequest;
+    BitField<26, 1, u32> readyCommand;
+    BitField<27, 1, u32> readyVramToCpu;
+    BitField<28, 1, u32> readyDmaBlock;
+    BitField<29, 2, u32> dmaDirection;
+    BitField<31, 1, u32> oddLine;
+    u32 r;
+};
+
+// Display configuration set through GP1
+struct DisplayState {
+    u32 startX = 0;
+    u32 startY = 0;
+    u32 rangeX1 = 0x200;
+    u32 rangeX2 = 0xc00;
+    u32 rangeY1 = 0x10;
+    u32 rangeY2 = 0x100;
+};
+
+// GP0/GPUREAD at 0x1f801810, GP1/GPUSTAT at 0x1f801814.
+// GP0 words are assembled into packets here and handed to the renderer thread. The CPU only waits for the renderer
+// on VRAM to CPU transfers and at VBlank
+class Gpu {
+  public:
+    Gpu(Emulator& emulator);
+
+    void reset();
+    void serialize(Serializer& s);
+
+    u32 dotClockDivider() const;
+    u32 cyclesPerScanline() const;  // In GPU cycles
+    u64 cyclesPerFrame() const;     // In CPU cycles
+    u32 displayWidth() const;
+    u32 displayHeight() const;
+
+    u32 read(u32 offset);
+    void write(u32 offset, u32 value);
+
+    void writeGP0(u32 value);
+    void writeGP1(u32 value);
+    void dmaWrite(const u32* words, u32 count);
+    void dmaRead(u32* words, u32 count);
+
+    void vblank();
+
+    GpuStatus m_stat;
+    DisplayState m_display;
+    u64 m_frameCount = 0;
+
+    Renderer m_renderer;
+    Framebuffer m_framebuffer;  // Display area as of the last VBlank
+    Recorder m_recorder;
+    bool m_presentFrames = true;  // Off while run-ahead emulates frames that aren't shown
+
+  private:
+    enum class GP0_MODE { COMMAND, POLYLINE, VRAM_WRITE };
+
+    u32 status();
+    u32 readData();
+
+    // Everything for the renderer goes through here so it can be recorded
+    void render(RENDER_COMMAND command, const u32* words, u32 count) {
+        if (m_recorder.active()) m_recorder.command(command, words, count);
+        m_renderer.push(command, words, count);
+    }
+    void executePacket();
+    void flushVramWrite();
+    void startVramRead(u32 position, u32 size);
+    void updateFramebuffer();
+
+    Emulator& m_emulator;
+
+    GP0_MODE m_mode = GP0_MODE::COMMAND;
+    std::vector<u32> m_fifo;  // The packet being assembled, or pending CPU to VRAM data
+    u32 m_packetLength = 0;
+    u32 m_vramWriteRemaining = 0;  // In words
+
+    std::vector<u32> m_readBuffer;  // Pending VRAM to CPU data
+    size_t m_readPosition = 0;
+    u32 m_gpuRead = 0;  // Last GP1(10) result
+
+    // Raw E2-E5 values, reported by GP1(10)
+    u32 m_texWindow = 0;
+    u32 m_drawAreaTopLeft = 0;
+    u32 m_drawAreaBottomRight = 0;
+    u32 m_drawOffset = 0;
+
+    u64 m_frameStart = 0;  // Cycle of the last VBlank
+
+    // What the framebuffer was last converted from
+    struct DisplaySource {
+        u32 x, y, width, height;
+        bool depth24, disabled;
+        u64 vramVersion;
+        bool operator==(const DisplaySource&) const = default;
+    } m_displaySource{};
+};
@@ -0,0 +1,37 @@
+#pragma once
+#include <string>
+
+#include "emulator.hpp"
+#include "utils.hpp"
+
+// Command line options shared by the GUI and the headless runner
+struct Options {
+    Options(int argc, char** argv);
+
+    std::string biosPath;
+    std::string exePath;
+    std::string discPath;  // CUE sheet, BIN image or CHD to insert
+    CdromSpeed cdromSpeed;
+    std::string statePath;  // Save state to start from
+    u32 runAheadFrames = 0;  // Frames the GUI runs ahead to hide input latency
+    std::string benchmark;  // Benchmark to run instead of the emulator
+    std::string recordPath;  // GPU recording to write
+    std::string replayPath;  // GPU recording to replay instead of running the emulator
+    u32 recordFrames = 0;    // Frames to record, 0 records until exit
+    u32 renderThreads = 0;   // Rasterizer threads when replaying, 0 uses the renderer default
+    bool headless = false;
+    u64 instructions = 0;  // Instructions to run in headless mode, 0 runs until the emulator stops
+};
+
+class Headless {
+  public:
+    Headless(Emulator& emulator, const Options& options) : m_emulator(emulator), m_options(options) {}
+
+    int run();
+
+  private:
+    int replay();
+
+    Emulator& m_emulator;
+    const Options& m_options;
+};
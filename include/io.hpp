@@ -0,0 +1,91 @@
+#pragma once
+#include <array>
+
+#include "mem.hpp"
+#include "utils.hpp"
+
+class Emulator;
+
+// Devices on the I/O page. Offsets are relative to HWREG_BASE
+enum class DEVICE : u8 { NONE, IRQ, DMA, TIMERS, CDROM, GPU, MDEC, SPU, COUNT };
+
+struct DeviceRange {
+    DEVICE device;
+    u32 start;
+    u32 size;
+};
+
+static constexpr DeviceRange deviceMap[] = {
+    {DEVICE::IRQ, 0x070, 0x8},
+    {DEVICE::DMA, 0x080, 0x80},
+    {DEVICE::TIMERS, 0x100, 0x30},
+    {DEVICE::CDROM, 0x800, 0x4},
+    {DEVICE::GPU, 0x810, 0x8},
+    {DEVICE::MDEC, 0x820, 0x8},
+    {DEVICE::SPU, 0xc00, 0x400},
+};
+
+// Device owning each 32-bit word of the I/O page, built at compile time from deviceMap
+static constexpr auto deviceLayout = [] {
+    std::array<DEVICE, HWREG_SIZE / 4> layout{};
+    for (const auto& range : deviceMap) {
+        for (u32 offset = range.start; offset < range.start + range.size; offset += 4) {
+            layout[offset >> 2] = range.device;
+        }
+    }
+    return layout;
+}();
+
+// Dispatch table for the 0x1f801000 I/O page. Registers that no device claims are backed by plain memory
+class IO {
+  public:
+    // size is the access width in bytes
+    using ReadHandler = u32 (*)(void* device, u32 offset, u32 size);
+    using WriteHandler = void (*)(void* device, u32 offset, u32 value, u32 size);
+
+    struct Handler {
+        void* device = nullptr;
+        ReadHandler read = nullptr;
+        WriteHandler write = nullptr;
+    };
+
+    IO(Emulator& emulator) : m_emulator(emulator) { init(); }
+
+    void init();
+
+    template <MemoryAccess T>
+    T read(u32 offset);
+
+    template <MemoryAccess T>
+    void write(u32 offset, T value);
+
+    // Bind a device instance to its ranges in deviceMap. Devices provide u32 read(u32) and void write(u32, u32),
+    // or versions taking the access width as a last parameter when they need to tell accesses apart
+    template <typename Device>
+    void attach(DEVICE id, Device& device) {
+        m_handlers[(size_t)id] = {
+            &device,
+            [](void* d, u32 offset, [[maybe_unused]] u32 size) -> u32 {
+                auto* device = static_cast<Device*>(d);
+                if constexpr (requires { device->read(offset, size); }) {
+                    return device->read(offset, size);
+                } else {
+                    return device->read(offset);
+                }
+            },
+            [](void* d, u32 offset, u32 value, [[maybe_unused]] u32 size) {
+                auto* device = static_cast<Device*>(d);
+                if constexpr (requires { device->write(offset, value, size); }) {
+                    device->write(offset, value, size);
+                } else {
+                    device->write(offset, value);
+                }
+            },
+        };
+    }
+
+  private:
+    Emulator& m_emulator;
+    std::array<Handler, (size_t)DEVICE::COUNT> m_handlers{};
+    std::array<Handler*, HWREG_SIZE / 4> m_table{};
+};
@@ -0,0 +1,28 @@
+#pragma once
+#include "utils.hpp"
+
+class Emulator;
+class Serializer;
+
+enum class IRQ : u32 { VBlank, GPU, CDROM, DMA, Timer0, Timer1, Timer2, Pad, SIO, SPU, Lightpen };
+
+// Interrupt controller, I_STAT at 0x1f801070 and I_MASK at 0x1f801074
+class InterruptController {
+  public:
+    InterruptController(Emulator& emulator) : m_emulator(emulator) {}
+
+    void reset();
+    void serialize(Serializer& s);
+
+    u32 read(u32 offset);
+    void write(u32 offset, u32 value);
+
+    inline void trigger(IRQ irq) { m_stat |= 1 << static_cast<u32>(irq); }
+    inline bool pending() const { return (m_stat & m_mask) != 0; }
+
+    u32 m_stat = 0;
+    u32 m_mask = 0;
+
+  private:
+    Emulator& m_emulator;
+};
@@ -0,0 +1,80 @@
+#pragma once
+#include <array>
+#include <vector>
+
+#include "threadpool.hpp"
+#include "utils.hpp"
+
+class Emulator;
+class Serializer;
+
+#define MDEC_BLOCK_SIZE (64)     // Coefficients in an 8x8 block
+#define MDEC_TASK_SIZE (8)       // Macroblocks per thread pool task
+#define MDEC_PARALLEL_MIN (32)   // Fewer macroblocks than this are decoded on the calling thread
+#define MDEC_MAX_THREADS (4)
+
+enum class MDEC_DEPTH : u8 { BIT4, BIT8, BIT24, BIT15 };
+
+namespace MDEC {
+using Idct = void (*)(s16* block, const s32* scale);
+
+// Inverse DCT of a block in place. scale is the scale table divided by 8, both passes round the same way so the
+// two versions give identical results
+void idctScalar(s16* block, const s32* scale);
+void idctAVX2(s16* block, const s32* scale);
+}  // namespace MDEC
+
+// Macroblock decoder at 0x1f801820-0x1f801827. The parameters of a decode command are collected until the last
+// word arrives, usually a whole frame sent by DMA0. The macroblocks are then split at their end codes and decoded
+// in parallel on a thread pool, the output waits for DMA1 or reads of the data register
+class Mdec {
+  public:
+    Mdec(Emulator& emulator);
+
+    void reset();
+    void serialize(Serializer& s);
+
+    u32 read(u32 offset);
+    void write(u32 offset, u32 value);
+
+    // DMA channels 0 and 1
+    void dmaWrite(const u32* data, u32 words);
+    void dmaRead(u32* data, u32 words);
+
+    bool outputReady() const { return m_outputIndex < m_output.size(); }
+
+    void setThreads(u32 threads) { m_pool.resize(threads); }
+
+  private:
+    enum COMMAND : u8 { NONE, DECODE, SET_QUANT, SET_SCALE };
+
+    void abort();
+    void receive(const u32* data, u32 words);
+    void startCommand(u32 word);
+    void finishCommand();
+    void decode();
+    void decodeMacroblock(const u16* input, u32 position, u32* output) const;
+    u32 status() const;
+
+    Emulator& m_emulator;
+    ThreadPool m_pool;
+    MDEC::Idct m_idct;
+
+    COMMAND m_command = NONE;
+    u32 m_commandBits = 0;  // Bits 25-28 of the last command, mirrored in the status register
+    u32 m_remaining = 0;    // Parameter words still expected
+    MDEC_DEPTH m_depth = MDEC_DEPTH::BIT4;
+    bool m_signed = false;
+    bool m_bit15 = false;
+    bool m_colorQuant = false;  // SET_QUANT carries the chroma table too
+    bool m_dataInEnable = false;
+    bool m_dataOutEnable = false;
+
+    std::vector<u16> m_input;  // Parameters of the current command, as halfwords
+    std::vector<u32> m_output;
+    size_t m_outputIndex = 0;
+
+    std::array<u8, MDEC_BLOCK_SIZE> m_lumaQuant{};
+    std::array<u8, MDEC_BLOCK_SIZE> m_chromaQuant{};
+    alignas(32) std::array<s32, MDEC_BLOCK_SIZE> m_scale{};
+};
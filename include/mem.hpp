@@ -1,5 +1,6 @@
 #pragma once
 #include <array>
+#include <cstring>
 #include <map>
 #include <memory>
 #include <vector>
@@ -8,6 +9,7 @@
 #include "BitField.hpp"
 
 class Emulator;
+class Serializer;
 
 #define BIOS_BASE (0x1fc00000)
 #define RAM_BASE (0x00000000)
@@ -23,9 +25,40 @@ class Emulator;
 #define MEMCONTROL_SIZE (0x20)
 #define CACHECONTROL_SIZE (4)
 
+// All guest memory lives in one arena. BIOS goes last so everything reset clears is one contiguous block
+#define ARENA_RAM_OFFSET (0)
+#define ARENA_SCRATCHPAD_OFFSET (ARENA_RAM_OFFSET + RAM_SIZE)
+#define ARENA_HWREG_OFFSET (ARENA_SCRATCHPAD_OFFSET + SCRATCHPAD_SIZE)
+#define ARENA_PARAPORT_OFFSET (ARENA_HWREG_OFFSET + HWREG_SIZE)
+#define ARENA_BIOS_OFFSET (ARENA_PARAPORT_OFFSET + PARAPORT_SIZE)
+#define ARENA_USED_SIZE (ARENA_BIOS_OFFSET + BIOS_SIZE)
+#define ARENA_ALIGNMENT (0x200000)  // Huge page size
+#define ARENA_SIZE ((ARENA_USED_SIZE + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1))
+
+#define RAM_PAGE_SHIFT (12)  // 4 KiB pages for dirty tracking
+#define RAM_PAGE_SIZE (1 << RAM_PAGE_SHIFT)
+#define RAM_PAGES (RAM_SIZE >> RAM_PAGE_SHIFT)
+
 using Helpers::Range;
 
-enum class REGION { NONE, BIOS, RAM, SCRATCHPAD, IO, CACHE_CONTROL };
+enum class REGION { NONE, BIOS, RAM, SCRATCHPAD, IO, EXP1, PARAPORT, CACHE_CONTROL };
+
+// Find the region an address belongs to. This is constexpr so constant addresses resolve at compile time
+static constexpr REGION regionOf(u32 address) {
+    if (address >= 0xfffe0130 && address < 0xfffe0130 + CACHECONTROL_SIZE) return REGION::CACHE_CONTROL;
+
+    const u32 hw_address = address & 0x1fffffff;
+    if (hw_address < RAM_BASE + RAM_SIZE) return REGION::RAM;
+    if (hw_address >= BIOS_BASE && hw_address < BIOS_BASE + BIOS_SIZE) return REGION::BIOS;
+    if (hw_address >= SCRATCHPAD_BASE && hw_address < SCRATCHPAD_BASE + SCRATCHPAD_SIZE) return REGION::SCRATCHPAD;
+    if (hw_address >= HWREG_BASE && hw_address < HWREG_BASE + HWREG_SIZE) return REGION::IO;
+    if (hw_address >= 0x1f000084 && hw_address < 0x1f000088) return REGION::EXP1;
+    if (hw_address >= PARAPORT_BASE && hw_address < PARAPORT_BASE + PARAPORT_SIZE) return REGION::PARAPORT;
+    return REGION::NONE;
+}
+
+template <typename T>
+concept MemoryAccess = std::is_same_v<T, u8> || std::is_same_v<T, u16> || std::is_same_v<T, u32>;
 
 
 union CacheControl {
@@ -62,14 +95,59 @@ class Memory {
 
     void init();
     void reset();
+    void serialize(Serializer& s);
+
+    template <MemoryAccess T>
+    T read(u32 address);
+
+    template <MemoryAccess T>
+    void write(u32 address, T value);
+
+    // Accesses to an address known at compile time. RAM, BIOS and scratchpad skip the region lookup entirely
+    template <MemoryAccess T, u32 address>
+    T read() {
+        static_assert(address % sizeof(T) == 0, "Unaligned constant address");
+        constexpr REGION region = regionOf(address);
+        constexpr u32 hw_address = address & 0x1fffffff;
+
+        if constexpr (region == REGION::RAM) {
+            return load<T>(m_ram, hw_address - RAM_BASE);
+        } else if constexpr (region == REGION::BIOS) {
+            return load<T>(m_bios, hw_address - BIOS_BASE);
+        } else if constexpr (region == REGION::SCRATCHPAD) {
+            return load<T>(m_scratch, hw_address - SCRATCHPAD_BASE);
+        } else {
+            return read<T>(address);
+        }
+    }
 
-    u8 psxRead8(u32 address);
-    u16 psxRead16(u32 address);
-    u32 psxRead32(u32 address);
+    template <MemoryAccess T, u32 address>
+    void write(T value) {
+        static_assert(address % sizeof(T) == 0, "Unaligned constant address");
+        constexpr REGION region = regionOf(address);
+        constexpr u32 hw_address = address & 0x1fffffff;
+
+        if constexpr (region == REGION::RAM) {
+            store<T>(m_ram, hw_address - RAM_BASE, value);
+            markDirty(hw_address - RAM_BASE);
+        } else if constexpr (region == REGION::SCRATCHPAD) {
+            store<T>(m_scratch, hw_address - SCRATCHPAD_BASE, value);
+        } else {
+            write<T>(address, value);
+        }
+    }
 
-    void psxWrite8(u32 address, u8 value);
-    void psxWrite16(u32 address, u16 value);
-    void psxWrite32(u32 address, u32 value);
+    template <MemoryAccess T>
+    static inline T load(const u8* region, u32 offset) {
+        T value;
+        std::memcpy(&value, region + offset, sizeof(T));
+        return value;
+    }
+
+    template <MemoryAccess T>
+    static inline void store(u8* region, u32 offset, T value) {
+        std::memcpy(region + offset, &value, sizeof(T));
+    }
 
     u8 read8(u8* region, u32 offset);
     u16 read16(u8* region, u32 offset);
@@ -79,6 +157,23 @@ class Memory {
     void write16(u8* region, u32 offset, u16 value);
     void write32(u8* region, u32 offset, u32 value);
 
+    // Dirty page tracking. Every write to RAM stamps its page with the current epoch, so any number of snapshot
+    // users can each ask what changed since their own checkpoint. Writes that bypass write() mark pages themselves
+    inline void markDirty(u32 offset) { m_pageStamps[offset >> RAM_PAGE_SHIFT] = m_epoch; }
+    void markDirty(u32 offset, u32 size);
+    void markBiosDirty() { m_biosStamp = m_epoch; }
+    // Pages written after this call are dirty since the returned epoch
+    u32 checkpoint() { return m_epoch++; }
+    bool dirtySince(u32 page, u32 epoch) const { return m_pageStamps[page] > epoch; }
+
+    // Called at vblank, counts the pages written during the frame. Speculative run-ahead frames aren't counted
+    void endFrame();
+    // Pages written so far don't count toward the current frame, for writes that aren't the game's own
+    void restartFrame() { m_frameEpoch = ++m_epoch; }
+    u32 lastFrameDirtyPages() const { return m_lastFrameDirtyPages; }
+    u64 dirtyPagesTotal() const { return m_dirtyPagesTotal; }
+
+    u8* m_arena = nullptr;
     u8* m_ram = nullptr;
     u8* m_bios = nullptr;
     u8* m_scratch = nullptr;
@@ -98,5 +193,15 @@ class Memory {
     const Range<u32> EXP1 = Range<u32>(0x1f000084, 4);
 
   private:
+    static u8* allocateArena();
+    static void freeArena(u8* arena);
+
     Emulator& m_emulator;
+
+    std::array<u32, RAM_PAGES> m_pageStamps{};
+    u32 m_biosStamp = 0;  // The BIOS only changes when one is loaded
+    u32 m_epoch = 1;
+    u32 m_frameEpoch = 1;  // Epoch the current frame started in
+    u32 m_lastFrameDirtyPages = 0;
+    u64 m_dirtyPagesTotal = 0;
 };
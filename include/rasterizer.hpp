@@ -0,0 +1,85 @@
+#pragma once
+#include "utils.hpp"
+
+#define VRAM_WIDTH (1024)
+#define VRAM_HEIGHT (512)
+// VRAM buffers keep a spare halfword after the end, texels are fetched with 32-bit gathers
+#define VRAM_ALLOCATION_SIZE (VRAM_WIDTH * VRAM_HEIGHT + 2)
+
+// Inclusive rectangle in VRAM coordinates
+struct ClipRect {
+    s32 left = 0;
+    s32 top = 0;
+    s32 right = VRAM_WIDTH - 1;
+    s32 bottom = VRAM_HEIGHT - 1;
+};
+
+// Drawing environment, set by GP0 E1-E6
+struct DrawState {
+    ClipRect area;
+    s32 offsetX = 0;
+    s32 offsetY = 0;
+
+    u32 texBaseX = 0;
+    u32 texBaseY = 0;
+    u32 semiMode = 0;
+    u32 texDepth = 0;
+    bool dither = false;
+    bool drawToDisplay = false;
+    bool texDisable = false;
+    bool flipX = false;
+    bool flipY = false;
+
+    u32 windowMaskX = 0;
+    u32 windowMaskY = 0;
+    u32 windowOffsetX = 0;
+    u32 windowOffsetY = 0;
+
+    bool setMask = false;
+    bool checkMask = false;
+};
+
+struct Vertex {
+    s32 x, y;
+    s32 r, g, b;
+    s32 u, v;
+};
+
+// Per primitive attributes decoded from the command word and texpage/CLUT fields
+struct Primitive {
+    bool shaded = false;
+    bool textured = false;
+    bool rawTexture = false;
+    bool semiTransparent = false;
+    bool dither = false;
+
+    u32 semiMode = 0;
+    u32 texDepth = 0;
+    u32 texBaseX = 0;
+    u32 texBaseY = 0;
+    u32 clutX = 0;
+    u32 clutY = 0;
+    const u16* texture = nullptr;  // Page decoded by the texture cache, 256x256 texels indexed by v * 256 + u
+};
+
+// Software rasterizer drawing into a 1024x512 16bpp VRAM.
+// Every pixel is computed from its absolute VRAM coordinates, so drawing a primitive clipped to several rects
+// gives the same result as drawing it once
+namespace Rasterizer {
+enum class BACKEND { SCALAR, AVX2 };
+
+// The fastest supported backend is picked at startup. The scalar one is the reference for the others
+bool supported(BACKEND backend);
+BACKEND backend();
+void setBackend(BACKEND backend);
+
+// Primitives return the number of pixels they rasterized
+u32 triangle(u16* vram, const DrawState& state, const Primitive& prim, const Vertex* vertices, const ClipRect& clip);
+u32 rectangle(u16* vram, const DrawState& state, const Primitive& prim, const Vertex& origin, s32 width, s32 height,
+              const ClipRect& clip);
+u32 line(u16* vram, const DrawState& state, const Primitive& prim, const Vertex& a, const Vertex& b,
+         const ClipRect& clip);
+
+void fill(u16* vram, u32 x, u32 y, u32 width, u32 height, u16 color);
+void copy(u16* vram, const DrawState& state, u32 srcX, u32 srcY, u32 dstX, u32 dstY, u32 width, u32 height);
+}  // namespace Rasterizer
@@ -0,0 +1,135 @@
+#pragma once
+#include <algorithm>
+
+#include "rasterizer.hpp"
+
+// Pixel pipeline shared by the scalar and SIMD span shaders. Every SIMD path must give the same result as
+// shadePixel for every pixel
+namespace Rasterizer {
+
+// Attributes are interpolated in fixed point with 12 fractional bits
+enum Attribute { R, G, B, U, V, ATTRIBUTE_COUNT };
+static constexpr s32 FRACTION_BITS = 12;
+
+static constexpr s32 ditherTable[4][4] = {
+    {-4, 0, -3, 1},
+    {2, -2, 3, -1},
+    {-3, 1, -4, 0},
+    {3, -1, 2, -2},
+};
+
+// Plane equations of the attributes, evaluated from absolute coordinates
+struct Gradients {
+    s32 originX, originY;
+    s32 base[ATTRIBUTE_COUNT];
+    s32 dx[ATTRIBUTE_COUNT];
+    s32 dy[ATTRIBUTE_COUNT];
+
+    inline s32 at(int attribute, s32 x, s32 y) const {
+        return base[attribute] + dx[attribute] * (x - originX) + dy[attribute] * (y - originY);
+    }
+};
+
+static inline u16* pixelAt(u16* vram, u32 x, u32 y) {
+    return vram + (y & (VRAM_HEIGHT - 1)) * VRAM_WIDTH + (x & (VRAM_WIDTH - 1));
+}
+
+static inline u16 fetchTexel(const u16* vram, const DrawState& state, const Primitive& prim, u32 u, u32 v) {
+    u = (u & ~(state.windowMaskX * 8)) | ((state.windowOffsetX & state.windowMaskX) * 8);
+    v = (v & ~(state.windowMaskY * 8)) | ((state.windowOffsetY & state.windowMaskY) * 8);
+    if (prim.texture) return prim.texture[(v << 8) | u];
+
+    const u32 y = ((prim.texBaseY + v) & (VRAM_HEIGHT - 1)) * VRAM_WIDTH;
+    const u16* clut = vram + prim.clutY * VRAM_WIDTH;
+
+    switch (prim.texDepth) {
+        case 0: {  // 4bpp, 4 CLUT indices per halfword
+            const u16 word = vram[y + ((prim.texBaseX + u / 4) & (VRAM_WIDTH - 1))];
+            return clut[(prim.clutX + ((word >> ((u & 3) * 4)) & 0xf)) & (VRAM_WIDTH - 1)];
+        }
+        case 1: {  // 8bpp
+            const u16 word = vram[y + ((prim.texBaseX + u / 2) & (VRAM_WIDTH - 1))];
+            return clut[(prim.clutX + ((word >> ((u & 1) * 8)) & 0xff)) & (VRAM_WIDTH - 1)];
+        }
+        default:  // 15bpp direct
+            return vram[y + ((prim.texBaseX + u) & (VRAM_WIDTH - 1))];
+    }
+}
+
+static inline u16 blend(u16 back, u16 front, u32 mode) {
+    u16 result = 0;
+    for (u32 shift = 0; shift < 15; shift += 5) {
+        const s32 b = (back >> shift) & 0x1f;
+        const s32 f = (front >> shift) & 0x1f;
+        s32 c;
+        switch (mode) {
+            case 0: c = (b + f) >> 1; break;
+            case 1: c = std::min(b + f, 31); break;
+            case 2: c = std::max(b - f, 0); break;
+            default: c = std::min(b + (f >> 2), 31); break;
+        }
+        result |= c << shift;
+    }
+    return result;
+}
+
+// Shade and write one pixel. Colors are 8 bits per channel until the final conversion to 15bpp
+static inline void shadePixel(u16* vram, const DrawState& state, const Primitive& prim, s32 x, s32 y, s32 r, s32 g,
+                              s32 b, u32 u, u32 v) {
+    u16& dst = *pixelAt(vram, x, y);
+    if (state.checkMask && (dst & 0x8000)) return;
+
+    bool semiTransparent = prim.semiTransparent;
+    u16 maskBit = state.setMask ? 0x8000 : 0;
+
+    if (prim.textured) {
+        const u16 texel = fetchTexel(vram, state, prim, u, v);
+        if (texel == 0) return;  // Fully transparent
+
+        semiTransparent = semiTransparent && (texel & 0x8000);
+        maskBit |= texel & 0x8000;
+
+        const s32 tr = (texel & 0x1f) << 3;
+        const s32 tg = ((texel >> 5) & 0x1f) << 3;
+        const s32 tb = ((texel >> 10) & 0x1f) << 3;
+        if (prim.rawTexture) {
+            r = tr, g = tg, b = tb;
+        } else {
+            r = std::min((tr * r) >> 7, 255);
+            g = std::min((tg * g) >> 7, 255);
+            b = std::min((tb * b) >> 7, 255);
+        }
+    }
+
+    if (prim.dither) {
+        const s32 offset = ditherTable[y & 3][x & 3];
+        r = std::clamp(r + offset, 0, 255);
+        g = std::clamp(g + offset, 0, 255);
+        b = std::clamp(b + offset, 0, 255);
+    }
+
+    u16 color = (r >> 3) | ((g >> 3) << 5) | ((b >> 3) << 10);
+    if (semiTransparent) color = blend(dst, color, prim.semiMode);
+    dst = color | maskBit;
+}
+
+static inline void shadeSpanPixel(u16* vram, const DrawState& state, const Primitive& prim, const Gradients& grad,
+                                  s32 x, s32 y) {
+    const s32 r = std::clamp(grad.at(R, x, y) >> FRACTION_BITS, 0, 255);
+    const s32 g = std::clamp(grad.at(G, x, y) >> FRACTION_BITS, 0, 255);
+    const s32 b = std::clamp(grad.at(B, x, y) >> FRACTION_BITS, 0, 255);
+    const u32 u = (grad.at(U, x, y) >> FRACTION_BITS) & 0xff;
+    const u32 v = (grad.at(V, x, y) >> FRACTION_BITS) & 0xff;
+    shadePixel(vram, state, prim, x, y, r, g, b, u, v);
+}
+
+// Shade pixels left to right of row y. The span is already clipped
+using SpanShader = void (*)(u16* vram, const DrawState& state, const Primitive& prim, const Gradients& grad, s32 y,
+                            s32 left, s32 right);
+
+void shadeSpanScalar(u16* vram, const DrawState& state, const Primitive& prim, const Gradients& grad, s32 y, s32 left,
+                     s32 right);
+void shadeSpanAVX2(u16* vram, const DrawState& state, const Primitive& prim, const Gradients& grad, s32 y, s32 left,
+                   s32 right);
+
+}  // namespace Rasterizer
@@ -0,0 +1,54 @@
+#pragma once
+#include <fstream>
+#include <string>
+
+#include "renderer.hpp"
+#include "utils.hpp"
+
+#define RECORDING_MAGIC (0x52555047)  // "GPUR"
+#define RECORDING_VERSION (1)
+
+// Record types. The first three match RENDER_COMMAND
+enum class RECORD : u8 {
+    GP0,
+    VRAM_WRITE,
+    RESET,
+    GP1,     // One GP1 word, for reference only, the renderer state it changes is recorded as RESET
+    VBLANK,  // End of a frame
+};
+
+// Captures everything the GPU hands to the renderer, so frames can be replayed without emulating the CPU.
+// A recording is the magic and version words followed by records in the render queue format, a header word
+// (type << 24 | length) and length words. It starts with a snapshot of VRAM and the drawing environment
+class Recorder {
+  public:
+    // Record the given number of frames, 0 records until stop()
+    bool start(const std::string& path, Renderer& renderer, u32 frames);
+    void stop();
+    bool active() const { return m_file.is_open(); }
+
+    void command(RENDER_COMMAND command, const u32* words, u32 count) {
+        write(static_cast<RECORD>(command), words, count);
+    }
+    void gp1(u32 value) { write(RECORD::GP1, &value, 1); }
+    void vblank();
+
+  private:
+    void write(RECORD type, const u32* words, u32 count);
+
+    std::ofstream m_file;
+    u32 m_framesLeft = 0;
+};
+
+// Results of replaying a recording
+struct ReplayStats {
+    u64 frames = 0;
+    u64 commands = 0;
+    u64 pixels = 0;
+    double totalTime = 0.0;  // In seconds
+    double worstFrame = 0.0;
+    std::string vramHash;  // SHA-1 of VRAM at the end
+};
+
+// Feed a recording to a renderer on this thread, timing every frame. Returns false if the file is not a recording
+bool replay(const std::string& path, u32 threads, ReplayStats& stats);
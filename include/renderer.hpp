@@ -0,0 +1,76 @@
+#pragma once
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "binner.hpp"
+#include "rasterizer.hpp"
+#include "ringbuffer.hpp"
+#include "utils.hpp"
+
+class Serializer;
+
+#define RENDER_QUEUE_SIZE (1 << 16)  // In words
+
+// Each queued command is a header word (command << 24 | length) followed by length words
+enum class RENDER_COMMAND : u8 {
+    GP0,         // A complete GP0 packet
+    VRAM_WRITE,  // Data for the CPU to VRAM transfer started by the last A0 packet
+    RESET,       // GP1(00), back to the default drawing environment
+    QUIT,
+};
+
+// Executes GP0 packets on its own thread. The GPU queues complete packets through a lock-free ring and only waits
+// for the renderer when the CPU needs to see VRAM
+class Renderer {
+  public:
+    Renderer(bool threaded = true);
+    ~Renderer();
+
+    void push(RENDER_COMMAND command, const u32* words, u32 count);
+    // Wait until every queued command has been executed
+    void sync();
+    // VRAM and the drawing state, syncs first
+    void serialize(Serializer& s);
+
+    // Only safe to touch after sync()
+    u16* vram() { return m_vram.data(); }
+    const DrawState& state() const { return m_state; }
+    u64 pixelsDrawn() const { return m_binner.pixels(); }
+    // Changes whenever VRAM inside the rect is written, at 64x16 block granularity
+    u64 vramVersion(s32 left, s32 top, s32 right, s32 bottom) const {
+        return m_binner.textureCache().latestWrite(left, top, right, bottom);
+    }
+
+    // Threads used for rasterization, counting the renderer thread
+    void setThreads(u32 threads) { m_binner.setThreads(threads); }
+    u32 threads() const { return m_binner.threads(); }
+    const TextureCache& textureCache() const { return m_binner.textureCache(); }
+
+  private:
+    void threadMain();
+    bool runQueued();
+    void execute(RENDER_COMMAND command, const u32* words, u32 count);
+
+    void gp0(const u32* words, u32 count);
+    void polygon(const u32* words);
+    void line(const u32* words, u32 count);
+    void rectangle(const u32* words);
+    void vramWrite(const u32* words, u32 count);
+    void setTexpage(u32 value);
+    void submit(const DrawCommand& command) { m_binner.submit(command); }
+
+    RingBuffer<u32, RENDER_QUEUE_SIZE> m_queue;
+    std::vector<u32> m_packet;
+    bool m_threaded;
+    std::thread m_thread;
+
+    std::vector<u16> m_vram;
+    Binner m_binner{m_vram.data()};
+    DrawState m_state;
+
+    struct VramTransfer {
+        u32 x, y, width, height;
+        u32 position;  // Pixels written so far
+    } m_transfer{};
+};
@@ -0,0 +1,69 @@
+#pragma once
+#include <array>
+
+#include "utils.hpp"
+
+#define REVERB_BLOCK_SIZE (32)                // Samples per call at 44.1 kHz
+#define REVERB_STEPS (REVERB_BLOCK_SIZE / 2)  // Reverb runs at 22.05 kHz
+#define REVERB_RESAMPLE_TAPS (39)
+#define REVERB_INPUT_HISTORY (REVERB_RESAMPLE_TAPS - 1)
+#define REVERB_OUTPUT_HISTORY (REVERB_RESAMPLE_TAPS / 2)
+#define REVERB_RAM_END (0x40000)  // End of sound RAM, in halfwords
+
+// The reverb unit: comb and all-pass filters working on a ring buffer at the end of sound RAM, at half the output
+// rate. Registers are written through the SPU at 0x1f801d84, 0x1f801da2 and 0x1f801dc0-0x1f801dff.
+//
+// process() handles a block at a time. Input and output are resampled with the filter taps applied over the whole
+// block, and every buffer tap reads or writes REVERB_STEPS consecutive halfwords, split at most once where the ring
+// wraps. That only gives the same result as going sample by sample when no two taps come within a block of each
+// other, otherwise the buffer part falls back to processReference(), which is the per sample reference for the rest
+struct Reverb {
+    void reset();
+    void write(u32 offset, u16 value);
+
+    // Mix a block of reverb input into the buffer in sound RAM and return the reverb output for it
+    void process(u16* ram, const s32* inputLeft, const s32* inputRight, s32* outputLeft, s32* outputRight);
+    void processReference(u16* ram, const s32* inputLeft, const s32* inputRight, s32* outputLeft,
+                          s32* outputRight);
+    // Whether process() can work on whole blocks with the current layout
+    bool blockSafe() const { return !tapsOverlap(); }
+
+    std::array<u16, 32> m_regs{};  // 0x1f801dc0-0x1f801dff
+    s32 m_volumeLeft = 0;
+    s32 m_volumeRight = 0;
+    u32 m_base = 0;     // Start of the ring buffer, in halfwords
+    u32 m_current = 0;  // Current position in the ring buffer, in halfwords
+
+  private:
+    enum TAP : u32 {
+        SAME_LEFT,
+        SAME_RIGHT,
+        DIFF_LEFT,
+        DIFF_RIGHT,
+        APF1_LEFT,
+        APF1_RIGHT,
+        APF2_LEFT,
+        APF2_RIGHT,
+        WRITE_TAPS,
+    };
+
+    // Buffer offsets relative to the current position, in halfwords
+    s32 offset(u32 reg) const { return s32(m_regs[reg]) * 4; }
+    u32 address(s32 offset) const;
+    bool tapsOverlap() const;
+
+    void step(u16* ram, s32 inputLeft, s32 inputRight, s32& outputLeft, s32& outputRight);
+    void steps(u16* ram, const s32* inputLeft, const s32* inputRight, s32* outputLeft, s32* outputRight);
+    void gather(const u16* ram, s32 offset, s32* values) const;
+    void scatter(u16* ram, s32 offset, const s32* values) const;
+
+    void pushInput(const s32* inputLeft, const s32* inputRight);
+    void popHistory();
+
+    // Resampler history in front of the current block
+    std::array<std::array<s32, REVERB_INPUT_HISTORY + REVERB_BLOCK_SIZE>, 2> m_input{};
+    std::array<std::array<s32, REVERB_OUTPUT_HISTORY + REVERB_STEPS>, 2> m_output{};
+
+    bool m_layoutChanged = true;  // Registers changed since tapsOverlap() last ran
+    bool m_overlap = false;
+};
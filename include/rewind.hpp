@@ -0,0 +1,80 @@
+#pragma once
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+#include "utils.hpp"
+
+class Emulator;
+
+#define REWIND_INTERVAL (6)               // Frames between snapshots
+#define REWIND_BUDGET (64 * 1024 * 1024)  // Bytes of deltas kept, the oldest are dropped past this
+
+// In-memory rewind. Every few frames the whole state is serialized into a buffer. The newest snapshot is kept in
+// full, each older one as the XOR of it and the snapshot after it, run-length encoded into a byte ring of a fixed
+// size. Stepping back loads the newest snapshot and XORs the last delta into it, so it never walks a chain
+class Rewind {
+  public:
+    Rewind(Emulator& emulator) : m_emulator(emulator) {}
+
+    void setEnabled(bool enabled);
+    bool enabled() const { return m_enabled; }
+    void setInterval(u32 frames) { m_interval = std::max<u32>(frames, 1); }
+    void setBudget(size_t bytes);
+
+    // Drops every snapshot, after a reset or a loaded state
+    void clear();
+
+    // Called between instructions with the GPU frame counter, snapshots when enough frames passed
+    inline void poll(u64 frame) {
+        if (frame != m_frame) onFrame(frame);
+    }
+
+    void snapshot();
+    // Go back to the newest snapshot, or the one before when nothing ran since. False when there is nothing left
+    bool stepBack();
+
+    size_t snapshots() const { return m_entries.size() + (m_latestSize != 0); }
+    size_t memoryUsed() const { return m_used + m_latest.capacity() + m_next.capacity(); }
+    double secondsHeld() const { return m_entries.size() * m_interval / 60.0; }
+    // Average snapshot time per emulated frame and the cost of the last snapshot, in milliseconds
+    double frameCost() const { return m_frames ? m_snapshotTime * 1000.0 / m_frames : 0.0; }
+    double lastCost() const { return m_lastCost * 1000.0; }
+
+  private:
+    struct Entry {
+        size_t offset;  // In m_ring
+        u32 size;
+        u32 stateSize;  // Of the older snapshot
+        u64 frame;
+        u64 cycle;
+    };
+
+    void onFrame(u64 frame);
+    void store(const std::vector<u8>& delta, u32 stateSize);
+    void load();
+
+    Emulator& m_emulator;
+    bool m_enabled = false;
+    u32 m_interval = REWIND_INTERVAL;
+    size_t m_budget = REWIND_BUDGET;
+
+    std::vector<u8> m_ring;
+    std::deque<Entry> m_entries;  // Oldest first
+    size_t m_head = 0;            // Where the next delta goes in m_ring
+    size_t m_used = 0;
+
+    std::vector<u8> m_latest;  // Newest snapshot in full, zero padded past m_latestSize
+    size_t m_latestSize = 0;
+    u64 m_latestFrame = 0;
+    u64 m_latestCycle = 0;
+    u32 m_latestEpoch = 0;  // Memory checkpoints of the snapshots in m_latest and m_next, 0 when unknown
+    u32 m_nextEpoch = 0;
+    std::vector<u8> m_next;
+    std::vector<u8> m_delta;
+
+    u64 m_frame = 0;  // Last frame counter seen by poll
+    u64 m_frames = 0;
+    double m_snapshotTime = 0.0;
+    double m_lastCost = 0.0;
+};
@@ -0,0 +1,108 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <memory>
+#include <thread>
+
+#include "utils.hpp"
+
+// Lock-free single producer, single consumer ring buffer.
+// Head and tail only ever grow, the slot of an index is index % Capacity. Either side can block when the ring is
+// empty or full, the other side only issues a wake up when it sees the waiting flag
+template <typename T, size_t Capacity>
+class RingBuffer {
+    static_assert(std::has_single_bit(Capacity), "Ring buffer capacity must be a power of 2");
+    static constexpr size_t MASK = Capacity - 1;
+    static constexpr int SPIN_COUNT = 256;
+
+  public:
+    static constexpr size_t capacity() { return Capacity; }
+
+    // Producer side
+    size_t freeSpace() const { return Capacity - (m_written - m_head.load()); }
+
+    // Copies items in after anything already written, without making them visible yet. The caller makes sure
+    // they fit
+    void write(const T* items, size_t count) {
+        const size_t start = m_written & MASK;
+        const size_t first = std::min(count, Capacity - start);
+
+        std::copy(items, items + first, m_data.get() + start);
+        std::copy(items + first, items + count, m_data.get());
+        m_written += count;
+    }
+
+    // Make everything written so far visible to the consumer at once
+    void publish() {
+        m_tail.store(m_written);
+        if (m_consumerWaiting.load()) m_tail.notify_one();
+    }
+
+    void push(const T* items, size_t count) {
+        write(items, count);
+        publish();
+    }
+
+    void waitForSpace(size_t count) {
+        while (true) {
+            const size_t head = m_head.load();
+            if (Capacity - (m_written - head) >= count) return;
+            waitFor(m_head, head, m_producerWaiting);
+        }
+    }
+
+    // Wait until the consumer has popped everything
+    void waitEmpty() {
+        while (true) {
+            const size_t head = m_head.load();
+            if (head == m_written) return;
+            waitFor(m_head, head, m_producerWaiting);
+        }
+    }
+
+    // Consumer side
+    size_t available() const { return m_tail.load() - m_head.load(std::memory_order_relaxed); }
+    const T& peek(size_t index) const { return m_data[(m_head.load(std::memory_order_relaxed) + index) & MASK]; }
+
+    void read(size_t index, T* items, size_t count) const {
+        const size_t start = (m_head.load(std::memory_order_relaxed) + index) & MASK;
+        const size_t first = std::min(count, Capacity - start);
+
+        std::copy(m_data.get() + start, m_data.get() + start + first, items);
+        std::copy(m_data.get(), m_data.get() + (count - first), items + first);
+    }
+
+    void pop(size_t count) {
+        m_head.store(m_head.load(std::memory_order_relaxed) + count);
+        if (m_producerWaiting.load()) m_head.notify_one();
+    }
+
+    void waitForData() {
+        while (true) {
+            const size_t tail = m_tail.load();
+            if (tail != m_head.load(std::memory_order_relaxed)) return;
+            waitFor(m_tail, tail, m_consumerWaiting);
+        }
+    }
+
+  private:
+    // Spin for a bit before sleeping on the counter the other side advances
+    static void waitFor(std::atomic<size_t>& counter, size_t old, std::atomic<bool>& waiting) {
+        for (int i = 0; i < SPIN_COUNT; i++) {
+            if (counter.load(std::memory_order_relaxed) != old) return;
+            std::this_thread::yield();
+        }
+
+        waiting.store(true);
+        counter.wait(old);
+        waiting.store(false);
+    }
+
+    alignas(64) std::atomic<size_t> m_head = 0;
+    alignas(64) std::atomic<size_t> m_tail = 0;
+    size_t m_written = 0;  // Producer only, the tail including unpublished items
+    alignas(64) std::atomic<bool> m_producerWaiting = false;
+    alignas(64) std::atomic<bool> m_consumerWaiting = false;
+    std::unique_ptr<T[]> m_data = std::make_unique<T[]>(Capacity);
+};
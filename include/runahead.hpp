@@ -0,0 +1,54 @@
+#pragma once
+#include <vector>
+
+#include "utils.hpp"
+
+class Emulator;
+
+#define RUNAHEAD_MAX_FRAMES (4)
+#define RUNAHEAD_AVERAGE_FRAMES (60)  // Host frames the reported costs are averaged over
+
+// Run-ahead hides frames of game-side input latency. Each host frame runs one real frame, saves the state, runs
+// the next frames with the same input and shows the last of them, then restores the saved state. Speculative
+// frames produce no audio and only the last one is converted for display. Save and restore go through the
+// incremental serializer, so only RAM pages the speculative frames wrote are copied back
+class RunAhead {
+  public:
+    RunAhead(Emulator& emulator) : m_emulator(emulator) {}
+
+    void setFrames(u32 frames);
+    u32 frames() const { return m_frames; }
+    bool speculating() const { return m_speculating; }
+
+    // Run one host frame
+    void frame();
+
+    // Extra time per host frame spent saving, running ahead and restoring, and how much of it went to the save
+    // and the restore, in milliseconds
+    double frameCost() const { return m_frameCost * 1000.0; }
+    double saveCost() const { return m_saveCost * 1000.0; }
+    double restoreCost() const { return m_restoreCost * 1000.0; }
+
+  private:
+    void runFrame();
+    void setOutput(bool audio, bool video);
+    void save();
+    void restore();
+
+    Emulator& m_emulator;
+    u32 m_frames = 0;
+    bool m_speculating = false;
+
+    std::vector<u8> m_state;
+    u32 m_epoch = 0;  // Memory checkpoint of the state in m_state, 0 when it has to be saved in full
+
+    // Totals over the current averaging period, in seconds
+    u32 m_periodFrames = 0;
+    double m_periodTime = 0.0;
+    double m_periodSave = 0.0;
+    double m_periodRestore = 0.0;
+
+    double m_frameCost = 0.0;
+    double m_saveCost = 0.0;
+    double m_restoreCost = 0.0;
+};
@@ -0,0 +1,96 @@
+#pragma once
+#include <cstring>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "utils.hpp"
+
+#define SAVESTATE_MAGIC (0x53585350)  // "PSXS"
+#define SAVESTATE_VERSION (1)         // Bump whenever any serialize() changes
+
+struct SaveStateHeader {
+    u32 magic = SAVESTATE_MAGIC;
+    u32 version = SAVESTATE_VERSION;
+    u64 size = 0;  // Of the state that follows
+};
+
+// Walks the emulator state for save states. Every device has a serialize() visiting its state in a fixed order, and
+// the same function measures, saves or loads depending on the mode. Blocks are copied straight between the device
+// and the destination, a memory-mapped file or a buffer, with no staging copy in between
+class Serializer {
+  public:
+    enum class MODE : u8 { MEASURE, SAVE, LOAD };
+
+    // A nonzero since makes the save or load incremental: the buffer already holds the state as of that
+    // Memory::checkpoint(), and RAM pages not written after it are skipped
+    Serializer(MODE mode, u8* data = nullptr, size_t size = 0, u32 since = 0)
+        : m_mode(mode), m_data(data), m_size(size), m_since(since) {}
+
+    bool loading() const { return m_mode == MODE::LOAD; }
+    size_t position() const { return m_position; }
+    u32 since() const { return m_since; }
+    // Byte ranges of the buffer left untouched by skip(), in order and merged
+    const std::vector<std::pair<size_t, size_t>>& skipped() const { return m_skipped; }
+    // False once a save or load ran past the end of the buffer, nothing is copied after that
+    bool ok() const { return !m_overflow; }
+
+    void bytes(void* data, size_t size) {
+        if (m_overflow) return;
+        if (m_mode != MODE::MEASURE) {
+            if (size > m_size - m_position) {
+                m_overflow = true;
+                return;
+            }
+            if (m_mode == MODE::SAVE) {
+                std::memcpy(m_data + m_position, data, size);
+            } else {
+                std::memcpy(data, m_data + m_position, size);
+            }
+        }
+        m_position += size;
+    }
+
+    void skip(size_t size) {
+        if (m_overflow) return;
+        if (m_mode != MODE::MEASURE && size > m_size - m_position) {
+            m_overflow = true;
+            return;
+        }
+        if (!m_skipped.empty() && m_skipped.back().second == m_position) {
+            m_skipped.back().second += size;
+        } else {
+            m_skipped.push_back({m_position, m_position + size});
+        }
+        m_position += size;
+    }
+
+    template <typename T>
+        requires std::is_trivially_copyable_v<T>
+    void operator()(T& value) {
+        bytes(&value, sizeof(T));
+    }
+
+    template <typename T>
+    void operator()(std::vector<T>& values) {
+        u64 count = values.size();
+        (*this)(count);
+        if (loading()) {
+            if (!ok() || count > (m_size - m_position) / sizeof(T)) {
+                m_overflow = true;
+                return;
+            }
+            values.resize(count);
+        }
+        bytes(values.data(), count * sizeof(T));
+    }
+
+  private:
+    MODE m_mode;
+    u8* m_data;
+    size_t m_size;
+    size_t m_position = 0;
+    u32 m_since;
+    bool m_overflow = false;
+    std::vector<std::pair<size_t, size_t>> m_skipped;
+};
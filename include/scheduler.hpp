@@ -0,0 +1,58 @@
+#pragma once
+#include <array>
+#include <limits>
+
+#include "utils.hpp"
+
+class Emulator;
+class Serializer;
+
+#define CPU_CLOCK (33868800)
+#define CYCLES_PER_INSTRUCTION (2)
+
+// The GPU runs at 11/7 of the CPU clock
+#define GPU_CLOCK_NUM (11)
+#define GPU_CLOCK_DEN (7)
+#define GPU_CYCLES_PER_SCANLINE_NTSC (3413)
+#define GPU_CYCLES_PER_SCANLINE_PAL (3406)
+#define SCANLINES_NTSC (263)
+#define SCANLINES_PAL (314)
+
+enum class EVENT : u8 { DMA0, DMA1, DMA2, DMA3, DMA4, DMA5, DMA6, TIMER0, TIMER1, TIMER2, VBLANK, SPU, CDROM, CDROM_DRIVE, COUNT };
+
+// Keeps the global cycle count and runs device events when their deadline passes.
+// Devices schedule their next interesting point in time instead of being ticked every instruction
+class Scheduler {
+  public:
+    using Handler = void (*)(Emulator& emulator);
+
+    static constexpr u64 NEVER = std::numeric_limits<u64>::max();
+
+    Scheduler(Emulator& emulator) : m_emulator(emulator) { init(); }
+
+    void init();
+    void reset();
+    void serialize(Serializer& s);
+
+    // Schedule an event to run after the given amount of cycles, replacing any earlier deadline for it
+    void schedule(EVENT event, u64 cycles);
+    void cancel(EVENT event);
+
+    inline bool isScheduled(EVENT event) const { return m_deadlines[(size_t)event] != NEVER; }
+    inline u64 now() const { return m_cycles; }
+
+    inline void tick(u64 cycles) {
+        m_cycles += cycles;
+        if (m_cycles >= m_nextDeadline) runEvents();
+    }
+
+  private:
+    void runEvents();
+    void updateNextDeadline();
+
+    Emulator& m_emulator;
+    u64 m_cycles = 0;
+    u64 m_nextDeadline = NEVER;
+    std::array<u64, (size_t)EVENT::COUNT> m_deadlines{};
+    std::array<Handler, (size_t)EVENT::COUNT> m_handlers{};
+};
@@ -0,0 +1,137 @@
+#pragma once
+#include <array>
+#include <memory>
+
+#include "BitField.hpp"
+#include "reverb.hpp"
+#include "ringbuffer.hpp"
+#include "utils.hpp"
+
+class Emulator;
+class Serializer;
+
+#define SPU_RAM_SIZE (512 * 1024)
+#define SPU_VOICE_COUNT (24)
+#define SPU_SAMPLE_RATE (44100)
+#define SPU_CYCLES_PER_SAMPLE (768)         // CPU_CLOCK / SPU_SAMPLE_RATE
+#define SPU_BLOCK_SIZE (REVERB_BLOCK_SIZE)  // Samples mixed per scheduler event
+#define ADPCM_BLOCK_SAMPLES (28)
+#define ADPCM_BLOCK_SIZE (16)               // In bytes
+#define AUDIO_RING_SIZE (8192)              // Interleaved stereo samples, about 90ms
+
+union SpuControl {
+    BitField<0, 1, u16> cdAudio;
+    BitField<1, 1, u16> externalAudio;
+    BitField<2, 1, u16> cdReverb;
+    BitField<3, 1, u16> externalReverb;
+    BitField<4, 2, u16> transferMode;
+    BitField<6, 1, u16> irqEnable;
+    BitField<7, 1, u16> reverbEnable;
+    BitField<8, 2, u16> noiseStep;
+    BitField<10, 4, u16> noiseShift;
+    BitField<14, 1, u16> unmute;
+    BitField<15, 1, u16> enable;
+    u16 r;
+};
+
+enum class ADSR_PHASE : u8 { OFF, ATTACK, DECAY, SUSTAIN, RELEASE };
+
+// Rate of an envelope phase, decoded from the ADSR registers
+struct EnvelopeRate {
+    u32 shift = 0;
+    s32 step = 0;
+    bool exponential = false;
+    bool decreasing = false;
+};
+
+struct Voice {
+    // Registers
+    u16 volumeLeft = 0;
+    u16 volumeRight = 0;
+    u16 pitch = 0;
+    u16 startAddress = 0;  // In 8 byte units
+    u32 adsr = 0;
+    u16 repeatAddress = 0;
+
+    // Playback state
+    u32 address = 0;  // Next ADPCM block, in bytes
+    u32 counter = 0;  // Position in the decoded block with 12 fractional bits
+    s16 history[2] = {};
+    // The last sample of the previous block followed by the current block, for interpolating across the boundary
+    s16 samples[ADPCM_BLOCK_SAMPLES + 1] = {};
+    u8 flags = 0;  // Loop flags of the current block
+
+    ADSR_PHASE phase = ADSR_PHASE::OFF;
+    s32 level = 0;         // Envelope level, 0 to 0x7fff
+    u32 envelopeWait = 0;  // Samples left until the next envelope step
+};
+
+// Sound processing unit at 0x1f801c00. Voices are mixed in blocks of SPU_BLOCK_SIZE samples: each voice decodes
+// its ADPCM a block ahead and renders a whole block before moving on, and the block is pushed to the host audio
+// thread through a lock-free ring
+class Spu {
+  public:
+    Spu(Emulator& emulator);
+
+    void reset();
+    void serialize(Serializer& s);
+
+    // 32-bit accesses cover two registers
+    u32 read(u32 offset, u32 size = 2);
+    void write(u32 offset, u32 value, u32 size = 2);
+
+    // Sound RAM transfers on DMA channel 4
+    void dmaWrite(const u32* data, u32 words);
+    void dmaRead(u32* data, u32 words);
+
+    // Mix the next block of samples, run by the scheduler
+    void mixBlock();
+
+    u64 droppedSamples() const { return m_droppedSamples; }
+
+    // Interleaved stereo samples for the host audio thread, the only consumer
+    RingBuffer<s16, AUDIO_RING_SIZE> m_output;
+    bool m_outputEnabled = true;  // Off while run-ahead emulates frames that aren't heard
+
+  private:
+    u16 readRegister(u32 offset);
+    void writeRegister(u32 offset, u16 value);
+    void writeVoice(Voice& voice, u32 reg, u16 value);
+
+    void keyOn(u32 mask);
+    void keyOff(u32 mask);
+
+    void decodeBlock(u32 index);
+    void nextBlock(u32 index);
+    void renderVoice(u32 index, const s32* modulation, const s32* noise, s32* output);
+    void updateNoise(s32* noise);
+    void tickEnvelope(Voice& voice);
+    EnvelopeRate envelopeRate(const Voice& voice) const;
+
+    void checkIrq(u32 address, u32 size);
+    void writeRam(u16 value);
+
+    Emulator& m_emulator;
+    std::unique_ptr<u8[]> m_ram = std::make_unique<u8[]>(SPU_RAM_SIZE);
+    std::array<Voice, SPU_VOICE_COUNT> m_voices{};
+    std::array<u16, 0x200> m_regs{};  // Raw register values for readback, indexed by halfword
+    Reverb m_reverb;
+
+    SpuControl m_control{};
+    u16 m_status = 0;
+    u16 m_mainVolumeLeft = 0;
+    u16 m_mainVolumeRight = 0;
+    s16 m_cdVolumeLeft = 0;
+    s16 m_cdVolumeRight = 0;
+    u32 m_pitchModulation = 0;  // Voice bitmasks
+    u32 m_noiseEnable = 0;
+    u32 m_reverbEnable = 0;
+    u32 m_endx = 0;
+
+    u32 m_irqAddress = 0;       // In bytes
+    u32 m_transferAddress = 0;  // In bytes
+
+    s32 m_noiseLevel = 1;
+    s32 m_noiseTimer = 0;
+    u64 m_droppedSamples = 0;
+};
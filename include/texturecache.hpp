@@ -0,0 +1,62 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "rasterizer.hpp"
+#include "utils.hpp"
+
+#define TEXTURE_CACHE_SIZE (64)  // Decoded pages
+#define INVALID_KEY (0xffffffff)
+#define TEXTURE_PAGE_TEXELS (256 * 256 + 2)  // Padded like VRAM for 32-bit gathers of the last texel
+
+// VRAM is split in 64x16 blocks, the width of a 4bpp texture page
+#define VERSION_BLOCK_WIDTH (64)
+#define VERSION_BLOCK_HEIGHT (16)
+#define VERSION_BLOCKS_X (VRAM_WIDTH / VERSION_BLOCK_WIDTH)
+#define VERSION_BLOCKS_Y (VRAM_HEIGHT / VERSION_BLOCK_HEIGHT)
+
+// Paletted (4bpp and 8bpp) texture pages decoded to 15bpp texels, keyed by page, depth and CLUT.
+// Every VRAM write bumps the version of the blocks it touches, and an entry is only used while none of the blocks
+// it was decoded from changed since
+class TextureCache {
+  public:
+    TextureCache();
+
+    // Decoded page for a paletted primitive, or nullptr when it has to be decoded first
+    const u16* find(const Primitive& prim);
+    // Decode into a free entry, the cache must not be full
+    const u16* insert(const u16* vram, const Primitive& prim);
+    bool full() const { return m_used == TEXTURE_CACHE_SIZE; }
+    void clear();
+
+    // Called for every VRAM write
+    void invalidate(s32 left, s32 top, s32 right, s32 bottom);
+    // Version of the last write touching a rect, at block granularity. Coordinates wrap
+    u64 latestWrite(s32 left, s32 top, s32 right, s32 bottom) const;
+
+    u64 hits() const { return m_hits.load(std::memory_order_relaxed); }
+    u64 misses() const { return m_misses.load(std::memory_order_relaxed); }
+
+  private:
+    struct Entry {
+        u32 key;
+        u64 version;  // Version counter when it was decoded
+        std::unique_ptr<u16[]> texels;
+    };
+
+    static u32 keyOf(const Primitive& prim);
+    u64 latestWrite(const Primitive& prim) const;
+    Entry* lookup(u32 key);
+
+    std::vector<Entry> m_entries;
+    u32 m_used = 0;
+
+    std::array<u64, VERSION_BLOCKS_X * VERSION_BLOCKS_Y> m_blockVersions{};
+    u64 m_version = 0;
+
+    // Written by the renderer thread only, read by the GUI
+    std::atomic<u64> m_hits = 0;
+    std::atomic<u64> m_misses = 0;
+};
@@ -0,0 +1,47 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "utils.hpp"
+
+// Fixed set of worker threads running parallel for loops. The calling thread takes part in every loop
+class ThreadPool {
+  public:
+    ThreadPool() = default;
+    ~ThreadPool() { resize(1); }
+
+    // Total number of threads, counting the caller
+    void resize(u32 threads);
+    u32 size() const { return m_workers.size() + 1; }
+
+    // Call fn(i) for i in [0, count) spread over the threads, returns once all calls finished
+    template <typename Fn>
+    void run(size_t count, Fn&& fn) {
+        using Function = std::remove_reference_t<Fn>;
+        dispatch(count, [](void* context, size_t i) { (*static_cast<Function*>(context))(i); }, &fn);
+    }
+
+  private:
+    using Task = void (*)(void* context, size_t index);
+
+    void dispatch(size_t count, Task task, void* context);
+    void work();
+    void workerMain(u64 generation);
+
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_start;
+    std::condition_variable m_done;
+
+    Task m_task = nullptr;
+    void* m_context = nullptr;
+    size_t m_count = 0;
+    std::atomic<size_t> m_next = 0;
+    u64 m_generation = 0;
+    u32 m_busy = 0;
+    bool m_quit = false;
+};
@@ -0,0 +1,76 @@
+#pragma once
+#include <array>
+
+#include "BitField.hpp"
+#include "utils.hpp"
+
+class Emulator;
+class Serializer;
+
+union TimerMode {
+    BitField<0, 1, u32> syncEnable;
+    BitField<1, 2, u32> syncMode;
+    BitField<3, 1, u32> resetAtTarget;
+    BitField<4, 1, u32> irqAtTarget;
+    BitField<5, 1, u32> irqAtOverflow;
+    BitField<6, 1, u32> irqRepeat;
+    BitField<7, 1, u32> irqToggle;
+    BitField<8, 2, u32> clockSource;
+    BitField<10, 1, u32> irqFlag;  // 0 while an IRQ is requested
+    BitField<11, 1, u32> reachedTarget;
+    BitField<12, 1, u32> reachedOverflow;
+    u32 r;
+};
+
+// Counters advance at a rational rate of num/den ticks per CPU cycle
+struct ClockRate {
+    u64 num;
+    u64 den;
+
+    inline u64 ticksAt(u64 cycle) const { return cycle * num / den; }
+    inline u64 cycleOfTick(u64 tick) const { return (tick * den + num - 1) / num; }
+};
+
+struct Timer {
+    TimerMode mode{};
+    u32 target = 0;
+    u32 base = 0;       // Counter value at the stamp
+    u64 stamp = 0;      // Cycle of the last write or rate change
+    u64 flagStamp = 0;  // Cycle up to which the reached flags are up to date
+    ClockRate rate{1, 1};
+    bool irqFired = false;
+};
+
+// Root counters at 0x1f801100-0x1f80112f.
+// Counters aren't ticked, their value is derived from the cycles elapsed since the last write. Only the next
+// target or overflow IRQ is scheduled
+class Timers {
+  public:
+    Timers(Emulator& emulator) : m_emulator(emulator) {}
+
+    void reset();
+    void serialize(Serializer& s);
+
+    u32 read(u32 offset);
+    void write(u32 offset, u32 value);
+
+    void onEvent(u32 index);
+
+    // The dot clock or scanline length changed, counters clocked by the GPU need a new rate
+    void updateVideoClocks();
+
+  private:
+    ClockRate clockRate(u32 index) const;
+    u32 period(const Timer& timer) const;
+    u32 valueAfter(const Timer& timer, u64 ticks) const;
+    u64 ticksToReach(const Timer& timer, u32 value) const;
+    bool reachedBetween(const Timer& timer, u32 value, u64 from, u64 to) const;
+
+    u32 counter(u32 index);
+    void rebase(u32 index);
+    void updateFlags(u32 index);
+    void scheduleIrq(u32 index);
+
+    Emulator& m_emulator;
+    std::array<Timer, 3> m_timers{};
+};
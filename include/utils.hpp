@@ -1,14 +1,19 @@
 #pragma once
 #include <bitset>
-#include <fstream>
+#include <cstring>
 #include <iostream>
 #include <utility>  // For std::pair, used by loadROMWithHash
 #include <vector>
 
 #include "fmt/color.h"   // Text coloring fmt functions
 #include "fmt/format.h"  // Core fmt functions
+#include "mio/mio.hpp"   // For memory-mapping ROMs, used by mapROM
 #include "sha1.hpp"      // For calculating SHA hashes, used by loadROMWithHash
 
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>  // For __cpuidex, used by avx2Supported
+#endif
+
 using u8 = std::uint8_t;
 using u16 = std::uint16_t;
 using u32 = std::uint32_t;
@@ -68,35 +73,33 @@ static void warn(const char* fmt, const Args&... args) {
     fmt::print(fg(fmt::color::red), fmt, args...);
 }
 
-// Read a ROM into a vector of uint8_t
-static auto loadROM(std::string directory) {
-    std::ifstream file(directory, std::ios::binary);
-    if (file.fail()) panic("Couldn't read file at {}\n", directory.c_str());
-
-    std::vector<u8> ROM;
-    file.unsetf(std::ios::skipws);
-
-    ROM.insert(ROM.begin(), std::istream_iterator<uint8_t>(file), std::istream_iterator<uint8_t>());
-
-    file.close();
+// Memory-map a ROM read-only. The mapping is empty if the file couldn't be mapped
+static auto mapROM(const std::string& directory) {
+    std::error_code error;
+    auto ROM = mio::make_mmap<mio::ummap_source>(directory, 0, mio::map_entire_file, error);
+    if (error) ROM.unmap();
     return ROM;
 }
 
-// Read a ROM into a vector of uint8_t. Return the ROM and its SHA-1 hash
-static auto loadROMWithHash(std::string directory) -> std::pair<std::vector<u8>, std::string> {
-    std::ifstream file(directory, std::ios::binary);
-    if (file.fail()) panic("Couldn't read file at {}\n", directory.c_str());
+// Copy a ROM into dest straight from its mapping. Returns the ROM size, or 0 if it doesn't fit in maxSize
+static size_t loadROM(const std::string& directory, u8* dest, size_t maxSize) {
+    auto ROM = mapROM(directory);
+    if (!ROM.is_mapped()) panic("Couldn't read file at {}\n", directory.c_str());
+    if (ROM.size() > maxSize) return 0;
 
-    std::vector<u8> ROM;
-    file.unsetf(std::ios::skipws);
+    std::memcpy(dest, ROM.data(), ROM.size());
+    return ROM.size();
+}
 
-    ROM.insert(ROM.begin(), std::istream_iterator<uint8_t>(file), std::istream_iterator<uint8_t>());
+// Copy a ROM into dest straight from its mapping. Return the ROM size and its SHA-1 hash
+static auto loadROMWithHash(const std::string& directory, u8* dest, size_t maxSize) -> std::pair<size_t, std::string> {
+    auto ROM = mapROM(directory);
+    if (!ROM.is_mapped()) panic("Couldn't read file at {}\n", directory.c_str());
+    if (ROM.size() > maxSize) return std::make_pair(0, std::string());
 
-    file.clear();                         // Clear fail and EOF flags
-    file.seekg(0, std::ios::beg);         // Seek back to the start to calculate the SHA-1 checksum
-    auto hash = SHA1::from_stream(file);  // Calculate the checksum
-    file.close();                         // Close the file
-    return std::make_pair(ROM, hash);     // Return the vector and its hash
+    auto hash = SHA1::from_buffer(ROM.data(), ROM.size());  // Calculate the checksum over the mapping
+    std::memcpy(dest, ROM.data(), ROM.size());
+    return std::make_pair(ROM.size(), hash);  // Return the size and the hash
 }
 
 static constexpr bool buildingInDebugMode() {
@@ -200,4 +203,21 @@ inline int popcnt32(int number) {
     return std::bitset<32>{number}.count();
 #endif
 }
+
+// Picks between the scalar and AVX2 versions of the rasterizer, XA resampler and IDCT. May run from a static
+// initializer
+inline bool avx2Supported() {
+#if defined(__x86_64__) || defined(_M_X64)
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+#else
+    return false;
+#endif
+}
 }  // namespace Helpers
@@ -0,0 +1,87 @@
+#pragma once
+#include <array>
+#include <thread>
+
+#include "BitField.hpp"
+#include "ringbuffer.hpp"
+#include "utils.hpp"
+
+class Serializer;
+
+#define XA_SOUND_GROUPS (18)  // Per sector
+#define XA_GROUP_SIZE (128)
+#define XA_GROUP_SAMPLES (224)  // 4-bit samples in a sound group, half as many 8-bit ones
+#define XA_PHASES (7)           // 37.8 and 18.9 kHz are 6/7 and 3/7 of the SPU rate
+#define XA_TAPS (16)            // Per phase
+#define XA_INPUT_RING (32)      // Sectors waiting for the decoder thread
+#define XA_OUTPUT_RING (65536)  // Interleaved stereo samples at the SPU rate, about 0.74 s
+
+// Output frames of the shortest sectors, 8-bit stereo at 37.8 kHz. Sectors waiting for the decoder are already
+// counted against the output, so the input ring never fills before the output does
+#define XA_MIN_SECTOR_FRAMES (1175)
+static_assert(XA_INPUT_RING > XA_OUTPUT_RING / 2 / XA_MIN_SECTOR_FRAMES);
+
+union XaCoding {
+    BitField<0, 2, u8> stereo;
+    BitField<2, 2, u8> halfRate;  // 18.9 kHz instead of 37.8 kHz
+    BitField<4, 2, u8> eightBit;
+    BitField<6, 1, u8> emphasis;
+    u8 r;
+};
+
+struct XaSector {
+    u8 coding = 0;  // XaCoding
+    bool stop = false;  // Tells the decoder thread to exit
+    std::array<u8, XA_SOUND_GROUPS * XA_GROUP_SIZE> data{};
+};
+
+namespace XA {
+using Resampler = u32 (*)(const s16* input, u32 count, u32 position, u32 step, s16* output);
+
+// Polyphase filter for one channel. input holds XA_TAPS - 1 samples of history followed by count new ones, position
+// is in 1/XA_PHASES of an input sample. Writes every other s16 of output and returns the number of frames
+u32 resampleScalar(const s16* input, u32 count, u32 position, u32 step, s16* output);
+u32 resampleAVX2(const s16* input, u32 count, u32 position, u32 step, s16* output);
+
+// Coefficients of each phase, oldest sample first, in Q15
+extern const std::array<std::array<s16, XA_TAPS>, XA_PHASES> coefficients;
+}  // namespace XA
+
+// XA-ADPCM audio from the CD. Sectors are decoded and resampled to the SPU rate on a thread of their own. The
+// emulation thread tracks how many samples each sector turns into, so the SPU pulls the same samples at the same
+// time no matter how far the decoder thread has got
+class XaDecoder {
+  public:
+    XaDecoder();
+    ~XaDecoder();
+
+    // Only call while no sector is being read
+    void reset();
+    // Waits for the decoder thread to go idle first
+    void serialize(Serializer& s);
+
+    // Queue the 2304 bytes of sound groups of a sector. Returns false if the sector would overflow the output, it
+    // is dropped then
+    bool submit(XaCoding coding, const u8* data);
+
+    // Samples at the SPU rate, zeroes once the buffered ones run out
+    void read(s16* left, s16* right, u32 count);
+
+  private:
+    void decoderLoop();
+    void decode(const XaSector& sector);
+
+    RingBuffer<XaSector, XA_INPUT_RING> m_input;
+    RingBuffer<s16, XA_OUTPUT_RING> m_output;
+    std::thread m_thread;
+
+    // Emulation thread
+    u32 m_position = 0;  // Mirrors the decoder's resampling position
+    u32 m_buffered = 0;  // Frames submitted and not read yet
+
+    // Decoder thread
+    XA::Resampler m_resample;
+    s32 m_history[2][2] = {};
+    std::array<std::array<s16, XA_TAPS - 1 + XA_SOUND_GROUPS * XA_GROUP_SAMPLES>, 2> m_samples{};
+    u32 m_decoderPosition = 0;
+};
@@ -0,0 +1,25 @@
+#include "audiostream.hpp"
+
+#include <algorithm>
+
+AudioStream::AudioStream(Spu& spu) : m_spu(spu) { initialize(2, SPU_SAMPLE_RATE); }
+
+// The stream thread calls onGetData, it has to be stopped before this object goes away
+AudioStream::~AudioStream() { stop(); }
+
+// Hand over whatever the SPU mixed so far and pad the rest with silence, waiting would stall the audio device
+bool AudioStream::onGetData(Chunk& data) {
+    auto& ring = m_spu.m_output;
+    const size_t count = std::min<size_t>(ring.available() & ~size_t(1), m_chunk.size());
+    ring.read(0, m_chunk.data(), count);
+    ring.pop(count);
+
+    if (count < m_chunk.size()) {
+        std::fill(m_chunk.begin() + count, m_chunk.end(), 0);
+        m_underruns.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    data.samples = m_chunk.data();
+    data.sampleCount = m_chunk.size();
+    return true;
+}
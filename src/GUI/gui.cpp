@@ -10,7 +10,6 @@
 GUI::GUI(Emulator& emulator) : window(sf::VideoMode(1366, 768), "PSX Emulator"), emulator(emulator) {
     window.setFramerateLimit(60);  // cap FPS to 60
     ImGui::SFML::Init(window);     // Init Imgui-SFML
-    display.create(Emulator::width, Emulator::height);
 
     auto& io = ImGui::GetIO();                             // Set some ImGui options
     io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;  // Enable navigation with keyboard
@@ -18,6 +17,8 @@ GUI::GUI(Emulator& emulator) : window(sf::VideoMode(1366, 768), "PSX Emulator"),
     io.ConfigFlags |= ImGuiConfigFlags_ViewportsEnable;    // Configure viewport feature
     io.ConfigFlags |= ImGuiConfigFlags_DpiEnableScaleViewports;
     io.ConfigFlags |= ImGuiConfigFlags_DpiEnableScaleFonts;
+
+    m_audio.play();
 }
 
 void GUI::update() {
@@ -28,8 +29,17 @@ void GUI::update() {
         if (event.type == sf::Event::Closed) window.close();
     }
 
-    while (emulator.isRunning && (emulator.m_cpu.m_regs.cycles < REFRESH_COUNT)) {
-        emulator.runFrame();
+    // Holding backspace rewinds one snapshot per GUI frame instead of running
+    auto& rewind = emulator.m_rewind;
+    if (rewind.enabled() && window.hasFocus() && sf::Keyboard::isKeyPressed(sf::Keyboard::BackSpace)) {
+        rewind.stepBack();
+    } else if (emulator.isRunning && emulator.m_runAhead.frames()) {
+        // Run-ahead works in whole frames, one per host frame
+        emulator.m_runAhead.frame();
+    } else {
+        while (emulator.isRunning && (emulator.m_cpu.m_regs.cycles < REFRESH_COUNT)) {
+            emulator.runFrame();
+        }
     }
     emulator.m_cpu.m_regs.cycles = 0;
 
@@ -62,25 +72,41 @@ void GUI::update() {
         m_memviewer.draw();
     }
 
+    if (m_perfoverlay.m_draw) {
+        m_perfoverlay.draw();
+    }
+
     drawGUI();
 }
 
 void GUI::showMenuBar() {
     static const char* romTypes[] = {"*.bin", "*.rom"};  // Some generic filetypes for ROMs, configure as you want
+    static const char* exeTypes[] = {"*.exe", "*.psx", "*.psexe"};
+    static const char* discTypes[] = {"*.cue", "*.bin", "*.img", "*.chd"};
+    static const char* stateTypes[] = {"*.state"};
 
     if (ImGui::BeginMainMenuBar()) {
         if (ImGui::BeginMenu("File")) {  // Show file selection dialog if open ROM button is pressed
             if (ImGui::MenuItem("Open ROM", nullptr)) {
                 auto file = tinyfd_openFileDialog("Choose a ROM",  // File explorer window title
                                                   "",              // Default directory
-                                                  2,               // Amount of file types
-                                                  romTypes,        // Array of file types
-                                                  "ROMs",          // File type description in file explorer window
+                                                  3,               // Amount of file types
+                                                  exeTypes,        // Array of file types
+                                                  "PS-X EXE",      // File type description in file explorer window
                                                   0);
 
                 if (file != nullptr) {  // Check if file dialog was canceled
                     const auto path = std::filesystem::path(file);
                     fmt::print("Opened file {}\n", path.string());
+                    emulator.loadExe(path.string());
+                }
+            }
+
+            if (ImGui::MenuItem("Open Disc", nullptr)) {
+                auto file = tinyfd_openFileDialog("Choose a disc image", "", 4, discTypes, "Disc image", 0);
+
+                if (file != nullptr) {  // Check if file dialog was canceled
+                    emulator.loadDisc(file);
                 }
             }
 
@@ -98,9 +124,26 @@ void GUI::showMenuBar() {
                 }
             }
 
-            if (ImGui::MenuItem("Save state", nullptr)) fmt::print("Save state");
+            if (ImGui::MenuItem("Save state", nullptr)) {
+                if (auto file = tinyfd_saveFileDialog("Save state", "psx.state", 1, stateTypes, "Save state")) {
+                    emulator.saveState(file);
+                }
+            }
+
+            if (ImGui::MenuItem("Load state", nullptr)) {
+                if (auto file = tinyfd_openFileDialog("Load state", "", 1, stateTypes, "Save state", 0)) {
+                    emulator.loadState(file);
+                }
+            }
 
-            if (ImGui::MenuItem("Load state", nullptr)) fmt::print("Load state");
+            auto& gpu = emulator.m_gpu;
+            if (ImGui::MenuItem("Record GPU", nullptr, gpu.m_recorder.active())) {
+                if (gpu.m_recorder.active()) {
+                    gpu.m_recorder.stop();
+                } else if (auto file = tinyfd_saveFileDialog("Record GPU commands", "gpu.rec", 0, nullptr, nullptr)) {
+                    if (!gpu.m_recorder.start(file, gpu.m_renderer, 0)) fmt::print("Couldn't open {}\n", file);
+                }
+            }
 
             if (ImGui::MenuItem("Show ImGui Demo", nullptr, &m_showDemo))
                 ;
@@ -116,6 +159,29 @@ void GUI::showMenuBar() {
             if (ImGui::MenuItem("Step", nullptr)) emulator.step();
             ImGui::MenuItem("Run", nullptr, &emulator.isRunning);
             ImGui::MenuItem("Enable Logs", nullptr, &emulator.m_enableLog);
+
+            auto& speed = emulator.m_cdrom.m_speed;
+            bool fastReads = speed.readMultiplier > 1;
+            if (ImGui::MenuItem("Fast CD reads", nullptr, &fastReads)) {
+                speed.readMultiplier = fastReads ? CDROM_FAST_MULTIPLIER : 1;
+            }
+            ImGui::MenuItem("Instant CD seeks", nullptr, &speed.instantSeek);
+
+            auto& rewind = emulator.m_rewind;
+            bool rewindEnabled = rewind.enabled();
+            if (ImGui::MenuItem("Rewind", nullptr, &rewindEnabled)) rewind.setEnabled(rewindEnabled);
+            if (ImGui::MenuItem("Step back", "Backspace", false, rewind.enabled())) rewind.stepBack();
+
+            auto& runAhead = emulator.m_runAhead;
+            if (ImGui::BeginMenu("Run-ahead")) {
+                for (u32 frames = 0; frames <= RUNAHEAD_MAX_FRAMES; frames++) {
+                    const auto label = frames ? fmt::format("{} frame{}", frames, frames > 1 ? "s" : "") : "Off";
+                    if (ImGui::MenuItem(label.c_str(), nullptr, runAhead.frames() == frames)) {
+                        runAhead.setFrames(frames);
+                    }
+                }
+                ImGui::EndMenu();
+            }
             ImGui::EndMenu();
         }
 
@@ -125,6 +191,7 @@ void GUI::showMenuBar() {
             ImGui::MenuItem("Disassembly", nullptr, &m_disassembly.m_draw);
             ImGui::MenuItem("Registers", nullptr, &m_regviewer.m_draw);
             ImGui::MenuItem("Memory", nullptr, &m_memviewer.m_draw);
+            ImGui::MenuItem("Performance", nullptr, &m_perfoverlay.m_draw);
             ImGui::EndMenu();
         }
 
@@ -132,21 +199,42 @@ void GUI::showMenuBar() {
     }
 }
 
-// TODO: Optimize this
-// This is fairly slow, so for best measure if you don't want presentation to bottleneck emulation too much
-// You should have the emulator on a separate thread from the GUI
+// Upload a new guest frame into the back texture, only the rows changed since that texture was last filled
+void GUI::uploadDisplay() {
+    const auto& frame = emulator.m_gpu.m_framebuffer;
+    if (frame.generation == displayGenerations[displayFront]) return;
+
+    const int back = displayFront ^ 1;
+    auto& texture = displays[back];
+    const auto pixels = reinterpret_cast<const sf::Uint8*>(frame.pixels.data());
+
+    if (texture.getSize() != sf::Vector2u(frame.width, frame.height)) {
+        texture.create(frame.width, frame.height);
+        texture.update(pixels);
+    } else {
+        const auto [first, last] = frame.changedRows(displayGenerations[back]);
+        if (first < last) texture.update(pixels + first * frame.width * 4, frame.width, last - first, 0, first);
+    }
+
+    displayGenerations[back] = frame.generation;
+    displayFront = back;
+    displaySprite.setTexture(texture, true);
+}
+
 void GUI::showDisplay() {
     if (ImGui::Begin("Display")) {
-        const auto size = ImGui::GetContentRegionAvail();
-        const auto scale_x = size.x / Emulator::width;
-        const auto scale_y = size.y / Emulator::height;
-        const auto scale = scale_x < scale_y ? scale_x : scale_y;
+        uploadDisplay();
 
-        display.update(emulator.framebuffer.data());
-        sf::Sprite sprite(display);
-        sprite.setScale(scale, scale);
-
-        ImGui::Image(sprite);
+        const auto size = ImGui::GetContentRegionAvail();
+        const auto textureSize = displays[displayFront].getSize();
+        if (textureSize.x != 0 && textureSize.y != 0) {
+            const auto scale_x = size.x / textureSize.x;
+            const auto scale_y = size.y / textureSize.y;
+            const auto scale = scale_x < scale_y ? scale_x : scale_y;
+
+            displaySprite.setScale(scale, scale);
+            ImGui::Image(displaySprite);
+        }
         ImGui::End();
     }
 }
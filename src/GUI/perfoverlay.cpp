@@ -0,0 +1,58 @@
+#include "perfoverlay.hpp"
+
+#include "imgui.h"
+
+void PerfOverlay::sample() {
+    const auto now = std::chrono::steady_clock::now();
+    const double elapsed = std::chrono::duration<double>(now - m_lastSample).count();
+    if (elapsed < 1.0) return;
+
+    const auto& cache = m_emulator.m_gpu.m_renderer.textureCache();
+    const u64 frames = m_emulator.m_gpu.m_frameCount;
+    const u64 hits = cache.hits() - m_lastHits;
+    const u64 lookups = hits + cache.misses() - m_lastMisses;
+
+    m_fps = (frames - m_lastFrames) / elapsed;
+    m_hitRate = lookups ? 100.0 * hits / lookups : 0.0;
+    const u64 dirtyPages = m_emulator.m_mem.dirtyPagesTotal();
+    m_dirtyPages = frames > m_lastFrames ? double(dirtyPages - m_lastDirtyPages) / (frames - m_lastFrames) : 0.0;
+
+    m_lastSample = now;
+    m_lastFrames = frames;
+    m_lastHits = cache.hits();
+    m_lastMisses = cache.misses();
+    m_lastDirtyPages = dirtyPages;
+}
+
+void PerfOverlay::draw() {
+    sample();
+
+    const auto flags = ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_AlwaysAutoResize |
+                       ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoFocusOnAppearing |
+                       ImGuiWindowFlags_NoNav;
+    ImGui::SetNextWindowBgAlpha(0.35f);
+    if (!ImGui::Begin("Performance", &m_draw, flags)) {
+        ImGui::End();
+        return;
+    }
+
+    const auto& renderer = m_emulator.m_gpu.m_renderer;
+    ImGui::Text("FPS: %.1f", m_fps);
+    ImGui::Text("Render threads: %u", renderer.threads());
+    ImGui::Text("Texture cache hits: %.1f%%", m_hitRate);
+    ImGui::Text("Dirty RAM pages: %.1f/frame of %u, last frame %u", m_dirtyPages, RAM_PAGES,
+                m_emulator.m_mem.lastFrameDirtyPages());
+
+    const auto& runAhead = m_emulator.m_runAhead;
+    if (runAhead.frames()) {
+        ImGui::Text("Run-ahead: %u frames, +%.2fms/frame (save %.2fms, restore %.2fms)", runAhead.frames(),
+                    runAhead.frameCost(), runAhead.saveCost(), runAhead.restoreCost());
+    }
+
+    const auto& rewind = m_emulator.m_rewind;
+    if (rewind.enabled()) {
+        ImGui::Text("Rewind: %.1fs in %.1fMB, %.3fms/frame", rewind.secondsHeld(), rewind.memoryUsed() / 1048576.0,
+                    rewind.frameCost());
+    }
+    ImGui::End();
+}
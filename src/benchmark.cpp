@@ -0,0 +1,947 @@
+#include "benchmark.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "emulator.hpp"
+#include "fmt/format.h"
+#include "mdec.hpp"
+#include "rasterizer.hpp"
+#include "rasterizer_span.hpp"
+#include "renderer.hpp"
+#include "reverb.hpp"
+
+namespace Benchmark {
+
+using Clock = std::chrono::steady_clock;
+
+// Keep the compiler from hoisting memory accesses out of a benchmark loop
+static inline void clobber() { asm volatile("" : : : "memory"); }
+
+// Time a function and print its throughput in millions of operations per second
+template <typename Fn>
+static double measure(const char* name, u64 operations, Fn&& fn) {
+    const auto start = Clock::now();
+    fn();
+    const auto elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    const auto rate = operations / elapsed;
+    fmt::print("{:<32} {:>10.3f}ms {:>12.2f} Mops/s\n", name, elapsed * 1000.0, rate / 1000000.0);
+    return rate;
+}
+
+// The baseline for memory(): psxRead32/psxWrite32 as they were before read<T>/write<T>, testing each region's
+// range in turn and checking whether to log every access. Only the regions the benchmark touches are kept. Out of
+// line, like read<T>/write<T> and the originals in mem.cpp
+[[gnu::noinline]] static u32 psxRead32(Emulator& emulator, u32 address) {
+    auto& mem = emulator.m_mem;
+    if (address % 4 != 0) {
+        emulator.log("Unaligned psxRead32 at address {:#x}\n", address);
+        return 0;
+    }
+    const u32 hw_address = address & 0x1fffffff;
+
+    if (mem.CACHECONTROL.contains(address)) return 0;
+    if (mem.BIOS.contains(hw_address)) {
+        emulator.log("psxRead32 BIOS address: {:#x}, hw_address {:#x}\n", address, hw_address);
+        return Memory::load<u32>(mem.m_bios, mem.BIOS.offset(hw_address));
+    }
+    if (mem.RAM.contains(hw_address)) {
+        emulator.log("psxRead32 RAM address: {:#x}, hw_address {:#x}\n", address, hw_address);
+        return Memory::load<u32>(mem.m_ram, mem.RAM.offset(hw_address));
+    }
+    emulator.log("psxRead32: Unmatched memory region at address {:#x}, hw_address {:#x}\n", address, hw_address);
+    return 0;
+}
+
+[[gnu::noinline]] static void psxWrite32(Emulator& emulator, u32 address, u32 value) {
+    auto& mem = emulator.m_mem;
+    if (address % 4 != 0) {
+        emulator.log("Unaligned psxWrite32 at address {:#x}\n", address);
+        return;
+    }
+    const u32 hw_address = address & 0x1fffffff;
+
+    if (mem.CACHECONTROL.contains(address)) return;
+    if (mem.RAM.contains(hw_address)) {
+        const u32 offset = mem.RAM.offset(hw_address);
+        Memory::store<u32>(mem.m_ram, offset, value);
+        emulator.log("psxWrite32 RAM address: {:#x}, offset: {:#x}, value: {:#x}\n", hw_address, offset, value);
+        return;
+    }
+    emulator.log("psxWrite32: Unmatched memory region at address {:#x}, hw_address {:#x}, value: {:#x}\n", address,
+                 hw_address, value);
+}
+
+// Mixed-width guest memory accesses across RAM (cached and uncached mirrors), BIOS and scratchpad. The 32-bit ones
+// are also timed through the old psxRead32/psxWrite32 path. write<u32> includes the dirty page tracking the old
+// path didn't have
+static void memory() {
+    constexpr u64 iterations = 1 << 24;
+    auto emulator = std::make_unique<Emulator>();
+    auto& mem = emulator->m_mem;
+    u32 sum = 0;
+
+    measure("read<u32> RAM", iterations, [&] {
+        for (u64 i = 0; i < iterations; i++) sum += mem.read<u32>(0x80000000 | ((i * 4) & (RAM_SIZE - 1)));
+    });
+    measure("read<u32> BIOS", iterations, [&] {
+        for (u64 i = 0; i < iterations; i++) sum += mem.read<u32>(0xbfc00000 | ((i * 4) & (BIOS_SIZE - 1)));
+    });
+    measure("read<u16> scratchpad", iterations, [&] {
+        for (u64 i = 0; i < iterations; i++) sum += mem.read<u16>(0x1f800000 | ((i * 2) & (SCRATCHPAD_SIZE - 1)));
+    });
+    measure("read<u8> RAM", iterations, [&] {
+        for (u64 i = 0; i < iterations; i++) sum += mem.read<u8>(0xa0000000 | (i & (RAM_SIZE - 1)));
+    });
+    measure("write<u32> RAM", iterations, [&] {
+        for (u64 i = 0; i < iterations; i++) mem.write<u32>(0x80000000 | ((i * 4) & (RAM_SIZE - 1)), u32(i));
+    });
+    measure("write<u16> scratchpad", iterations, [&] {
+        for (u64 i = 0; i < iterations; i++) mem.write<u16>(0x1f800000 | ((i * 2) & (SCRATCHPAD_SIZE - 1)), u16(i));
+    });
+
+    measure("read<u32, constant> RAM", iterations, [&] {
+        for (u64 i = 0; i < iterations; i++) {
+            sum += mem.read<u32, 0x80010000>();
+            clobber();
+        }
+    });
+
+    measure("psxRead32 RAM (old path)", iterations, [&] {
+        for (u64 i = 0; i < iterations; i++) sum += psxRead32(*emulator, 0x80000000 | ((i * 4) & (RAM_SIZE - 1)));
+    });
+    measure("psxRead32 BIOS (old path)", iterations, [&] {
+        for (u64 i = 0; i < iterations; i++) sum += psxRead32(*emulator, 0xbfc00000 | ((i * 4) & (BIOS_SIZE - 1)));
+    });
+    measure("psxWrite32 RAM (old path)", iterations, [&] {
+        for (u64 i = 0; i < iterations; i++) psxWrite32(*emulator, 0x80000000 | ((i * 4) & (RAM_SIZE - 1)), u32(i));
+    });
+
+    fmt::print("Checksum: {:#x}\n", sum);
+}
+
+// Deterministic pseudo random numbers so every run draws the same scene
+struct Random {
+    u32 state = 0x12345678;
+    u32 next() {
+        state = state * 1664525 + 1013904223;
+        return state >> 8;
+    }
+    s32 range(s32 min, s32 max) { return min + s32(next() % u32(max - min + 1)); }
+};
+
+static const char* backendName(Rasterizer::BACKEND backend) {
+    return backend == Rasterizer::BACKEND::AVX2 ? "avx2" : "scalar";
+}
+
+// Fill rate of every primitive type on every supported rasterizer backend, operations are pixels.
+// Also checks that the other backends draw exactly what the scalar one does
+static void rasterizer() {
+    struct Case {
+        const char* name;
+        Primitive prim;
+        DrawState state;
+    };
+
+    auto textured = [](u32 depth, bool raw) {
+        Primitive prim;
+        prim.textured = true;
+        prim.rawTexture = raw;
+        prim.texDepth = depth;
+        prim.texBaseX = 512;
+        prim.clutY = 480;
+        return prim;
+    };
+
+    std::vector<Case> cases;
+    cases.push_back({"flat", Primitive(), DrawState()});
+    cases.push_back({"gouraud", Primitive(), DrawState()});
+    cases.back().prim.shaded = true;
+    cases.push_back({"gouraud dithered", cases.back().prim, DrawState()});
+    cases.back().prim.dither = true;
+    cases.push_back({"textured 4bpp", textured(0, true), DrawState()});
+    cases.push_back({"textured 8bpp", textured(1, true), DrawState()});
+    cases.push_back({"textured 15bpp", textured(2, true), DrawState()});
+    cases.push_back({"textured 4bpp modulated", textured(0, false), DrawState()});
+    cases.back().prim.shaded = cases.back().prim.dither = true;
+    for (u32 mode = 0; mode < 4; mode++) {
+        static const char* names[4] = {"semi average", "semi add", "semi subtract", "semi add quarter"};
+        cases.push_back({names[mode], Primitive(), DrawState()});
+        cases.back().prim.shaded = cases.back().prim.semiTransparent = true;
+        cases.back().prim.semiMode = mode;
+    }
+    cases.push_back({"semi textured 8bpp", textured(1, false), DrawState()});
+    cases.back().prim.semiTransparent = true;
+    cases.push_back({"masked textured 15bpp", textured(2, true), DrawState()});
+    cases.back().state.checkMask = cases.back().state.setMask = true;
+    cases.back().state.windowMaskX = 3;
+    cases.back().state.windowOffsetX = 1;
+
+    // Draw left of the texture page and above the CLUTs. Sampling texels that the same primitive overwrites is order
+    // dependent, which is fine for games but not for a comparison
+    for (auto& c : cases) {
+        c.state.area.right = 511;
+        c.state.area.bottom = 479;
+    }
+
+    std::vector<u16> initial(VRAM_ALLOCATION_SIZE);
+    Random random;
+    for (auto& pixel : initial) pixel = random.next();
+
+    auto randomVertex = [&random](Vertex& v) {
+        v = {random.range(-64, 1100), random.range(-64, 560), random.range(0, 255), random.range(0, 255),
+             random.range(0, 255),   random.range(0, 255),   random.range(0, 255)};
+    };
+
+    const auto defaultBackend = Rasterizer::backend();
+    std::vector<u16> reference(VRAM_ALLOCATION_SIZE);
+    std::vector<u16> vram(VRAM_ALLOCATION_SIZE);
+    bool match = true;
+
+    // Exactness: random triangles and rectangles, drawn by each backend from the same starting VRAM
+    for (auto backend : {Rasterizer::BACKEND::SCALAR, Rasterizer::BACKEND::AVX2}) {
+        if (!Rasterizer::supported(backend)) continue;
+        Rasterizer::setBackend(backend);
+        auto& target = backend == Rasterizer::BACKEND::SCALAR ? reference : vram;
+        target = initial;
+        random.state = 1;
+
+        for (const auto& c : cases) {
+            for (int i = 0; i < 64; i++) {
+                Vertex vertices[3];
+                for (auto& v : vertices) randomVertex(v);
+                Rasterizer::triangle(target.data(), c.state, c.prim, vertices, c.state.area);
+                Rasterizer::rectangle(target.data(), c.state, c.prim, vertices[0], random.range(1, 100),
+                                      random.range(1, 100), c.state.area);
+            }
+        }
+
+        if (backend != Rasterizer::BACKEND::SCALAR && target != reference) {
+            fmt::print("{} output differs from the scalar rasterizer\n", backendName(backend));
+            match = false;
+        }
+    }
+
+    // Fill rate: a 256x240 quad, split in two triangles, as big as a typical full screen polygon
+    constexpr u32 iterations = 200;
+    constexpr u64 pixels = u64(iterations) * 256 * 240;
+    Vertex quad[4] = {
+        {0, 0, 255, 0, 0, 0, 0},
+        {256, 0, 0, 255, 0, 255, 0},
+        {0, 240, 0, 0, 255, 0, 239},
+        {256, 240, 255, 255, 255, 255, 239},
+    };
+
+    for (auto backend : {Rasterizer::BACKEND::SCALAR, Rasterizer::BACKEND::AVX2}) {
+        if (!Rasterizer::supported(backend)) continue;
+        Rasterizer::setBackend(backend);
+
+        for (const auto& c : cases) {
+            vram = initial;
+            const auto name = fmt::format("{} {}", backendName(backend), c.name);
+            measure(name.c_str(), pixels, [&] {
+                for (u32 i = 0; i < iterations; i++) {
+                    Rasterizer::triangle(vram.data(), c.state, c.prim, &quad[0], c.state.area);
+                    Rasterizer::triangle(vram.data(), c.state, c.prim, &quad[1], c.state.area);
+                    clobber();
+                }
+            });
+        }
+    }
+
+    Rasterizer::setBackend(defaultBackend);
+    fmt::print("Backends match: {}\n", match ? "yes" : "no");
+}
+
+// GP0 packets as a flat list of (length, words...) records
+struct CommandStream {
+    std::vector<u32> words;
+    u64 primitives = 0;
+
+    void packet(std::initializer_list<u32> packet) {
+        words.push_back(packet.size());
+        words.insert(words.end(), packet);
+    }
+};
+
+static u32 position(s32 x, s32 y) { return (u32(y & 0x7ff) << 16) | u32(x & 0x7ff); }
+
+// A few frames of a typical 3D game: a clear, gouraud and textured quads, sprites and semi-transparent effects.
+// Every frame ends with a 15bpp sprite and a quad drawn over the texels it samples, which must not be drawn in
+// parallel
+static CommandStream buildScene(Random& random) {
+    CommandStream stream;
+    auto color = [&] { return random.next() & 0xffffff; };
+    auto point = [&] { return position(random.range(-32, 543), random.range(-32, 511)); };
+    auto texcoord = [&](u32 high) { return (high << 16) | (random.next() & 0xffff); };
+
+    constexpr u32 texpage = 8 | (1 << 7) | (1 << 9);     // 8bpp at (512, 0), dithering on
+    constexpr u32 clut = (480 << 6);                     // (0, 480)
+    constexpr u32 directPage = 4 | (2 << 7) | (1 << 9);  // 15bpp at (256, 0)
+    stream.packet({0xe1000000 | texpage});
+    stream.packet({0xe3000000});
+    stream.packet({0xe4000000 | (479 << 10) | 511});
+
+    for (u32 frame = 0; frame < 8; frame++) {
+        stream.packet({0x02000000, position(0, 0), position(512, 480)});
+
+        for (int i = 0; i < 400; i++) {
+            const s32 x = random.range(0, 480), y = random.range(0, 448);
+            const s32 w = random.range(8, 64), h = random.range(8, 64);
+            switch (random.next() % 5) {
+                case 0:  // Gouraud quad
+                    stream.packet({0x38000000 | color(), position(x, y), color(), position(x + w, y), color(),
+                                   position(x, y + h), color(), position(x + w, y + h)});
+                    break;
+                case 1:  // Textured gouraud quad
+                    stream.packet({0x3c000000 | color(), position(x, y), texcoord(clut), color(), position(x + w, y),
+                                   texcoord(texpage), color(), position(x, y + h), random.next() & 0xffff, color(),
+                                   position(x + w, y + h), random.next() & 0xffff});
+                    break;
+                case 2:  // Sprite
+                    stream.packet({0x64808080, position(x, y), texcoord(clut), position(w, h)});
+                    break;
+                case 3:  // Semi-transparent triangle
+                    stream.packet({0x22000000 | color(), point(), point(), point()});
+                    break;
+                default:  // Gouraud line
+                    stream.packet({0x50000000 | color(), point(), color(), point()});
+                    break;
+            }
+            stream.primitives++;
+        }
+
+        stream.packet({0xe1000000 | directPage});
+        stream.packet({0x64808080, position(0, 256), 0, position(64, 64)});
+        stream.packet({0xe1000000 | texpage});
+        stream.packet({0x38000000 | color(), position(256, 0), color(), position(320, 0), color(), position(256, 64),
+                       color(), position(320, 64)});
+        stream.primitives += 2;
+    }
+    return stream;
+}
+
+// Replays a GP0 command stream with a varying number of rasterizer threads, operations are primitives.
+// Also checks that every thread count draws exactly what a single thread does
+static void renderer() {
+    Random random;
+    std::vector<u32> texture(256 * 256 / 2);
+    for (auto& word : texture) word = random.next() | (random.next() << 24);
+    std::vector<u32> palette(128);
+    for (auto& word : palette) word = (random.next() & 0x7fff7fff) | 0x80008000;  // Skip transparent black
+
+    const auto stream = buildScene(random);
+
+    std::vector<u32> threadCounts = {1};
+    const u32 cores = std::max(1u, std::thread::hardware_concurrency());
+    for (u32 n = 2; n < cores; n *= 2) threadCounts.push_back(n);
+    if (cores > 1) threadCounts.push_back(cores);
+
+    std::vector<u16> reference;
+    bool match = true;
+
+    for (const u32 threads : threadCounts) {
+        auto renderer = std::make_unique<Renderer>(false);
+        renderer->setThreads(threads);
+
+        const u32 textureUpload[] = {0xa0000000, position(512, 0), position(128, 256)};
+        const u32 paletteUpload[] = {0xa0000000, position(0, 480), position(256, 1)};
+        renderer->push(RENDER_COMMAND::GP0, textureUpload, 3);
+        renderer->push(RENDER_COMMAND::VRAM_WRITE, texture.data(), texture.size());
+        renderer->push(RENDER_COMMAND::GP0, paletteUpload, 3);
+        renderer->push(RENDER_COMMAND::VRAM_WRITE, palette.data(), palette.size());
+
+        const auto name = fmt::format("{} thread{}", threads, threads == 1 ? "" : "s");
+        measure(name.c_str(), stream.primitives, [&] {
+            for (size_t i = 0; i < stream.words.size(); i += stream.words[i] + 1) {
+                renderer->push(RENDER_COMMAND::GP0, &stream.words[i + 1], stream.words[i]);
+            }
+            renderer->sync();
+        });
+
+        std::vector<u16> vram(renderer->vram(), renderer->vram() + VRAM_WIDTH * VRAM_HEIGHT);
+        if (reference.empty()) {
+            reference = std::move(vram);
+        } else if (vram != reference) {
+            fmt::print("{} output differs from a single thread\n", name);
+            match = false;
+        }
+    }
+
+    fmt::print("Thread counts match: {}\n", match ? "yes" : "no");
+}
+
+// Mixing cost of all 24 voices playing looped ADPCM, operations are output samples. Some voices use noise and
+// pitch modulation so every path of the mixer runs
+static void spu() {
+    constexpr u32 seconds = 10;
+    constexpr u32 blocks = seconds * SPU_SAMPLE_RATE / SPU_BLOCK_SIZE;
+    auto emulator = std::make_unique<Emulator>();
+    auto& mem = emulator->m_mem;
+    auto& spu = emulator->m_spu;
+
+    // 64 blocks of random ADPCM at 0x1000, looping back to the start
+    Random random;
+    mem.write<u16>(0x1f801daa, 0xc000);
+    mem.write<u16>(0x1f801da6, 0x1000 / 8);
+    for (u32 block = 0; block < 64; block++) {
+        const u32 flags = block == 0 ? 0x04 : block == 63 ? 0x03 : 0;
+        mem.write<u16>(0x1f801da8, u16((random.next() % 5) << 4 | (4 + random.next() % 8) | flags << 8));
+        for (u32 i = 0; i < 7; i++) mem.write<u16>(0x1f801da8, u16(random.next()));
+    }
+
+    mem.write<u16>(0x1f801d80, 0x3fff);
+    mem.write<u16>(0x1f801d82, 0x3fff);
+    mem.write<u16>(0x1f801d90, 0x0f00);  // Pitch modulation on voices 8-11
+    mem.write<u16>(0x1f801d94, 0x0003);  // Noise on voices 0 and 1
+    for (u32 voice = 0; voice < SPU_VOICE_COUNT; voice++) {
+        const u32 base = 0x1f801c00 + voice * 16;
+        mem.write<u16>(base + 0x0, 0x0800);
+        mem.write<u16>(base + 0x2, 0x0800);
+        mem.write<u16>(base + 0x4, u16(0x400 + voice * 0x80));
+        mem.write<u16>(base + 0x6, 0x1000 / 8);
+        mem.write<u16>(base + 0x8, 0x00ff);  // Fast attack, slow decay to full sustain
+        mem.write<u16>(base + 0xa, 0x0000);
+    }
+    mem.write<u16>(0x1f801d88, 0xffff);
+    mem.write<u16>(0x1f801d8a, 0x00ff);
+
+    std::vector<s16> output(AUDIO_RING_SIZE);
+    const auto rate = measure("24 voices", u64(blocks) * SPU_BLOCK_SIZE, [&] {
+        for (u32 i = 0; i < blocks; i++) {
+            spu.mixBlock();
+            const size_t available = spu.m_output.available();
+            spu.m_output.read(0, output.data(), available);
+            spu.m_output.pop(available);
+        }
+    });
+
+    fmt::print("Share of a core at {} Hz: {:.2f}%\n", SPU_SAMPLE_RATE, 100.0 * SPU_SAMPLE_RATE / rate);
+}
+
+// Random reverb layout in a buffer of the given size, in halfwords. Taps land anywhere in the buffer, so some
+// layouts have taps close enough to need the per sample path
+static void randomReverb(Reverb& reverb, Random& random, u32 size) {
+    reverb.reset();
+    reverb.write(0xda2, u16((REVERB_RAM_END - size) / 4));
+    reverb.write(0xd84, 0x3000);
+    reverb.write(0xd86, 0x3000);
+    for (u32 reg = 0; reg < 32; reg++) {
+        const bool volume = (reg >= 2 && reg <= 9) || reg >= 30;
+        const u16 value = volume ? u16(random.range(-0x6000, 0x6000)) : u16(random.next() % (size / 4));
+        reverb.write(0xdc0 + reg * 2, value);
+    }
+}
+
+// Reverb cost per output sample for the block and per sample paths, with a layout where the block path applies.
+// Then checks that both give the same output and buffer contents over a series of random layouts
+static void reverb() {
+    constexpr u32 blocks = 1 << 14;
+    Random random;
+    std::vector<s32> input(blocks * REVERB_BLOCK_SIZE * 2);
+    for (auto& sample : input) sample = random.range(-0x4000, 0x3fff);
+
+    auto run = [&](Reverb& reverb, std::vector<u16>& ram, std::vector<s32>& output, u32 count, bool reference) {
+        for (u32 block = 0; block < count; block++) {
+            const s32* left = &input[block * REVERB_BLOCK_SIZE * 2];
+            s32* outLeft = &output[block * REVERB_BLOCK_SIZE * 2];
+            if (reference) {
+                reverb.processReference(ram.data(), left, left + REVERB_BLOCK_SIZE, outLeft,
+                                        outLeft + REVERB_BLOCK_SIZE);
+            } else {
+                reverb.process(ram.data(), left, left + REVERB_BLOCK_SIZE, outLeft, outLeft + REVERB_BLOCK_SIZE);
+            }
+        }
+    };
+
+    // Taps spread over a 16 KiB buffer at uneven distances
+    Reverb reverb;
+    reverb.write(0xda2, u16((REVERB_RAM_END - 0x2000) / 4));
+    reverb.write(0xd84, 0x3000);
+    reverb.write(0xd86, 0x3000);
+    for (u32 reg = 0; reg < 32; reg++) {
+        const bool volume = (reg >= 2 && reg <= 9) || reg >= 30;
+        reverb.write(0xdc0 + reg * 2, volume ? 0x3000 : u16(40 + reg * reg * 2));
+    }
+
+    std::vector<u16> ram(REVERB_RAM_END);
+    std::vector<s32> output(input.size());
+    const u64 samples = u64(blocks) * REVERB_BLOCK_SIZE;
+    if (!reverb.blockSafe()) fmt::print("Benchmark layout falls back to the per sample path\n");
+    measure("block", samples, [&] { run(reverb, ram, output, blocks, false); });
+    measure("per sample", samples, [&] { run(reverb, ram, output, blocks, true); });
+
+    bool match = true;
+    u32 blockLayouts = 0;
+    constexpr u32 layouts = 200;
+    for (u32 layout = 0; layout < layouts && match; layout++) {
+        const u32 size = layout % 4 == 0 ? 64 + random.next() % 256 : 0x400 + random.next() % 0x8000;
+        Reverb block, reference;
+        randomReverb(block, random, size);
+        reference = block;
+
+        std::vector<u16> blockRam(REVERB_RAM_END), referenceRam(REVERB_RAM_END);
+        for (u32 i = REVERB_RAM_END - size; i < REVERB_RAM_END; i++) blockRam[i] = referenceRam[i] = random.next();
+        std::vector<s32> blockOutput(input.size()), referenceOutput(input.size());
+
+        run(block, blockRam, blockOutput, 64, false);
+        run(reference, referenceRam, referenceOutput, 64, true);
+        match = blockRam == referenceRam && blockOutput == referenceOutput;
+        if (!match) fmt::print("Layout {} differs from the per sample path\n", layout);
+        if (block.blockSafe()) blockLayouts++;
+    }
+
+    fmt::print("Layouts using the block path: {}/{}\n", blockLayouts, layouts);
+    fmt::print("Block and per sample paths match: {}\n", match ? "yes" : "no");
+}
+
+// A file on disc, in sectors
+struct DiscFile {
+    u32 start;
+    u32 sectors;
+};
+
+struct LoadResult {
+    u64 cycles = 0;
+    u64 checksum = 0;
+    std::vector<u8> interrupts;  // Every interrupt the loader saw, in order
+};
+
+// Loads files the way a game's CD code does: Setloc and ReadN at double speed, one DMA per INT1, Pause after the
+// last sector of a file. Time is emulated time, the CPU isn't running
+static LoadResult loadFiles(const std::string& image, const std::vector<DiscFile>& files, CdromSpeed speed) {
+    auto emulator = std::make_unique<Emulator>();
+    emulator->loadDisc(image);
+    auto& cdrom = emulator->m_cdrom;
+    cdrom.m_speed = speed;
+
+    LoadResult result;
+    auto command = [&](u8 value, std::initializer_list<u8> params) {
+        cdrom.write(0x800, 0);
+        for (auto param : params) cdrom.write(0x802, param);
+        cdrom.write(0x801, value);
+    };
+    auto wait = [&] {
+        cdrom.write(0x800, 1);
+        while ((cdrom.read(0x803) & 7) == 0) emulator->m_scheduler.tick(64);
+        result.interrupts.push_back(cdrom.read(0x803) & 7);
+    };
+    auto acknowledge = [&] {
+        cdrom.write(0x800, 1);
+        cdrom.write(0x803, 0x1f);
+    };
+
+    cdrom.write(0x800, 1);
+    cdrom.write(0x802, 0x1f);
+    command(0x0e, {0x80});
+    wait();
+    acknowledge();
+
+    std::array<u32, 512> buffer;
+    for (const auto& file : files) {
+        const auto msf = CD::msf(file.start);
+        command(0x02, {msf.minutes, msf.seconds, msf.sectors});
+        wait();
+        acknowledge();
+        command(0x06, {});
+        wait();
+        acknowledge();
+
+        for (u32 i = 0; i < file.sectors; i++) {
+            wait();
+            cdrom.write(0x800, 0);
+            cdrom.write(0x803, 0x80);
+            cdrom.dmaRead(buffer.data(), buffer.size());
+            for (auto word : buffer) result.checksum = result.checksum * 31 + word;
+            acknowledge();
+        }
+
+        command(0x09, {});
+        wait();
+        acknowledge();
+        wait();
+        acknowledge();
+    }
+
+    result.cycles = emulator->m_scheduler.now();
+    return result;
+}
+
+// Emulated load times of a few loading patterns with real drive timing and with the speed-ups, on a generated disc.
+// Also checks that every mode loads the same data and raises the same interrupts in the same order
+static void cdrom() {
+    constexpr u32 discSectors = 20000;
+    const auto image = (std::filesystem::temp_directory_path() / "psx-bench-disc.bin").string();
+    {
+        std::vector<u8> sector(SECTOR_SIZE);
+        std::ofstream file(image, std::ios::binary);
+        for (u32 i = 0; i < discSectors; i++) {
+            const auto msf = CD::msf(LEAD_IN_SECTORS + i);
+            sector[12] = msf.minutes;
+            sector[13] = msf.seconds;
+            sector[14] = msf.sectors;
+            sector[15] = 2;
+            for (u32 j = 24; j < SECTOR_SIZE; j += 4) std::memcpy(&sector[j], &i, 4);
+            file.write(reinterpret_cast<const char*>(sector.data()), sector.size());
+        }
+    }
+
+    Random random;
+    auto scattered = [&](u32 count, u32 minSectors, u32 maxSectors) {
+        std::vector<DiscFile> files;
+        for (u32 i = 0; i < count; i++) {
+            const u32 sectors = u32(random.range(minSectors, maxSectors));
+            files.push_back({LEAD_IN_SECTORS + random.next() % (discSectors - sectors), sectors});
+        }
+        return files;
+    };
+
+    const std::pair<const char*, std::vector<DiscFile>> patterns[] = {
+        {"boot, 2 MB executable", {{LEAD_IN_SECTORS + 24, 1000}}},
+        {"level, 8 scattered files", scattered(8, 50, 400)},
+        {"streaming, 64 small reads", scattered(64, 2, 16)},
+    };
+    const std::pair<const char*, CdromSpeed> modes[] = {
+        {"real timing", {1, false}},
+        {"instant seek", {1, true}},
+        {"8x reads", {8, false}},
+        {"8x reads, instant seek", {8, true}},
+    };
+
+    bool match = true;
+    for (const auto& [pattern, files] : patterns) {
+        fmt::print("{}\n", pattern);
+        LoadResult reference;
+        for (const auto& [mode, speed] : modes) {
+            const auto start = Clock::now();
+            const auto result = loadFiles(image, files, speed);
+            const auto elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+            if (reference.interrupts.empty()) reference = result;
+            const double seconds = double(result.cycles) / CPU_CLOCK;
+            const double speedup = double(reference.cycles) / result.cycles;
+            fmt::print("  {:<24} {:>8.2f}s emulated {:>6.2f}x {:>10.3f}ms\n", mode, seconds, speedup, elapsed * 1000.0);
+
+            if (result.checksum != reference.checksum || result.interrupts != reference.interrupts) {
+                fmt::print("  {} differs from real timing\n", mode);
+                match = false;
+            }
+        }
+    }
+
+    std::filesystem::remove(image);
+    fmt::print("Data and interrupt order match: {}\n", match ? "yes" : "no");
+}
+
+// Default quantization and scale tables of the official libraries
+static const u8 mdecQuant[MDEC_BLOCK_SIZE] = {
+    2,  16, 19, 22, 26, 27, 29, 34, 16, 16, 22, 24, 27, 29, 34, 37, 19, 22, 26, 27, 29, 34,
+    34, 38, 22, 22, 26, 27, 29, 34, 37, 40, 22, 26, 27, 29, 32, 35, 40, 48, 26, 27, 29, 32,
+    35, 40, 48, 58, 26, 27, 29, 34, 38, 46, 56, 69, 27, 29, 35, 38, 46, 56, 69, 83,
+};
+static const u16 mdecScale[MDEC_BLOCK_SIZE] = {
+    0x5a82, 0x5a82, 0x5a82, 0x5a82, 0x5a82, 0x5a82, 0x5a82, 0x5a82, 0x7d8a, 0x6a6d, 0x471c, 0x18f8, 0xe707,
+    0xb8e3, 0x9592, 0x8275, 0x7641, 0x30fb, 0xcf04, 0x89be, 0x89be, 0xcf04, 0x30fb, 0x7641, 0x6a6d, 0xe707,
+    0x8275, 0xb8e3, 0x471c, 0x7d8a, 0x18f8, 0x9592, 0x5a82, 0xa57d, 0xa57d, 0x5a82, 0x5a82, 0xa57d, 0xa57d,
+    0x5a82, 0x471c, 0x8275, 0x18f8, 0x6a6d, 0x9592, 0xe707, 0x7d8a, 0xb8e3, 0x30fb, 0x89be, 0x7641, 0xcf04,
+    0xcf04, 0x7641, 0x89be, 0x30fb, 0x18f8, 0xb8e3, 0x6a6d, 0x8275, 0x7d8a, 0x9592, 0x471c, 0xe707,
+};
+
+// Decode command for a 320x240 colour frame of random run-length data. Blocks have a DC term and up to 16 AC
+// codes, about what video at a moderate bitrate sends
+static std::vector<u32> mdecFrame(Random& random, u32 macroblocks, MDEC_DEPTH depth) {
+    std::vector<u16> halfwords;
+    for (u32 block = 0; block < macroblocks * 6; block++) {
+        halfwords.push_back(u16(random.range(1, 8) << 10 | (random.next() & 0x3ff)));
+        const u32 codes = random.next() % 17;
+        for (u32 i = 0; i < codes; i++) {
+            halfwords.push_back(u16((random.next() % 3) << 10 | (random.range(-64, 63) & 0x3ff)));
+        }
+        halfwords.push_back(0xfe00);
+    }
+    if (halfwords.size() & 1) halfwords.push_back(0xfe00);
+
+    std::vector<u32> words(1 + halfwords.size() / 2);
+    words[0] = 1u << 29 | u32(depth) << 27 | u32(words.size() - 1);
+    std::memcpy(&words[1], halfwords.data(), halfwords.size() * 2);
+    return words;
+}
+
+// IDCT throughput of both versions, then whole 320x240 frames from the decode command to the last word read by
+// DMA, on one thread and on the MDEC's thread pool. Operations are macroblocks
+static void mdec() {
+    Random random;
+    s32 scale[MDEC_BLOCK_SIZE];
+    for (u32 i = 0; i < MDEC_BLOCK_SIZE; i++) scale[i] = s16(mdecScale[i]) / 8;
+
+    constexpr u32 blockCount = 1 << 14;
+    std::vector<s16> blocks(blockCount * MDEC_BLOCK_SIZE);
+    for (auto& coefficient : blocks) coefficient = s16(random.range(-0x400, 0x3ff));
+    auto scalarBlocks = blocks;
+    auto avx2Blocks = blocks;
+
+    measure("IDCT scalar", blockCount, [&] {
+        for (u32 i = 0; i < blockCount; i++) MDEC::idctScalar(&scalarBlocks[i * MDEC_BLOCK_SIZE], scale);
+    });
+    if (Helpers::avx2Supported()) {
+        measure("IDCT AVX2", blockCount, [&] {
+            for (u32 i = 0; i < blockCount; i++) MDEC::idctAVX2(&avx2Blocks[i * MDEC_BLOCK_SIZE], scale);
+        });
+        fmt::print("IDCT versions match: {}\n", scalarBlocks == avx2Blocks ? "yes" : "no");
+    }
+
+    constexpr u32 macroblocks = 20 * 15;
+    constexpr u32 frames = 64;
+    const u32 poolThreads = std::clamp(std::thread::hardware_concurrency() / 2, 1u, u32(MDEC_MAX_THREADS));
+    std::vector<u32> threadCounts = {1};
+    if (poolThreads > 1) threadCounts.push_back(poolThreads);
+    auto emulator = std::make_unique<Emulator>();
+    auto& mdec = emulator->m_mdec;
+
+    std::vector<u32> tables = {2u << 29 | 1};
+    for (u32 i = 0; i < 2 * MDEC_BLOCK_SIZE; i += 4) {
+        const u8* quant = &mdecQuant[i % MDEC_BLOCK_SIZE];
+        tables.push_back(quant[0] | quant[1] << 8 | quant[2] << 16 | u32(quant[3]) << 24);
+    }
+    tables.push_back(3u << 29);
+    for (u32 i = 0; i < MDEC_BLOCK_SIZE; i += 2) tables.push_back(mdecScale[i] | u32(mdecScale[i + 1]) << 16);
+    mdec.dmaWrite(tables.data(), tables.size());
+
+    bool match = true;
+    const std::pair<const char*, MDEC_DEPTH> depths[] = {{"24-bit", MDEC_DEPTH::BIT24}, {"15-bit", MDEC_DEPTH::BIT15}};
+    for (const auto& [depthName, depth] : depths) {
+        const auto frame = mdecFrame(random, macroblocks, depth);
+        std::vector<u32> output(macroblocks * (depth == MDEC_DEPTH::BIT24 ? 192 : 128));
+        std::vector<u32> reference;
+
+        for (const u32 threads : threadCounts) {
+            mdec.setThreads(threads);
+            const auto name = fmt::format("{}, {} thread{}", depthName, threads, threads == 1 ? "" : "s");
+            const auto rate = measure(name.c_str(), u64(frames) * macroblocks, [&] {
+                for (u32 i = 0; i < frames; i++) {
+                    mdec.dmaWrite(frame.data(), frame.size());
+                    mdec.dmaRead(output.data(), output.size());
+                }
+            });
+            fmt::print("  {:.0f} frames of 320x240 per second\n", rate / macroblocks);
+
+            if (reference.empty()) {
+                reference = output;
+            } else if (output != reference) {
+                fmt::print("  {} output differs from a single thread\n", name);
+                match = false;
+            }
+        }
+    }
+    mdec.setThreads(poolThreads);
+    fmt::print("Thread counts match: {}\n", match ? "yes" : "no");
+}
+
+// Average time to save and load a state, to a file and to a buffer in memory, with random RAM and sound RAM. Then
+// checks that loading a state and saving again gives the same bytes
+static void savestate() {
+    constexpr u32 runs = 20;
+    const auto path = (std::filesystem::temp_directory_path() / "psx-bench.state").string();
+    auto emulator = std::make_unique<Emulator>();
+    Random random;
+    for (u32 i = 0; i < RAM_SIZE; i += 4) Memory::store<u32>(emulator->m_mem.m_ram, i, random.next());
+    std::vector<u32> soundRam(SPU_RAM_SIZE / 4);
+    for (auto& word : soundRam) word = random.next();
+    emulator->m_spu.dmaWrite(soundRam.data(), soundRam.size());
+
+    auto time = [&](const char* name, auto&& fn) {
+        const auto start = Clock::now();
+        for (u32 i = 0; i < runs; i++) fn();
+        const auto elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        fmt::print("{:<32} {:>10.3f}ms\n", name, elapsed * 1000.0 / runs);
+    };
+
+    Serializer measure(Serializer::MODE::MEASURE);
+    emulator->serialize(measure);
+    std::vector<u8> buffer(measure.position());
+    fmt::print("State size: {}kb\n", buffer.size() / 1024);
+
+    time("save to file", [&] { emulator->saveState(path); });
+    time("load from file", [&] { emulator->loadState(path); });
+    time("save to memory", [&] {
+        Serializer writer(Serializer::MODE::SAVE, buffer.data(), buffer.size());
+        emulator->serialize(writer);
+    });
+    time("load from memory", [&] {
+        Serializer reader(Serializer::MODE::LOAD, buffer.data(), buffer.size());
+        emulator->serialize(reader);
+    });
+    time("save to memory, no dirty pages", [&] {
+        Serializer writer(Serializer::MODE::SAVE, buffer.data(), buffer.size(), emulator->m_mem.checkpoint());
+        emulator->serialize(writer);
+    });
+
+    auto readFile = [](const std::string& file) {
+        std::ifstream stream(file, std::ios::binary);
+        return std::vector<char>(std::istreambuf_iterator<char>(stream), {});
+    };
+    emulator->saveState(path);
+    const auto saved = readFile(path);
+    std::memset(emulator->m_mem.m_ram, 0, RAM_SIZE);
+    emulator->loadState(path);
+    emulator->saveState(path);
+    const bool match = readFile(path) == saved;
+
+    std::filesystem::remove(path);
+    fmt::print("Loaded state saves back identically: {}\n", match ? "yes" : "no");
+}
+
+static u64 ramHash(const u8* ram) {
+    u64 hash = 0xcbf29ce484222325;
+    for (u32 i = 0; i < RAM_SIZE; i += 4) hash = (hash ^ Memory::load<u32>(ram, i)) * 0x100000001b3;
+    return hash;
+}
+
+// Emulator with a BIOS that spins in place and random RAM
+static std::unique_ptr<Emulator> spinningEmulator() {
+    auto emulator = std::make_unique<Emulator>();
+    Memory::store<u32>(emulator->m_mem.m_bios, 0, 0x0bf00000);  // j 0xbfc00000
+    emulator->m_cpu.fetch();
+    emulator->m_biosLoaded = true;
+
+    Random random;
+    for (u32 i = 0; i < RAM_SIZE; i += 4) Memory::store<u32>(emulator->m_mem.m_ram, i, random.next());
+    return emulator;
+}
+
+// Scribble over a few kilobytes of RAM, standing in for what a game does in a frame
+static void scribble(Emulator& emulator, Random& random) {
+    for (u32 block = 0; block < 16; block++) {
+        const u32 address = (random.next() % (RAM_SIZE / 256)) * 256;
+        for (u32 i = 0; i < 256; i += 4) emulator.m_mem.write<u32>(address + i, random.next());
+    }
+}
+
+// Scribble and run to the next frame. Returns the time spent emulating
+static double runFrame(Emulator& emulator, Random& random) {
+    scribble(emulator, random);
+
+    const u64 frame = emulator.m_gpu.m_frameCount;
+    const auto start = Clock::now();
+    while (emulator.m_gpu.m_frameCount == frame) emulator.runFrame();
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Frame time with and without rewind while a few kilobytes of RAM change every frame. Then steps back through every
+// snapshot and checks RAM against a hash taken when it was saved
+static void rewind() {
+    constexpr u32 frames = 300;
+
+    double plain = 0.0;
+    auto emulator = spinningEmulator();
+    Random random;
+    for (u32 frame = 0; frame < frames; frame++) plain += runFrame(*emulator, random);
+
+    double withRewind = 0.0;
+    std::map<u64, u64> hashes;  // RAM hash by the cycle of each snapshot
+    emulator = spinningEmulator();
+    auto& rewind = emulator->m_rewind;
+    rewind.setEnabled(true);
+    for (u32 frame = 0; frame < frames; frame++) {
+        const size_t snapshots = rewind.snapshots();
+        withRewind += runFrame(*emulator, random);
+        if (rewind.snapshots() != snapshots) hashes[emulator->m_scheduler.now()] = ramHash(emulator->m_mem.m_ram);
+    }
+
+    fmt::print("Frame time: {:.3f}ms without rewind, {:.3f}ms with\n", plain * 1000.0 / frames,
+               withRewind * 1000.0 / frames);
+    fmt::print("Snapshot cost: {:.3f}ms per frame, {:.3f}ms for the last snapshot\n", rewind.frameCost(),
+               rewind.lastCost());
+    fmt::print("{} snapshots, {:.1f}s of rewind in {:.2f}MB\n", rewind.snapshots(), rewind.secondsHeld(),
+               rewind.memoryUsed() / 1048576.0);
+    fmt::print("Dirty RAM pages: {:.1f} per frame of {}\n", double(emulator->m_mem.dirtyPagesTotal()) / frames,
+               RAM_PAGES);
+
+    u32 steps = 0;
+    u32 mismatches = 0;
+    const auto start = Clock::now();
+    while (rewind.stepBack()) {
+        steps++;
+        if (hashes[emulator->m_scheduler.now()] != ramHash(emulator->m_mem.m_ram)) mismatches++;
+    }
+    const double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    fmt::print("Stepped back {} times, {:.3f}ms per step, {} mismatches\n", steps,
+               elapsed * 1000.0 / std::max(steps, 1u), mismatches);
+}
+
+// Host frame time with each number of run-ahead frames, and how much of the extra time goes to saving and restoring.
+// The same RAM writes go in before every host frame, so the real frames have to end in the very same state
+static void runahead() {
+    constexpr u32 frames = 120;
+
+    std::vector<u8> reference;
+    for (u32 ahead = 0; ahead <= RUNAHEAD_MAX_FRAMES; ahead++) {
+        auto emulator = spinningEmulator();
+        emulator->isRunning = true;
+        auto& runAhead = emulator->m_runAhead;
+        runAhead.setFrames(ahead);
+
+        Random random;
+        double elapsed = 0.0;
+        for (u32 frame = 0; frame < frames; frame++) {
+            scribble(*emulator, random);
+            const auto start = Clock::now();
+            runAhead.frame();
+            elapsed += std::chrono::duration<double>(Clock::now() - start).count();
+        }
+
+        Serializer measure(Serializer::MODE::MEASURE);
+        emulator->serialize(measure);
+        std::vector<u8> state(measure.position());
+        Serializer writer(Serializer::MODE::SAVE, state.data(), state.size());
+        emulator->serialize(writer);
+        if (ahead == 0) reference = state;
+
+        fmt::print("{} frames ahead: {:>7.3f}ms per host frame, {:.3f}ms extra, save {:.3f}ms, restore {:.3f}ms, {}\n",
+                   ahead, elapsed * 1000.0 / frames, runAhead.frameCost(), runAhead.saveCost(), runAhead.restoreCost(),
+                   state == reference ? "same state" : "state differs");
+        // Only the real frames count, so this matches with any number of frames ahead
+        fmt::print("  {:.1f} dirty RAM pages per frame\n", double(emulator->m_mem.dirtyPagesTotal()) / frames);
+    }
+}
+
+static const std::map<std::string, std::function<void()>> benchmarks = {
+    {"cdrom", cdrom},
+    {"mdec", mdec},
+    {"memory", memory},
+    {"rasterizer", rasterizer},
+    {"renderer", renderer},
+    {"reverb", reverb},
+    {"rewind", rewind},
+    {"runahead", runahead},
+    {"savestate", savestate},
+    {"spu", spu},
+};
+
+int run(const std::string& name) {
+    if (name == "all") {
+        for (auto& [benchName, fn] : benchmarks) {
+            fmt::print("== {} ==\n", benchName);
+            fn();
+        }
+        return 0;
+    }
+
+    auto it = benchmarks.find(name);
+    if (it == benchmarks.end()) {
+        Helpers::warn("Unknown benchmark {}\n", name);
+        return 1;
+    }
+
+    it->second();
+    return 0;
+}
+
+}  // namespace Benchmark
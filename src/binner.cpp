@@ -0,0 +1,140 @@
+#include "binner.hpp"
+
+#include <algorithm>
+
+static inline ClipRect intersect(const ClipRect& a, const ClipRect& b) {
+    return {std::max(a.left, b.left), std::max(a.top, b.top), std::min(a.right, b.right),
+            std::min(a.bottom, b.bottom)};
+}
+
+static inline bool isEmpty(const ClipRect& rect) { return rect.left > rect.right || rect.top > rect.bottom; }
+static inline bool overlaps(const ClipRect& a, const ClipRect& b) { return !isEmpty(intersect(a, b)); }
+
+static ClipRect bounds(const DrawCommand& command) {
+    const Vertex* v = command.vertices;
+    switch (command.type) {
+        case DrawCommand::TYPE::TRIANGLE:
+            return {std::min({v[0].x, v[1].x, v[2].x}), std::min({v[0].y, v[1].y, v[2].y}),
+                    std::max({v[0].x, v[1].x, v[2].x}), std::max({v[0].y, v[1].y, v[2].y})};
+        case DrawCommand::TYPE::RECTANGLE:
+            return {v[0].x, v[0].y, v[0].x + command.width - 1, v[0].y + command.height - 1};
+        default:
+            return {std::min(v[0].x, v[1].x), std::min(v[0].y, v[1].y), std::max(v[0].x, v[1].x),
+                    std::max(v[0].y, v[1].y)};
+    }
+}
+
+// VRAM a textured primitive reads: its texture page and CLUT. Anything wrapping around the right edge of VRAM is
+// treated as covering the whole width
+static std::array<ClipRect, 2> textureSources(const Primitive& prim) {
+    static constexpr s32 pageWidths[4] = {64, 128, 256, 256};
+    const s32 left = prim.texBaseX;
+    const s32 top = prim.texBaseY;
+
+    ClipRect page = {left, top, left + pageWidths[prim.texDepth] - 1, top + 255};
+    if (page.right >= VRAM_WIDTH) page.left = 0, page.right = VRAM_WIDTH - 1;
+
+    ClipRect clut = {VRAM_WIDTH, VRAM_HEIGHT, -1, -1};
+    if (prim.texDepth < 2) {
+        const s32 entries = prim.texDepth == 0 ? 16 : 256;
+        clut = {s32(prim.clutX), s32(prim.clutY), s32(prim.clutX) + entries - 1, s32(prim.clutY)};
+        if (clut.right >= VRAM_WIDTH) clut.left = 0, clut.right = VRAM_WIDTH - 1;
+    }
+
+    return {page, clut};
+}
+
+void Binner::submit(DrawCommand command) {
+    const ClipRect area = intersect(bounds(command), command.state.area);
+    if (isEmpty(area)) return;
+
+    bool serial = m_pool.size() <= 1;
+    if (command.prim.textured) {
+        const auto sources = textureSources(command.prim);
+        const bool readsBatch = overlaps(sources[0], m_dirty) || overlaps(sources[1], m_dirty);
+        const bool readsItself = overlaps(sources[0], area) || overlaps(sources[1], area);
+
+        // The result depends on the order pixels are drawn in, keep it serial and sample VRAM directly
+        if (readsBatch || readsItself) flush();
+        serial = serial || readsItself;
+        if (!readsItself && command.prim.texDepth < 2) command.prim.texture = cachedTexture(command.prim);
+    }
+
+    // Drawing over VRAM that a batched 15bpp primitive still samples directly
+    if (overlaps(area, m_reads)) flush();
+
+    m_textureCache.invalidate(area.left, area.top, area.right, area.bottom);
+    if (serial) {
+        m_pixels.fetch_add(draw(command, command.state.area), std::memory_order_relaxed);
+        return;
+    }
+
+    const u32 index = m_batch.size();
+    m_batch.push_back(command);
+
+    for (s32 y = area.top / TILE_HEIGHT; y <= area.bottom / TILE_HEIGHT; y++) {
+        for (s32 x = area.left / TILE_WIDTH; x <= area.right / TILE_WIDTH; x++) {
+            auto& bin = m_bins[y * TILES_X + x];
+            if (bin.empty()) m_activeTiles.push_back(y * TILES_X + x);
+            bin.push_back(index);
+        }
+    }
+
+    m_dirty = {std::min(m_dirty.left, area.left), std::min(m_dirty.top, area.top),
+               std::max(m_dirty.right, area.right), std::max(m_dirty.bottom, area.bottom)};
+    if (command.prim.textured && command.prim.texDepth >= 2) {
+        const ClipRect page = textureSources(command.prim)[0];
+        m_reads = {std::min(m_reads.left, page.left), std::min(m_reads.top, page.top),
+                   std::max(m_reads.right, page.right), std::max(m_reads.bottom, page.bottom)};
+    }
+
+    if (m_batch.size() >= MAX_BATCH_SIZE) flush();
+}
+
+void Binner::flush() {
+    if (m_batch.empty()) return;
+
+    m_pool.run(m_activeTiles.size(), [this](size_t i) {
+        const u32 tile = m_activeTiles[i];
+        const s32 x = (tile % TILES_X) * TILE_WIDTH;
+        const s32 y = (tile / TILES_X) * TILE_HEIGHT;
+        const ClipRect rect = {x, y, x + TILE_WIDTH - 1, y + TILE_HEIGHT - 1};
+
+        u64 pixels = 0;
+        for (const u32 index : m_bins[tile]) {
+            const auto& command = m_batch[index];
+            pixels += draw(command, intersect(rect, command.state.area));
+        }
+        m_pixels.fetch_add(pixels, std::memory_order_relaxed);
+    });
+
+    for (const u32 tile : m_activeTiles) m_bins[tile].clear();
+    m_activeTiles.clear();
+    m_batch.clear();
+    m_dirty = {VRAM_WIDTH, VRAM_HEIGHT, -1, -1};
+    m_reads = {VRAM_WIDTH, VRAM_HEIGHT, -1, -1};
+}
+
+const u16* Binner::cachedTexture(const Primitive& prim) {
+    if (const u16* texels = m_textureCache.find(prim)) return texels;
+
+    // Batched primitives may hold any entry, only recycle them once the batch is drawn
+    if (m_textureCache.full()) {
+        flush();
+        m_textureCache.clear();
+    }
+    return m_textureCache.insert(m_vram, prim);
+}
+
+u32 Binner::draw(const DrawCommand& command, const ClipRect& clip) {
+    switch (command.type) {
+        case DrawCommand::TYPE::TRIANGLE:
+            return Rasterizer::triangle(m_vram, command.state, command.prim, command.vertices, clip);
+        case DrawCommand::TYPE::RECTANGLE:
+            return Rasterizer::rectangle(m_vram, command.state, command.prim, command.vertices[0], command.width,
+                                         command.height, clip);
+        default:
+            return Rasterizer::line(m_vram, command.state, command.prim, command.vertices[0], command.vertices[1],
+                                    clip);
+    }
+}
@@ -0,0 +1,532 @@
+#include "cdrom.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <string_view>
+
+#include "emulator.hpp"
+
+// Stat bits
+#define STAT_ERROR (1 << 0)
+#define STAT_MOTOR (1 << 1)
+#define STAT_SHELL_OPEN (1 << 4)
+#define STAT_READING (1 << 5)
+#define STAT_SEEKING (1 << 6)
+
+// Error codes sent with INT5
+#define ERROR_SEEK_FAILED (0x04)
+#define ERROR_INVALID_PARAMETER (0x10)
+#define ERROR_PARAMETER_COUNT (0x20)
+#define ERROR_INVALID_COMMAND (0x40)
+#define ERROR_NOT_READY (0x80)
+
+Cdrom::Cdrom(Emulator& emulator) : m_emulator(emulator) { reset(); }
+
+void Cdrom::reset() {
+    m_index = 0;
+    m_irqEnable = 0;
+    m_irqFlag = 0;
+    m_commandPending = false;
+    m_paramCount = 0;
+    m_response = {};
+    m_responseIndex = 0;
+    m_second = {};
+    m_data = nullptr;
+    m_dataSize = m_dataIndex = 0;
+    m_mode.r = 0;
+    m_drive = DRIVE_STATE::IDLE;
+    m_motorOn = hasDisc();
+    m_readAfterSeek = m_seekPending = false;
+    m_seekTarget = m_position = LEAD_IN_SECTORS;
+    m_sector = nullptr;
+    m_filterFile = m_filterChannel = 0;
+    m_xa.reset();
+    m_volumes = m_pendingVolumes = {0x80, 0, 0x80, 0};
+    m_adpcmMuted = false;
+    m_emulator.m_scheduler.cancel(EVENT::CDROM);
+    m_emulator.m_scheduler.cancel(EVENT::CDROM_DRIVE);
+}
+
+void Cdrom::insertDisc(std::unique_ptr<Disc> disc) {
+    stopDrive();
+    m_data = m_sector = nullptr;
+    m_dataSize = m_dataIndex = 0;
+    m_disc = std::move(disc);
+    m_motorOn = hasDisc();
+    m_position = LEAD_IN_SECTORS;
+    if (m_disc) {
+        m_region = region();
+        m_disc->prefetch(m_position);
+    }
+}
+
+// Sectors are saved as their position on the disc and read again on load
+void Cdrom::serialize(Serializer& s) {
+    s(m_index);
+    s(m_irqEnable);
+    s(m_irqFlag);
+    s(m_command);
+    s(m_commandPending);
+    s(m_params);
+    s(m_paramCount);
+    s(m_response);
+    s(m_responseIndex);
+    s(m_second);
+
+    bool hasSector = m_sector != nullptr;
+    bool hasData = m_data != nullptr;
+    s(hasSector);
+    s(hasData);
+    s(m_sectorPosition);
+    s(m_dataPosition);
+    s(m_dataSize);
+    s(m_dataIndex);
+
+    s(m_mode.r);
+    s(m_drive);
+    s(m_motorOn);
+    s(m_readAfterSeek);
+    s(m_seekPending);
+    s(m_seekTarget);
+    s(m_position);
+    s(m_filterFile);
+    s(m_filterChannel);
+    s(m_volumes);
+    s(m_pendingVolumes);
+    s(m_adpcmMuted);
+    m_xa.serialize(s);
+
+    if (!s.loading()) return;
+    if (m_disc == nullptr && (hasSector || hasData)) {
+        m_emulator.log("CDROM: State was saved with a disc inserted\n");
+        hasSector = hasData = false;
+    }
+    const u8* dataSector = hasData ? m_disc->sector(m_dataPosition) : nullptr;
+    m_data = dataSector != nullptr ? dataSector + (m_dataSize == 0x924 ? 12 : 24) : nullptr;
+    m_sector = hasSector ? m_disc->sector(m_sectorPosition) : nullptr;
+    if (m_data == nullptr) m_dataSize = m_dataIndex = 0;
+}
+
+u8 Cdrom::stat() const {
+    if (!hasDisc()) return STAT_SHELL_OPEN;
+
+    u8 value = m_motorOn ? STAT_MOTOR : 0;
+    if (m_drive == DRIVE_STATE::SEEKING) value |= STAT_SEEKING;
+    if (m_drive == DRIVE_STATE::READING) value |= STAT_READING;
+    return value;
+}
+
+u32 Cdrom::read(u32 offset, u32 size) {
+    if (size > 1) {
+        u32 value = 0;
+        for (u32 i = 0; i < size; i++) value |= read(offset == 0x802 ? offset : offset + i) << (i * 8);
+        return value;
+    }
+
+    switch (offset) {
+        case 0x800: {
+            u8 status = m_index;
+            if (m_paramCount == 0) status |= 1 << 3;
+            if (m_paramCount < CDROM_FIFO_SIZE) status |= 1 << 4;
+            if (m_responseIndex < m_response.size) status |= 1 << 5;
+            if (m_dataIndex < m_dataSize) status |= 1 << 6;
+            if (m_commandPending) status |= 1 << 7;
+            return status;
+        }
+        case 0x801: return m_responseIndex < m_response.size ? m_response.data[m_responseIndex++] : 0;
+        case 0x802: return m_dataIndex < m_dataSize ? m_data[m_dataIndex++] : 0;
+        case 0x803: return (m_index & 1 ? m_irqFlag : m_irqEnable) | 0xe0;
+        default: return 0;
+    }
+}
+
+void Cdrom::write(u32 offset, u32 value) {
+    const u8 byte = u8(value);
+    switch (offset << 2 | m_index) {
+        case 0x800 << 2 | 0:
+        case 0x800 << 2 | 1:
+        case 0x800 << 2 | 2:
+        case 0x800 << 2 | 3: m_index = byte & 3; break;
+
+        case 0x801 << 2 | 0:
+            m_command = byte;
+            m_commandPending = true;
+            m_emulator.m_scheduler.schedule(EVENT::CDROM, CDROM_ACK_DELAY);
+            break;
+
+        case 0x802 << 2 | 0:
+            if (m_paramCount < CDROM_FIFO_SIZE) m_params[m_paramCount++] = byte;
+            break;
+        case 0x802 << 2 | 1: m_irqEnable = byte & 0x1f; break;
+
+        case 0x803 << 2 | 0:  // Request register, bit 7 loads the sector buffer into the data FIFO
+            if (byte & 0x80) {
+                if (m_sector != nullptr && m_dataIndex >= m_dataSize) {
+                    m_data = m_sector + (m_mode.wholeSector ? 12 : 24);
+                    m_dataPosition = m_sectorPosition;
+                    m_dataSize = m_mode.wholeSector ? 0x924 : 0x800;
+                    m_dataIndex = 0;
+                }
+            } else {
+                m_dataIndex = m_dataSize = 0;
+            }
+            break;
+        case 0x803 << 2 | 1:
+            m_irqFlag &= ~(byte & 0x1f);
+            if (byte & 0x40) m_paramCount = 0;
+            // Anything held back for the acknowledge goes out shortly after
+            if (m_irqFlag == 0 && (m_commandPending || m_second.interrupt)) {
+                const auto& scheduler = m_emulator.m_scheduler;
+                if (!scheduler.isScheduled(EVENT::CDROM)) {
+                    m_emulator.m_scheduler.schedule(EVENT::CDROM, CDROM_RETRY_DELAY);
+                }
+            }
+            break;
+
+        case 0x801 << 2 | 3: m_pendingVolumes[2] = byte; break;
+        case 0x802 << 2 | 2: m_pendingVolumes[0] = byte; break;
+        case 0x802 << 2 | 3: m_pendingVolumes[3] = byte; break;
+        case 0x803 << 2 | 2: m_pendingVolumes[1] = byte; break;
+        case 0x803 << 2 | 3:
+            m_adpcmMuted = byte & 1;
+            if (byte & 0x20) m_volumes = m_pendingVolumes;
+            break;
+
+        default: break;
+    }
+}
+
+void Cdrom::dmaRead(u32* data, u32 words) {
+    u8* destination = reinterpret_cast<u8*>(data);
+    const u32 bytes = std::min(words * 4, m_dataSize - m_dataIndex);
+    // An empty FIFO has no sector behind it
+    if (bytes) std::memcpy(destination, m_data + m_dataIndex, bytes);
+    std::memset(destination + bytes, 0, words * 4 - bytes);
+    m_dataIndex += bytes;
+}
+
+void Cdrom::readAudio(s32* left, s32* right, u32 count) {
+    alignas(32) s16 xaLeft[SPU_BLOCK_SIZE];
+    alignas(32) s16 xaRight[SPU_BLOCK_SIZE];
+
+    for (u32 done = 0; done < count; done += SPU_BLOCK_SIZE) {
+        const u32 chunk = std::min<u32>(count - done, SPU_BLOCK_SIZE);
+        m_xa.read(xaLeft, xaRight, chunk);
+
+        const s32 mute = m_adpcmMuted ? 0 : 1;
+        for (u32 i = 0; i < chunk; i++) {
+            const s32 l = xaLeft[i] * mute;
+            const s32 r = xaRight[i] * mute;
+            left[done + i] = std::clamp((l * m_volumes[0] + r * m_volumes[3]) >> 7, -0x8000, 0x7fff);
+            right[done + i] = std::clamp((r * m_volumes[2] + l * m_volumes[1]) >> 7, -0x8000, 0x7fff);
+        }
+    }
+}
+
+void Cdrom::deliver(const Response& response) {
+    m_response = response;
+    m_responseIndex = 0;
+    m_irqFlag = response.interrupt;
+    if (m_irqFlag & m_irqEnable) m_emulator.m_irq.trigger(IRQ::CDROM);
+}
+
+void Cdrom::respond(u8 interrupt, std::initializer_list<u8> bytes) {
+    Response response{interrupt, u8(bytes.size())};
+    std::copy(bytes.begin(), bytes.end(), response.data.begin());
+    deliver(response);
+}
+
+void Cdrom::queueSecond(u8 interrupt, std::initializer_list<u8> bytes, u64 delay) {
+    m_second = {interrupt, u8(bytes.size())};
+    std::copy(bytes.begin(), bytes.end(), m_second.data.begin());
+    m_emulator.m_scheduler.schedule(EVENT::CDROM, delay);
+}
+
+void Cdrom::error(u8 code) { respond(5, {u8(stat() | STAT_ERROR), code}); }
+
+void Cdrom::commandEvent() {
+    if (m_irqFlag) {
+        m_emulator.m_scheduler.schedule(EVENT::CDROM, CDROM_RETRY_DELAY);
+        return;
+    }
+
+    if (m_commandPending) {
+        m_commandPending = false;
+        execute();
+        m_paramCount = 0;
+    } else if (m_second.interrupt) {
+        deliver(m_second);
+        m_second = {};
+    }
+}
+
+void Cdrom::execute() {
+    static constexpr u8 paramCounts[0x20] = {
+        0, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 1, 0, 0, 0, 1, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0,
+    };
+    if (m_command < 0x20 && m_paramCount < paramCounts[m_command]) {
+        error(ERROR_PARAMETER_COUNT);
+        return;
+    }
+
+    const bool needsDisc = m_command == 0x06 || m_command == 0x1b || (m_command >= 0x13 && m_command <= 0x16) ||
+                           m_command == 0x1e;
+    if (needsDisc && !hasDisc()) {
+        error(ERROR_NOT_READY);
+        return;
+    }
+
+    switch (m_command) {
+        case 0x01:  // Getstat
+            respond(3, {stat()});
+            break;
+        case 0x02:  // Setloc
+            m_seekTarget = CD::position(CD::fromBcd(m_params[0]), CD::fromBcd(m_params[1]), CD::fromBcd(m_params[2]));
+            m_seekPending = true;
+            respond(3, {stat()});
+            break;
+        case 0x03:  // Play
+            m_emulator.log("CDROM: CD audio playback is not emulated\n");
+            respond(3, {stat()});
+            break;
+        case 0x06:  // ReadN
+        case 0x1b:  // ReadS
+            respond(3, {stat()});
+            seek(true);
+            break;
+        case 0x07:  // MotorOn
+            m_motorOn = hasDisc();
+            respond(3, {stat()});
+            queueSecond(2, {stat()}, CDROM_SECOND_DELAY);
+            break;
+        case 0x08:  // Stop
+            stopDrive();
+            respond(3, {stat()});
+            m_motorOn = false;
+            queueSecond(2, {stat()}, CDROM_SECOND_DELAY);
+            break;
+        case 0x09:  // Pause
+            respond(3, {stat()});
+            stopDrive();
+            queueSecond(2, {stat()}, CDROM_SECOND_DELAY);
+            break;
+        case 0x0a:  // Init
+            respond(3, {stat()});
+            stopDrive();
+            m_mode.r = 0;
+            m_motorOn = hasDisc();
+            queueSecond(2, {stat()}, CDROM_INIT_DELAY);
+            break;
+        case 0x0b:  // Mute
+        case 0x0c:  // Demute
+            respond(3, {stat()});
+            break;
+        case 0x0d:  // Setfilter
+            m_filterFile = m_params[0];
+            m_filterChannel = m_params[1];
+            respond(3, {stat()});
+            break;
+        case 0x0e:  // Setmode
+            m_mode.r = m_params[0];
+            respond(3, {stat()});
+            break;
+        case 0x0f:  // Getparam
+            respond(3, {stat(), m_mode.r, 0, m_filterFile, m_filterChannel});
+            break;
+        case 0x10: {  // GetlocL, the header and subheader of the last sector
+            if (m_sector == nullptr) {
+                error(ERROR_INVALID_COMMAND | ERROR_NOT_READY);
+                break;
+            }
+            const u8* h = m_sector + 12;
+            respond(3, {h[0], h[1], h[2], h[3], h[4], h[5], h[6], h[7]});
+            break;
+        }
+        case 0x11: {  // GetlocP
+            const Track* track = m_disc ? m_disc->trackAt(m_position) : nullptr;
+            const u32 start = track ? track->start : 0;
+            const auto relative = CD::msf(m_position >= start ? m_position - start : start - m_position);
+            const auto absolute = CD::msf(m_position);
+            const u8 number = track ? CD::toBcd(track->number) : 0;
+            const u8 index = m_position >= start ? 1 : 0;
+            respond(3, {number, index, relative.minutes, relative.seconds, relative.sectors, absolute.minutes,
+                        absolute.seconds, absolute.sectors});
+            break;
+        }
+        case 0x12:  // SetSession
+            respond(3, {stat()});
+            queueSecond(2, {stat()}, CDROM_SECOND_DELAY);
+            break;
+        case 0x13: {  // GetTN
+            const auto& tracks = m_disc->tracks();
+            respond(3, {stat(), CD::toBcd(tracks.front().number), CD::toBcd(tracks.back().number)});
+            break;
+        }
+        case 0x14: {  // GetTD, track 0 is the end of the disc
+            const u32 number = CD::fromBcd(m_params[0]);
+            const auto& tracks = m_disc->tracks();
+            const auto track = std::find_if(tracks.begin(), tracks.end(), [&](auto& t) { return t.number == number; });
+            if (number != 0 && track == tracks.end()) {
+                error(ERROR_INVALID_PARAMETER);
+                break;
+            }
+            const auto msf = CD::msf(number == 0 ? m_disc->end() : track->start);
+            respond(3, {stat(), msf.minutes, msf.seconds});
+            break;
+        }
+        case 0x15:  // SeekL
+        case 0x16:  // SeekP
+            respond(3, {stat()});
+            seek(false);
+            break;
+        case 0x19:  // Test
+            if (m_params[0] == 0x20) {  // Controller date and version
+                respond(3, {0x94, 0x09, 0x19, 0xc0});
+            } else {
+                m_emulator.log("CDROM: Unknown test command {:#x}\n", m_params[0]);
+                error(ERROR_INVALID_PARAMETER);
+            }
+            break;
+        case 0x1a:  // GetID
+            if (!hasDisc()) {
+                respond(5, {0x08, 0x40, 0, 0, 0, 0, 0, 0});
+                break;
+            }
+            respond(3, {stat()});
+            if (m_disc->tracks().front().type == TRACK_TYPE::AUDIO) {
+                queueSecond(5, {u8(stat() | STAT_ERROR), 0x90, 0, 0, 0, 0, 0, 0}, CDROM_SECOND_DELAY);
+            } else {
+                queueSecond(2, {stat(), 0x00, 0x20, 0x00, 'S', 'C', 'E', m_region}, CDROM_SECOND_DELAY);
+            }
+            break;
+        case 0x1e:  // ReadTOC
+            respond(3, {stat()});
+            queueSecond(2, {stat()}, CDROM_INIT_DELAY);
+            break;
+        default:
+            m_emulator.log("CDROM: Unknown command {:#x}\n", m_command);
+            error(ERROR_INVALID_COMMAND);
+            break;
+    }
+}
+
+// The license string in the system area names the region
+u8 Cdrom::region() const {
+    const u8* sector = m_disc->sector(LEAD_IN_SECTORS + 4);
+    if (sector == nullptr) return 'A';
+    const std::string_view license(reinterpret_cast<const char*>(sector + 24), 0x800);
+    if (license.find("Euro") != std::string_view::npos) return 'E';
+    if (license.find("Inc.") != std::string_view::npos) return 'I';
+    return 'A';
+}
+
+// Streams keep the speed the game selected: XA audio and real-time sectors (STR movies) have to arrive at the rate
+// they play at. Only plain data reads are sped up
+bool Cdrom::fastReads() const {
+    if (m_speed.readMultiplier <= 1 || m_mode.xaAdpcm) return false;
+    const bool realTime = m_sector != nullptr && m_sector[15] == 2 && (m_sector[16 + 2] & 0x40);
+    return !realTime;
+}
+
+u64 Cdrom::readCycles() const {
+    const u32 speed = (m_mode.doubleSpeed ? 2 : 1) * (fastReads() ? m_speed.readMultiplier : 1);
+    return CPU_CLOCK / (SECTORS_PER_SECOND * speed);
+}
+
+// Move to the Setloc target, if it wasn't reached yet, then start reading or report the end of the seek
+void Cdrom::seek(bool thenRead) {
+    m_readAfterSeek = thenRead;
+    m_motorOn = true;
+
+    u64 cycles = readCycles();
+    if (m_seekPending && m_speed.instantSeek) {
+        m_drive = DRIVE_STATE::SEEKING;  // Reaches the target in a sector's time, the events stay the same
+        m_disc->prefetch(m_seekTarget);
+    } else if (m_seekPending) {
+        const u32 distance = m_seekTarget > m_position ? m_seekTarget - m_position : m_position - m_seekTarget;
+        cycles = CDROM_SEEK_BASE + u64(CDROM_SEEK_FULL) * std::min(distance, m_disc->end()) / m_disc->end();
+        m_drive = DRIVE_STATE::SEEKING;
+        m_disc->prefetch(m_seekTarget);
+    } else {
+        m_drive = thenRead ? DRIVE_STATE::READING : DRIVE_STATE::SEEKING;
+    }
+    m_emulator.m_scheduler.schedule(EVENT::CDROM_DRIVE, cycles);
+}
+
+// Real-time audio sectors go to the XA decoder instead of the CPU while ADPCM playback is on. With the filter on,
+// only the selected file and channel play, other audio sectors are skipped
+bool Cdrom::playAdpcm(const u8* sector) {
+    const u8* subheader = sector + 16;
+    const bool audio = sector[15] == 2 && (subheader[2] & 0x44) == 0x44;
+    if (!m_mode.xaAdpcm || !audio) return false;
+
+    if (m_mode.xaFilter && (subheader[0] != m_filterFile || subheader[1] != m_filterChannel)) return true;
+    XaCoding coding;
+    coding.r = subheader[3];
+    if (!m_xa.submit(coding, sector + 24)) m_emulator.log("CDROM: XA output full, sector dropped\n");
+    return true;
+}
+
+// Request the sectors still in use again, so they stay valid after the drive looked at sectors it didn't keep
+void Cdrom::keepSectors() {
+    if (m_data != nullptr) m_data = m_disc->sector(m_dataPosition) + (m_dataSize == 0x924 ? 12 : 24);
+    if (m_sector != nullptr) m_sector = m_disc->sector(m_sectorPosition);
+}
+
+void Cdrom::stopDrive() {
+    m_drive = DRIVE_STATE::IDLE;
+    m_emulator.m_scheduler.cancel(EVENT::CDROM_DRIVE);
+}
+
+void Cdrom::driveEvent() {
+    if (m_drive == DRIVE_STATE::SEEKING) {
+        if (m_seekPending) m_position = m_seekTarget;
+        m_seekPending = false;
+
+        if (!m_readAfterSeek) {
+            m_drive = DRIVE_STATE::IDLE;
+            queueSecond(2, {stat()}, CDROM_RETRY_DELAY);
+            return;
+        }
+        m_drive = DRIVE_STATE::READING;
+        m_emulator.m_scheduler.schedule(EVENT::CDROM_DRIVE, readCycles());
+        return;
+    }
+
+    if (m_drive != DRIVE_STATE::READING) return;
+    // The previous sector wasn't acknowledged yet. The drive moves on and this one is lost, unless reads are sped
+    // up. Then the drive waits, games that take more than a sector's time to handle one don't lose data
+    if (m_irqFlag && fastReads()) {
+        m_emulator.m_scheduler.schedule(EVENT::CDROM_DRIVE, CDROM_RETRY_DELAY);
+        return;
+    }
+    m_emulator.m_scheduler.schedule(EVENT::CDROM_DRIVE, readCycles());
+    if (m_irqFlag) {
+        // Audio sectors raise no interrupt, they still reach the decoder
+        if (m_mode.xaAdpcm) {
+            if (const u8* sector = m_disc->sector(m_position)) playAdpcm(sector);
+            keepSectors();
+        }
+        m_position++;
+        return;
+    }
+
+    // Sectors only stay valid for one more read, drop what is left of an older one in the data FIFO
+    if (m_data != nullptr && (m_data < m_sector || m_data >= m_sector + SECTOR_SIZE)) {
+        m_data = nullptr;
+        m_dataSize = m_dataIndex = 0;
+    }
+    const u8* sector = m_disc->sector(m_position);
+    if (sector == nullptr) {
+        m_emulator.log("CDROM: Couldn't read sector {}\n", m_position);
+        stopDrive();
+        error(ERROR_SEEK_FAILED);
+        return;
+    }
+    m_sector = sector;
+    m_sectorPosition = m_position;
+    m_disc->prefetch(m_position);
+    m_position++;
+    if (playAdpcm(m_sector)) return;
+    respond(1, {stat()});
+}
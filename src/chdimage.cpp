@@ -0,0 +1,596 @@
+#include "chdimage.hpp"
+
+#include <lzma.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string_view>
+
+#define CHD_HEADER_SIZE (124)
+#define CHD_MAP_HEADER_SIZE (16)
+
+static constexpr u32 codecTag(const char (&name)[5]) {
+    return u32(name[0]) << 24 | u32(name[1]) << 16 | u32(name[2]) << 8 | u32(name[3]);
+}
+
+static constexpr u32 CODEC_NONE = 0;
+static constexpr u32 CODEC_ZLIB = codecTag("zlib");
+static constexpr u32 CODEC_LZMA = codecTag("lzma");
+static constexpr u32 CODEC_CD_ZLIB = codecTag("cdzl");
+static constexpr u32 CODEC_CD_LZMA = codecTag("cdlz");
+
+static std::string codecName(u32 codec) {
+    return {char(codec >> 24), char(codec >> 16), char(codec >> 8), char(codec)};
+}
+
+// Hunk compression types in the map
+enum COMPRESSION : u8 {
+    CODEC0,
+    CODEC1,
+    CODEC2,
+    CODEC3,
+    NONE,
+    SELF,
+    PARENT,
+    RLE_SMALL,
+    RLE_LARGE,
+    SELF_0,
+    SELF_1,
+    PARENT_SELF,
+    PARENT_0,
+    PARENT_1,
+};
+
+static const u8 syncHeader[12] = {0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x00};
+static const u8 zeroSector[SECTOR_SIZE] = {};
+
+static u64 readBE(const u8* data, u32 bytes) {
+    u64 value = 0;
+    for (u32 i = 0; i < bytes; i++) value = value << 8 | data[i];
+    return value;
+}
+
+// MSB first bit reader for the compressed map. Reads past the end return zeroes
+class BitReader {
+  public:
+    BitReader(const u8* data, size_t size) : m_data(data), m_bits(size * 8) {}
+
+    u32 peek(u32 count) const {
+        u32 value = 0;
+        for (u32 i = 0; i < count; i++) {
+            const size_t bit = m_position + i;
+            value = value << 1 | (bit < m_bits ? (m_data[bit >> 3] >> (7 - (bit & 7))) & 1 : 0);
+        }
+        return value;
+    }
+    void skip(u32 count) { m_position += count; }
+    u32 read(u32 count) {
+        const u32 value = peek(count);
+        skip(count);
+        return value;
+    }
+    bool overflowed() const { return m_position > m_bits; }
+
+  private:
+    const u8* m_data;
+    size_t m_bits;
+    size_t m_position = 0;
+};
+
+// Canonical Huffman code over the 16 map compression types, codes are at most 8 bits
+class MapHuffman {
+  public:
+    bool import(BitReader& bits) {
+        // Code lengths are run-length encoded, 1 escapes either a literal 1 or a run
+        u32 node = 0;
+        while (node < m_lengths.size()) {
+            u32 length = bits.read(4);
+            if (length == 1) {
+                length = bits.read(4);
+                if (length != 1) {
+                    const u32 count = bits.read(4) + 3;
+                    if (node + count > m_lengths.size()) return false;
+                    for (u32 i = 0; i < count; i++) m_lengths[node++] = length;
+                    continue;
+                }
+            }
+            m_lengths[node++] = length;
+        }
+
+        // Assign codes from the longest length down
+        std::array<u32, 33> starts{};
+        for (auto length : m_lengths) {
+            if (length > maxBits) return false;
+            starts[length]++;
+        }
+        u32 start = 0;
+        for (u32 length = 32; length > 0; length--) {
+            const u32 next = (start + starts[length]) >> 1;
+            if (length != 1 && next * 2 != start + starts[length]) return false;
+            starts[length] = start;
+            start = next;
+        }
+
+        for (u32 value = 0; value < m_lengths.size(); value++) {
+            const u32 length = m_lengths[value];
+            if (length == 0) continue;
+            const u32 code = starts[length]++;
+            const u32 shift = maxBits - length;
+            for (u32 i = code << shift; i < (code + 1) << shift; i++) m_lookup[i] = u16(value << 5 | length);
+        }
+        return true;
+    }
+
+    u32 decode(BitReader& bits) const {
+        const u16 entry = m_lookup[bits.peek(maxBits)];
+        bits.skip(entry & 0x1f);
+        return entry >> 5;
+    }
+
+  private:
+    static constexpr u32 maxBits = 8;
+    std::array<u32, 16> m_lengths{};
+    std::array<u16, 1 << maxBits> m_lookup{};
+};
+
+// Raw deflate, without the zlib header
+static bool inflateRaw(const u8* source, u32 sourceSize, u8* destination, u32 size) {
+    z_stream stream{};
+    if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) return false;
+
+    stream.next_in = const_cast<u8*>(source);
+    stream.avail_in = sourceSize;
+    stream.next_out = destination;
+    stream.avail_out = size;
+    inflate(&stream, Z_FINISH);
+    inflateEnd(&stream);
+    return stream.total_out == size;
+}
+
+// Raw LZMA without an end marker, with the dictionary size chdman derives from the hunk size
+static bool decompressLzma(const u8* source, u32 sourceSize, u8* destination, u32 size, u32 hunkBytes) {
+    u32 dictionary = 1 << 26;
+    for (u32 i = 11; i <= 30 && dictionary > hunkBytes; i++) {
+        if (hunkBytes <= 2u << i) {
+            dictionary = 2u << i;
+        } else if (hunkBytes <= 3u << i) {
+            dictionary = 3u << i;
+        } else {
+            continue;
+        }
+        break;
+    }
+
+    lzma_options_lzma options{};
+    options.dict_size = dictionary;
+    options.lc = 3;
+    options.lp = 0;
+    options.pb = 2;
+    const lzma_filter filters[] = {{LZMA_FILTER_LZMA1, &options}, {LZMA_VLI_UNKNOWN, nullptr}};
+
+    lzma_stream stream = LZMA_STREAM_INIT;
+    if (lzma_raw_decoder(&stream, filters) != LZMA_OK) return false;
+
+    stream.next_in = source;
+    stream.avail_in = sourceSize;
+    stream.next_out = destination;
+    stream.avail_out = size;
+    // Without an end marker the decoder stops once the output is full
+    while (stream.avail_out && lzma_code(&stream, LZMA_RUN) == LZMA_OK && stream.avail_in) {
+    }
+    const bool done = stream.avail_out == 0;
+    lzma_end(&stream);
+    return done;
+}
+
+// Reed-Solomon tables of the CD-ROM ECC, GF(2^8) with the polynomial 0x11d
+static constexpr auto eccTables = [] {
+    std::array<std::array<u8, 256>, 2> tables{};
+    for (u32 i = 0; i < 256; i++) {
+        const u32 doubled = (i << 1) ^ (i & 0x80 ? 0x11d : 0);
+        tables[0][i] = u8(doubled);
+        tables[1][i ^ doubled] = u8(i);
+    }
+    return tables;
+}();
+
+static void eccBlock(u8* sector, u32 majorCount, u32 minorCount, u32 majorMult, u32 minorIncrement, u8* parity) {
+    const u8* source = sector + 12;
+    const u32 size = majorCount * minorCount;
+    const auto& forward = eccTables[0];
+    const auto& backward = eccTables[1];
+
+    for (u32 major = 0; major < majorCount; major++) {
+        u32 index = (major >> 1) * majorMult + (major & 1);
+        u8 a = 0, b = 0;
+        for (u32 minor = 0; minor < minorCount; minor++) {
+            const u8 value = source[index];
+            index += minorIncrement;
+            if (index >= size) index -= size;
+            a ^= value;
+            b ^= value;
+            a = forward[a];
+        }
+        a = backward[forward[a] ^ b];
+        parity[major] = a;
+        parity[major + majorCount] = a ^ b;
+    }
+}
+
+// chdman drops the sync pattern and ECC of sectors where it can regenerate them
+static void restoreEcc(u8* sector) {
+    std::memcpy(sector, syncHeader, sizeof(syncHeader));
+    eccBlock(sector, 86, 24, 2, 86, sector + 0x81c);  // P parity
+    eccBlock(sector, 52, 43, 86, 88, sector + 0x8c8);  // Q parity
+}
+
+ChdImage::~ChdImage() {
+    if (m_prefetcher.joinable()) {
+        m_stop = true;
+        m_prefetchTarget.fetch_add(1);
+        m_prefetchTarget.notify_one();
+        m_prefetcher.join();
+    }
+}
+
+bool ChdImage::open(const std::string& path) {
+    m_file = Helpers::mapROM(path);
+    if (!m_file.is_mapped() || m_file.size() < CHD_HEADER_SIZE) {
+        Helpers::warn("Couldn't map disc image {}\n", path);
+        return false;
+    }
+
+    const u8* header = m_file.data();
+    if (std::memcmp(header, "MComprHD", 8) != 0 || readBE(header + 12, 4) != 5) {
+        Helpers::warn("{} is not a version 5 CHD\n", path);
+        return false;
+    }
+    if (std::any_of(header + 104, header + 124, [](u8 byte) { return byte != 0; })) {
+        Helpers::warn("{} needs a parent CHD, which is not supported\n", path);
+        return false;
+    }
+
+    for (u32 i = 0; i < m_codecs.size(); i++) {
+        m_codecs[i] = u32(readBE(header + 16 + i * 4, 4));
+        const u32 codec = m_codecs[i];
+        if (codec != CODEC_NONE && codec != CODEC_ZLIB && codec != CODEC_LZMA && codec != CODEC_CD_ZLIB &&
+            codec != CODEC_CD_LZMA) {
+            Helpers::warn("{}: Hunks compressed with {} are not supported and fail to read\n", path, codecName(codec));
+        }
+    }
+
+    m_hunkBytes = u32(readBE(header + 56, 4));
+    const u32 unitBytes = u32(readBE(header + 60, 4));
+    if (unitBytes != CHD_FRAME_SIZE || m_hunkBytes == 0 || m_hunkBytes % CHD_FRAME_SIZE) {
+        Helpers::warn("{} is not a CD image\n", path);
+        return false;
+    }
+    m_framesPerHunk = m_hunkBytes / CHD_FRAME_SIZE;
+
+    if (!readMap(header)) {
+        Helpers::warn("{} has an invalid hunk map\n", path);
+        return false;
+    }
+    if (!readTracks(readBE(header + 48, 8))) return false;
+
+    m_pool.resize(std::clamp(std::thread::hardware_concurrency() / 2, 1u, 4u));
+    m_prefetchTarget = u32(std::max<s64>(frameAt(m_tracks.front().start), 0) / m_framesPerHunk);
+    m_prefetcher = std::thread([this] { prefetchLoop(); });
+    return true;
+}
+
+bool ChdImage::readMap(const u8* header) {
+    const u64 logicalBytes = readBE(header + 32, 8);
+    const u64 mapOffset = readBE(header + 40, 8);
+    const u64 hunkCount = (logicalBytes + m_hunkBytes - 1) / m_hunkBytes;
+    const size_t fileSize = m_file.size();
+    m_map.resize(hunkCount);
+
+    // Uncompressed images have a plain table of hunk numbers
+    if (m_codecs[0] == CODEC_NONE) {
+        if (mapOffset + hunkCount * 4 > fileSize) return false;
+        for (u64 i = 0; i < hunkCount; i++) {
+            const u64 offset = readBE(m_file.data() + mapOffset + i * 4, 4) * m_hunkBytes;
+            if (offset + m_hunkBytes > fileSize) return false;
+            m_map[i] = {NONE, m_hunkBytes, offset};
+        }
+        return true;
+    }
+
+    if (mapOffset + CHD_MAP_HEADER_SIZE > fileSize) return false;
+    const u8* mapHeader = m_file.data() + mapOffset;
+    const u32 mapBytes = u32(readBE(mapHeader, 4));
+    u64 offset = readBE(mapHeader + 4, 6);
+    const u32 lengthBits = mapHeader[12];
+    const u32 selfBits = mapHeader[13];
+    const u32 parentBits = mapHeader[14];
+    if (mapOffset + CHD_MAP_HEADER_SIZE + mapBytes > fileSize) return false;
+
+    BitReader bits(mapHeader + CHD_MAP_HEADER_SIZE, mapBytes);
+    MapHuffman huffman;
+    if (!huffman.import(bits)) return false;
+
+    // Compression types first, with runs of the previous type
+    u8 last = CODEC0;
+    u32 repeat = 0;
+    for (auto& entry : m_map) {
+        if (repeat > 0) {
+            entry.compression = last;
+            repeat--;
+            continue;
+        }
+
+        const u32 type = huffman.decode(bits);
+        if (type == RLE_SMALL) {
+            entry.compression = last;
+            repeat = 2 + huffman.decode(bits);
+        } else if (type == RLE_LARGE) {
+            entry.compression = last;
+            repeat = 2 + 16 + (huffman.decode(bits) << 4);
+            repeat += huffman.decode(bits);
+        } else {
+            entry.compression = last = u8(type);
+        }
+    }
+
+    // Then the lengths and offsets. Compressed hunks follow each other in the file
+    u64 lastSelf = 0;
+    for (auto& entry : m_map) {
+        switch (entry.compression) {
+            case CODEC0:
+            case CODEC1:
+            case CODEC2:
+            case CODEC3:
+            case NONE:
+                entry.length = entry.compression == NONE ? m_hunkBytes : bits.read(lengthBits);
+                entry.offset = offset;
+                offset += entry.length;
+                bits.skip(16);  // CRC16
+                if (entry.offset + entry.length > fileSize) return false;
+                break;
+            case SELF: entry.offset = lastSelf = bits.read(selfBits); break;
+            case SELF_1: lastSelf++; [[fallthrough]];
+            case SELF_0:
+                entry.compression = SELF;
+                entry.offset = lastSelf;
+                break;
+            case PARENT: bits.skip(parentBits); [[fallthrough]];
+            case PARENT_SELF:
+            case PARENT_0:
+            case PARENT_1: entry.compression = PARENT; break;
+            default: return false;
+        }
+        if (entry.compression == SELF && entry.offset >= u64(&entry - m_map.data())) return false;
+    }
+    return !bits.overflowed();
+}
+
+// Tracks are stored one after the other, each padded to a multiple of 4 frames
+bool ChdImage::readTracks(u64 offset) {
+    u32 frame = 0;
+    u32 position = 0;
+
+    while (offset != 0 && offset + 16 <= m_file.size()) {
+        const u8* entry = m_file.data() + offset;
+        const u32 tag = u32(readBE(entry, 4));
+        const u32 length = u32(readBE(entry + 5, 3));
+        offset = readBE(entry + 8, 8);
+        if (tag != codecTag("CHT2") && tag != codecTag("CHTR")) continue;
+
+        const std::string text(reinterpret_cast<const char*>(entry + 16),
+                               std::min<size_t>(length, m_file.size() - (entry + 16 - m_file.data())));
+        u32 number = 0, frames = 0, pregap = 0, postgap = 0;
+        char type[32] = {}, subtype[32] = {}, pregapType[32] = {}, pregapSubtype[32] = {};
+        const char* format = "TRACK:%u TYPE:%31s SUBTYPE:%31s FRAMES:%u PREGAP:%u PGTYPE:%31s PGSUB:%31s POSTGAP:%u";
+        const int fields = std::sscanf(text.c_str(), format, &number, type, subtype, &frames, &pregap, pregapType,
+                                       pregapSubtype, &postgap);
+        if (fields < 4) {
+            Helpers::warn("Invalid CHD track metadata {}\n", text);
+            return false;
+        }
+
+        const std::string_view mode = type;
+        if (mode != "AUDIO" && mode != "MODE1_RAW" && mode != "MODE2_RAW") {
+            Helpers::warn("Track {} is {}, only raw 2352 byte tracks are supported\n", number, mode);
+            return false;
+        }
+
+        const u32 stored = pregapType[0] == 'V' ? std::min(pregap, frames) : 0;
+        const u32 leadIn = m_tracks.empty() ? LEAD_IN_SECTORS : 0;
+        position += leadIn + pregap - stored;
+
+        Track track{number, mode == "AUDIO" ? TRACK_TYPE::AUDIO : TRACK_TYPE::DATA};
+        track.start = position + stored;
+        track.pregap = pregap + leadIn;
+        track.length = frames - stored;
+        m_tracks.push_back(track);
+        m_trackData.push_back({frame + stored, stored});
+
+        position = track.start + track.length + postgap;
+        frame += (frames + 3) & ~3;
+    }
+
+    if (m_tracks.empty()) {
+        Helpers::warn("CHD has no CD track metadata\n");
+        return false;
+    }
+    return true;
+}
+
+// Frame in the image holding a position, -1 for gaps that aren't stored
+s64 ChdImage::frameAt(u32 position) const {
+    const Track* track = trackAt(position);
+    if (track == nullptr) return -1;
+
+    const auto& data = m_trackData[track - m_tracks.data()];
+    const s64 relative = s64(position) - track->start;
+    if (relative < -s64(data.storedPregap)) return -1;
+
+    const s64 frame = data.frame + relative;
+    return frame < s64(m_map.size()) * m_framesPerHunk ? frame : -1;
+}
+
+const u8* ChdImage::sector(u32 position) {
+    const s64 frame = frameAt(position);
+    if (frame < 0) return zeroSector;
+
+    auto data = hunk(u32(frame / m_framesPerHunk));
+    if (data->empty()) return nullptr;
+    const u8* sector = data->data() + (frame % m_framesPerHunk) * SECTOR_SIZE;
+    m_returned[m_returnedIndex++ & 1] = std::move(data);
+    return sector;
+}
+
+ChdImage::Hunk ChdImage::cached(u32 index) {
+    std::lock_guard lock(m_cacheMutex);
+    const auto entry = m_cache.find(index);
+    if (entry == m_cache.end()) return nullptr;
+
+    m_lru.splice(m_lru.begin(), m_lru, entry->second);
+    return entry->second->second;
+}
+
+void ChdImage::insert(u32 index, const Hunk& hunk) {
+    std::lock_guard lock(m_cacheMutex);
+    if (m_cache.contains(index)) return;
+
+    m_lru.emplace_front(index, hunk);
+    m_cache[index] = m_lru.begin();
+    if (m_lru.size() > CHD_CACHE_HUNKS) {
+        m_cache.erase(m_lru.back().first);
+        m_lru.pop_back();
+    }
+}
+
+// Misses decompress on the calling thread instead of waiting for the prefetcher
+ChdImage::Hunk ChdImage::hunk(u32 index) {
+    if (auto data = cached(index)) return data;
+
+    auto data = std::make_shared<const std::vector<u8>>(decompress(index));
+    insert(index, data);
+    return data;
+}
+
+std::vector<u8> ChdImage::decompress(u32 index) {
+    std::vector<u8> sectors(m_framesPerHunk * SECTOR_SIZE);
+    const auto& entry = m_map[index];
+    const u8* source = m_file.data() + entry.offset;
+
+    // Frames are 2352 bytes of sector followed by the subchannel, which isn't kept
+    auto fromFrames = [&](const u8* frames) {
+        for (u32 i = 0; i < m_framesPerHunk; i++) {
+            std::memcpy(&sectors[i * SECTOR_SIZE], frames + i * CHD_FRAME_SIZE, SECTOR_SIZE);
+        }
+    };
+
+    bool ok = true;
+    switch (entry.compression) {
+        case CODEC0:
+        case CODEC1:
+        case CODEC2:
+        case CODEC3: {
+            const u32 codec = m_codecs[entry.compression];
+            if (codec == CODEC_CD_ZLIB || codec == CODEC_CD_LZMA) {
+                ok = decompressCd(codec, source, entry.length, sectors.data());
+            } else if (codec == CODEC_ZLIB || codec == CODEC_LZMA) {
+                std::vector<u8> frames(m_hunkBytes);
+                if (codec == CODEC_ZLIB) {
+                    ok = inflateRaw(source, entry.length, frames.data(), m_hunkBytes);
+                } else {
+                    ok = decompressLzma(source, entry.length, frames.data(), m_hunkBytes, m_hunkBytes);
+                }
+                fromFrames(frames.data());
+            } else {
+                Helpers::warn("CHD: Hunk {} uses the unsupported {} codec\n", index, codecName(codec));
+                return {};
+            }
+            break;
+        }
+        case NONE: fromFrames(source); break;
+        case SELF: return std::vector<u8>(*hunk(u32(entry.offset)));
+        default: break;
+    }
+
+    if (!ok) {
+        Helpers::warn("CHD: Couldn't decompress hunk {}\n", index);
+        return {};
+    }
+    swapAudio(index, sectors);
+    return sectors;
+}
+
+// The CD codecs compress the sectors and the subchannel data separately, after a bitmap of sectors to regenerate
+// the ECC for and the compressed size of the sectors
+bool ChdImage::decompressCd(u32 codec, const u8* source, u32 length, u8* sectors) const {
+    const u32 eccBytes = (m_framesPerHunk + 7) / 8;
+    const u32 sizeBytes = m_hunkBytes < 65536 ? 2 : 3;
+    if (length < eccBytes + sizeBytes) return false;
+
+    const u32 baseLength = u32(readBE(source + eccBytes, sizeBytes));
+    const u8* base = source + eccBytes + sizeBytes;
+    if (baseLength > length - eccBytes - sizeBytes) return false;
+
+    const u32 size = m_framesPerHunk * SECTOR_SIZE;
+    const bool ok = codec == CODEC_CD_ZLIB ? inflateRaw(base, baseLength, sectors, size)
+                                           : decompressLzma(base, baseLength, sectors, size, size);
+    if (!ok) return false;
+
+    for (u32 i = 0; i < m_framesPerHunk; i++) {
+        if (source[i / 8] & (1 << (i % 8))) restoreEcc(sectors + i * SECTOR_SIZE);
+    }
+    return true;
+}
+
+// Audio is stored big-endian
+void ChdImage::swapAudio(u32 index, std::vector<u8>& sectors) const {
+    const u32 first = index * m_framesPerHunk;
+    for (size_t i = 0; i < m_tracks.size(); i++) {
+        if (m_tracks[i].type != TRACK_TYPE::AUDIO) continue;
+
+        const u32 start = m_trackData[i].frame - m_trackData[i].storedPregap;
+        const u32 end = m_trackData[i].frame + m_tracks[i].length;
+        for (u32 frame = std::max(first, start); frame < std::min(first + m_framesPerHunk, end); frame++) {
+            u8* sector = &sectors[(frame - first) * SECTOR_SIZE];
+            for (u32 byte = 0; byte < SECTOR_SIZE; byte += 2) std::swap(sector[byte], sector[byte + 1]);
+        }
+    }
+}
+
+// Only wake the prefetcher once reads get halfway through the hunks it already decompressed
+void ChdImage::prefetch(u32 position) {
+    const s64 frame = frameAt(position);
+    if (frame < 0) return;
+
+    const u32 index = u32(frame / m_framesPerHunk);
+    const u32 target = m_prefetchTarget.load(std::memory_order_relaxed);
+    if (index >= target && index < target + CHD_PREFETCH_HUNKS / 2) return;
+
+    m_prefetchTarget.store(index);
+    m_prefetchTarget.notify_one();
+}
+
+void ChdImage::prefetchLoop() {
+    std::vector<u32> missing;
+
+    while (!m_stop) {
+        const u32 target = m_prefetchTarget.load();
+        const u32 end = std::min<u32>(target + CHD_PREFETCH_HUNKS, m_map.size());
+
+        missing.clear();
+        {
+            std::lock_guard lock(m_cacheMutex);
+            for (u32 index = target; index < end; index++) {
+                if (!m_cache.contains(index)) missing.push_back(index);
+            }
+        }
+
+        m_pool.run(missing.size(), [&](size_t i) {
+            if (m_stop) return;
+            insert(missing[i], std::make_shared<const std::vector<u8>>(decompress(missing[i])));
+        });
+
+        m_prefetchTarget.wait(target);
+    }
+}
@@ -22,9 +22,20 @@ void Cpu::reset() {
     m_loadDelay = false;
 }
 
+void Cpu::serialize(Serializer& s) {
+    s(m_regs);
+    s(m_loadDelay);
+    s(m_inLoadDelaySlot);
+    s(m_branchDelay);
+    s(m_inBranchDelaySlot);
+    s(m_branching);
+    s(m_pendingLoad);
+    s(m_instruction.code);
+}
+
 void Cpu::fetch() {
     m_regs.gpr.zero = 0;
-    m_instruction = m_emulator.m_mem.psxRead32(m_regs.pc);
+    m_instruction = m_emulator.m_mem.read<u32>(m_regs.pc);
     m_emulator.log("Current PC: {:#x} Instruction: {:#x}\n", m_regs.pc, m_instruction.code);
 }
 
@@ -72,10 +83,34 @@ void Cpu::handleBranchDelay() {
     }
 }
 
+void Cpu::handleInterrupt() {
+    // Retire a pending load, the instruction it was waiting on won't run before the handler
+    if (m_loadDelay) {
+        m_regs.wbLoadDelay();
+        clearLoadDelay();
+    }
+
+    ExceptionHandler(Interrupt);
+
+    // The handler returns to EPC, which points at the branch when interrupted in a delay slot
+    m_branchDelay = false;
+    m_inBranchDelaySlot = false;
+    m_regs.jumppc = 0;
+    m_regs.link_pc = 0;
+    m_regs.next_pc = m_regs.pc + 4;
+    fetch();
+}
+
 void Cpu::step() {
     m_branching = false;
     m_regs.backup_pc = m_regs.pc;
 
+    // IEc and IM2 set, and the interrupt controller has an unmasked request
+    if ((m_regs.copr.sr & 0x401) == 0x401 && m_emulator.m_irq.pending()) {
+        handleInterrupt();
+        return;
+    }
+
     if ((m_regs.pc % 4) != 0) {
         m_emulator.log("Unaligned PC {:#x}", m_regs.pc);
         ExceptionHandler(BadLoadAddress);
@@ -97,9 +132,6 @@ void Cpu::step() {
 
     fetch();
     m_emulator.checktoBreak();
-
-    // TEMP FIX FOR MISSING GPU
-    m_emulator.m_mem.write32(m_emulator.m_mem.m_hw, 0xe8, 0);
 }
 
 void Cpu::logMnemonic() {
@@ -0,0 +1,223 @@
+#include "cueimage.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+// Unstored gaps read back as silence, or as an empty data sector
+static const u8 zeroSector[SECTOR_SIZE] = {};
+
+CueImage::~CueImage() {
+    if (m_prefetcher.joinable()) {
+        m_stop = true;
+        m_prefetchTarget.fetch_add(1);
+        m_prefetchTarget.notify_one();
+        m_prefetcher.join();
+    }
+}
+
+bool CueImage::mapFile(const std::string& path) {
+    auto map = Helpers::mapROM(path);
+    if (!map.is_mapped() || map.size() < SECTOR_SIZE) {
+        Helpers::warn("Couldn't map disc image {}\n", path);
+        return false;
+    }
+    if (map.size() % SECTOR_SIZE) Helpers::warn("{} is not a whole number of 2352 byte sectors\n", path);
+
+    m_files.push_back(std::move(map));
+    return true;
+}
+
+bool CueImage::openBin(const std::string& path) {
+    if (!mapFile(path)) return false;
+
+    m_tracks.push_back({1, TRACK_TYPE::DATA});
+    m_trackData.push_back({0, 0, 0});
+    m_cueGaps.push_back(0);
+    layout();
+    startPrefetcher();
+    return true;
+}
+
+static bool parseMsf(const std::string& text, u32& position) {
+    u32 minutes, seconds, sectors;
+    char colon1, colon2;
+    std::istringstream stream(text);
+    if (!(stream >> minutes >> colon1 >> seconds >> colon2 >> sectors) || colon1 != ':' || colon2 != ':') return false;
+
+    position = CD::position(minutes, seconds, sectors);
+    return true;
+}
+
+// Only raw BINARY files with 2352 byte sectors are supported
+bool CueImage::openCue(const std::string& path) {
+    std::ifstream cue(path);
+    if (!cue) {
+        Helpers::warn("Couldn't open CUE sheet {}\n", path);
+        return false;
+    }
+
+    const auto directory = std::filesystem::path(path).parent_path();
+    std::vector<u32> index0;  // Index 0 of each track in file sectors, UINT32_MAX without one
+    std::string line;
+    u32 lineNumber = 0;
+
+    while (std::getline(cue, line)) {
+        lineNumber++;
+        std::istringstream stream(line);
+        std::string command;
+        stream >> command;
+
+        auto fail = [&](const char* reason) {
+            Helpers::warn("{}:{}: {}\n", path, lineNumber, reason);
+            return false;
+        };
+
+        if (command == "FILE") {
+            std::string name, type;
+            stream >> std::ws;
+            if (stream.peek() == '"') {
+                stream.get();
+                std::getline(stream, name, '"');
+            } else {
+                stream >> name;
+            }
+            stream >> type;
+            if (type != "BINARY") return fail("Only BINARY files are supported");
+            if (!mapFile((directory / name).string())) return false;
+        } else if (command == "TRACK") {
+            u32 number;
+            std::string mode;
+            stream >> number >> mode;
+            if (m_files.empty()) return fail("TRACK before FILE");
+
+            TRACK_TYPE type;
+            if (mode == "AUDIO") {
+                type = TRACK_TYPE::AUDIO;
+            } else if (mode == "MODE2/2352" || mode == "MODE1/2352") {
+                type = TRACK_TYPE::DATA;
+            } else {
+                return fail("Only raw 2352 byte tracks are supported");
+            }
+
+            m_tracks.push_back({number, type});
+            m_trackData.push_back({u32(m_files.size() - 1)});
+            m_cueGaps.push_back(0);
+            index0.push_back(UINT32_MAX);
+        } else if (command == "INDEX" || command == "PREGAP") {
+            if (m_tracks.empty()) return fail("INDEX or PREGAP before TRACK");
+
+            u32 index = 0, position;
+            std::string time;
+            if (command == "INDEX") stream >> index;
+            stream >> time;
+            if (!parseMsf(time, position)) return fail("Invalid time");
+
+            if (command == "PREGAP") {
+                m_cueGaps.back() = position;
+            } else if (index == 0) {
+                index0.back() = position;
+            } else if (index == 1) {
+                m_trackData.back().fileSector = position;
+            }
+        }
+    }
+
+    if (m_tracks.empty()) {
+        Helpers::warn("{} has no tracks\n", path);
+        return false;
+    }
+
+    for (size_t i = 0; i < m_tracks.size(); i++) {
+        if (index0[i] != UINT32_MAX) m_trackData[i].storedPregap = m_trackData[i].fileSector - index0[i];
+    }
+    layout();
+    startPrefetcher();
+    return true;
+}
+
+// Place the tracks on the disc. Files follow each other, with the unstored gaps in between
+void CueImage::layout() {
+    u32 fileStart = LEAD_IN_SECTORS;
+    u32 gaps = 0;  // Unstored gaps so far in the current file
+
+    for (size_t i = 0; i < m_tracks.size(); i++) {
+        auto& track = m_tracks[i];
+        const auto& data = m_trackData[i];
+        const u32 fileSectors = u32(m_files[data.file].size() / SECTOR_SIZE);
+
+        if (i > 0 && data.file != m_trackData[i - 1].file) {
+            const auto& previous = m_trackData[i - 1];
+            fileStart += gaps + u32(m_files[previous.file].size() / SECTOR_SIZE);
+            gaps = 0;
+        }
+
+        gaps += m_cueGaps[i];
+        track.start = fileStart + gaps + data.fileSector;
+        track.pregap = data.storedPregap + m_cueGaps[i] + (i == 0 ? LEAD_IN_SECTORS : 0);
+
+        const bool lastInFile = i + 1 == m_tracks.size() || m_trackData[i + 1].file != data.file;
+        const u32 end = lastInFile ? fileSectors : m_trackData[i + 1].fileSector - m_trackData[i + 1].storedPregap;
+        track.length = end > data.fileSector ? end - data.fileSector : 0;
+    }
+}
+
+const u8* CueImage::fileSector(u32 position) const {
+    const Track* track = trackAt(position);
+    if (track == nullptr) return nullptr;
+
+    const auto& data = m_trackData[track - m_tracks.data()];
+    const s64 relative = s64(position) - track->start;
+    if (relative < -s64(data.storedPregap)) return nullptr;  // In the unstored part of the pregap
+
+    const u64 offset = u64(data.fileSector + relative) * SECTOR_SIZE;
+    const auto& map = m_files[data.file];
+    return offset + SECTOR_SIZE <= map.size() ? map.data() + offset : nullptr;
+}
+
+const u8* CueImage::sector(u32 position) {
+    const u8* data = fileSector(position);
+    return data ? data : zeroSector;
+}
+
+// Only wake the prefetcher once reads get halfway through what it already touched
+void CueImage::prefetch(u32 position) {
+    const u32 target = m_prefetchTarget.load(std::memory_order_relaxed);
+    if (position >= target && position < target + PREFETCH_SECTORS / 2) return;
+
+    m_prefetchTarget.store(position);
+    m_prefetchTarget.notify_one();
+}
+
+void CueImage::startPrefetcher() {
+    m_prefetchTarget = m_tracks.front().start;
+    m_prefetcher = std::thread([this] { prefetchLoop(); });
+}
+
+// Read a byte from every page of the sectors ahead of the target, faulting them in on this thread
+void CueImage::prefetchLoop() {
+    constexpr size_t pageSize = 4096;
+    u32 prefetchedFrom = 0;
+    u32 prefetchedUntil = 0;
+    u32 sum = 0;
+
+    while (!m_stop) {
+        const u32 target = m_prefetchTarget.load();
+        const bool continues = target >= prefetchedFrom && target <= prefetchedUntil;
+        const u32 first = continues ? prefetchedUntil : target;
+
+        for (u32 position = first; position < target + PREFETCH_SECTORS && !m_stop; position++) {
+            const u8* data = fileSector(position);
+            if (data == nullptr) continue;
+            for (size_t offset = 0; offset < SECTOR_SIZE; offset += pageSize) sum += data[offset];
+            sum += data[SECTOR_SIZE - 1];
+        }
+
+        prefetchedFrom = target;
+        prefetchedUntil = target + PREFETCH_SECTORS;
+        m_prefetchTarget.wait(target);
+    }
+
+    // Keep the reads from being optimized out
+    asm volatile("" : : "r"(sum));
+}
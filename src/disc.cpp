@@ -0,0 +1,39 @@
+#include "disc.hpp"
+
+#include <algorithm>
+#include <filesystem>
+
+#include "chdimage.hpp"
+#include "cueimage.hpp"
+
+std::unique_ptr<Disc> Disc::open(const std::string& path) {
+    auto extension = std::filesystem::path(path).extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+    if (extension == ".cue") {
+        auto image = std::make_unique<CueImage>();
+        if (image->openCue(path)) return image;
+    } else if (extension == ".chd") {
+        auto image = std::make_unique<ChdImage>();
+        if (image->open(path)) return image;
+    } else if (extension == ".bin" || extension == ".img") {
+        auto image = std::make_unique<CueImage>();
+        if (image->openBin(path)) return image;
+    } else {
+        Helpers::warn("Unsupported disc image {}\n", path);
+    }
+    return nullptr;
+}
+
+// Tracks are sorted, each one covering its pregap up to the start of the next one
+const Track* Disc::trackAt(u32 position) const {
+    const auto next = std::upper_bound(m_tracks.begin(), m_tracks.end(), position, [](u32 position, const Track& t) {
+        return position < t.start - t.pregap;
+    });
+    if (next == m_tracks.begin()) return nullptr;
+
+    const Track& track = *(next - 1);
+    return position < track.start + track.length ? &track : nullptr;
+}
+
+u32 Disc::end() const { return m_tracks.empty() ? 0 : m_tracks.back().start + m_tracks.back().length; }
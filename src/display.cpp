@@ -0,0 +1,54 @@
+#include "display.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "rasterizer.hpp"
+
+namespace Display {
+
+static inline u32 expand5(u32 value) { return (value << 3) | (value >> 2); }
+
+void convertRow15Scalar(const u16* src, u32 count, u32* dst) {
+    for (u32 i = 0; i < count; i++) {
+        const u16 pixel = src[i];
+        dst[i] = expand5(pixel & 0x1f) | expand5((pixel >> 5) & 0x1f) << 8 | expand5((pixel >> 10) & 0x1f) << 16 |
+                 0xff000000;
+    }
+}
+
+void convertRow24Scalar(const u8* src, u32 count, u32* dst) {
+    for (u32 i = 0; i < count; i++) {
+        dst[i] = src[i * 3] | src[i * 3 + 1] << 8 | src[i * 3 + 2] << 16 | 0xff000000;
+    }
+}
+
+void convert(const u16* vram, u32 x, u32 y, u32 width, u32 height, bool depth24, u32* rgba) {
+    const bool avx2 = Rasterizer::backend() == Rasterizer::BACKEND::AVX2;
+    const auto row15 = avx2 ? convertRow15AVX2 : convertRow15Scalar;
+    const auto row24 = avx2 ? convertRow24AVX2 : convertRow24Scalar;
+
+    // 24bpp rows are gathered with the wraparound and padding the kernels expect
+    constexpr u32 rowBytes = VRAM_WIDTH * 2;
+    u8 packed[rowBytes + 32] = {};
+
+    for (u32 line = 0; line < height; line++) {
+        const u16* row = vram + ((y + line) & (VRAM_HEIGHT - 1)) * VRAM_WIDTH;
+        u32* dst = rgba + line * width;
+
+        if (depth24) {
+            const u32 bytes = std::min(width * 3, rowBytes);
+            const u32 start = (x * 2) % rowBytes;
+            const u32 first = std::min(bytes, rowBytes - start);
+            std::memcpy(packed, reinterpret_cast<const u8*>(row) + start, first);
+            std::memcpy(packed + first, row, bytes - first);
+            row24(packed, bytes / 3, dst);
+        } else {
+            const u32 first = std::min(width, VRAM_WIDTH - x);
+            row15(row + x, first, dst);
+            row15(row, width - first, dst + first);
+        }
+    }
+}
+
+}  // namespace Display
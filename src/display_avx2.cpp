@@ -0,0 +1,65 @@
+#include "display.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#define AVX2_TARGET
+#else
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+namespace Display {
+
+// 8 pixels per iteration, the tail goes through the scalar path
+AVX2_TARGET void convertRow15AVX2(const u16* src, u32 count, u32* dst) {
+    const __m256i channel = _mm256_set1_epi32(0x1f);
+    const __m256i alpha = _mm256_set1_epi32(0xff000000);
+
+    u32 i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const __m256i pixels = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+        const __m256i r = _mm256_and_si256(pixels, channel);
+        const __m256i g = _mm256_and_si256(_mm256_srli_epi32(pixels, 5), channel);
+        const __m256i b = _mm256_and_si256(_mm256_srli_epi32(pixels, 10), channel);
+
+        // Each 5-bit channel becomes (c << 3) | (c >> 2), placed at its byte
+        __m256i color = _mm256_or_si256(r, _mm256_or_si256(_mm256_slli_epi32(g, 8), _mm256_slli_epi32(b, 16)));
+        color = _mm256_or_si256(_mm256_slli_epi32(color, 3), _mm256_and_si256(_mm256_srli_epi32(color, 2),
+                                                                              _mm256_set1_epi32(0x070707)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_or_si256(color, alpha));
+    }
+
+    convertRow15Scalar(src + i, count - i, dst + i);
+}
+
+// 8 pixels per iteration, 4 from each 128-bit lane. Reads up to 4 bytes past the last pixel of an iteration
+AVX2_TARGET void convertRow24AVX2(const u8* src, u32 count, u32* dst) {
+    const __m256i shuffle = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1, 0, 1, 2, -1, 3,
+                                             4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m256i alpha = _mm256_set1_epi32(0xff000000);
+
+    u32 i = 0;
+    for (; i + 8 <= count; i += 8) {
+        const u8* bytes = src + i * 3;
+        const __m256i packed = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes))),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + 12)), 1);
+        const __m256i color = _mm256_or_si256(_mm256_shuffle_epi8(packed, shuffle), alpha);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), color);
+    }
+
+    convertRow24Scalar(src + i * 3, count - i, dst + i);
+}
+
+}  // namespace Display
+
+#else
+
+namespace Display {
+
+void convertRow15AVX2(const u16* src, u32 count, u32* dst) { convertRow15Scalar(src, count, dst); }
+void convertRow24AVX2(const u8* src, u32 count, u32* dst) { convertRow24Scalar(src, count, dst); }
+
+}  // namespace Display
+
+#endif
@@ -0,0 +1,319 @@
+#include "dma.hpp"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "emulator.hpp"
+
+void Dma::reset() {
+    for (auto& channel : m_channels) {
+        channel.madr = 0;
+        channel.bcr = 0;
+        channel.chcr.r = 0;
+    }
+    m_dpcr = 0x07654321;
+    m_dicr.r = 0;
+    m_waiting = 0;
+}
+
+void Dma::serialize(Serializer& s) {
+    for (auto& channel : m_channels) {
+        s(channel.madr);
+        s(channel.bcr);
+        s(channel.chcr.r);
+    }
+    s(m_dpcr);
+    s(m_dicr.r);
+    s(m_waiting);
+}
+
+u32 Dma::read(u32 offset) {
+    const u32 channel = (offset - 0x80) >> 4;
+    const u32 shift = (offset & 3) * 8;
+
+    if (channel == 7) {
+        switch (offset & ~3) {
+            case 0xf0:
+                return m_dpcr >> shift;
+            case 0xf4:
+                return m_dicr.r >> shift;
+            default:
+                return 0;
+        }
+    }
+
+    switch (offset & 0xc) {
+        case 0x0:
+            return m_channels[channel].madr >> shift;
+        case 0x4:
+            return m_channels[channel].bcr >> shift;
+        case 0x8:
+            return m_channels[channel].chcr.r >> shift;
+        default:
+            return 0;
+    }
+}
+
+void Dma::write(u32 offset, u32 value, u32 size) {
+    const u32 channel = (offset - 0x80) >> 4;
+    const u32 shift = (offset & 3) * 8;
+    const u32 mask = (size == 4 ? 0xffffffff : (1u << (size * 8)) - 1) << shift;
+    value = (value << shift) & mask;
+    auto merge = [&](u32 old) { return (old & ~mask) | value; };
+
+    if (channel == 7) {
+        switch (offset & ~3) {
+            case 0xf0:
+                m_dpcr = merge(m_dpcr);
+                break;
+            case 0xf4: {
+                // Writing 1 to a channel flag acknowledges it, the flags in bytes not written stay
+                const u32 flags = m_dicr.r & 0x7f000000 & ~value;
+                m_dicr.r = flags | (merge(m_dicr.r) & 0x00ff803f);
+                updateMasterFlag();
+                break;
+            }
+            default:
+                m_emulator.log("DMA: Unhandled write at offset {:#x}, value {:#x}\n", offset, value);
+        }
+        return;
+    }
+
+    auto& dmaChannel = m_channels[channel];
+    switch (offset & 0xc) {
+        case 0x0:
+            dmaChannel.madr = merge(dmaChannel.madr) & 0xffffff;
+            break;
+        case 0x4:
+            dmaChannel.bcr = merge(dmaChannel.bcr);
+            break;
+        case 0x8:
+            value = merge(dmaChannel.chcr.r);
+            // OTC only ever writes to RAM, backwards
+            if (channel == (u32)DMA_CHANNEL::OTC) value = (value & 0x51000000) | 2;
+            dmaChannel.chcr.r = value;
+            if (isActive(dmaChannel) && (m_dpcr >> (channel * 4 + 3)) & 1) startTransfer(channel);
+            break;
+        default:
+            break;
+    }
+}
+
+bool Dma::isActive(const DmaChannel& channel) const {
+    return channel.chcr.busy && (channel.chcr.syncMode != MANUAL || channel.chcr.trigger);
+}
+
+void Dma::startTransfer(u32 channel) {
+    auto& dmaChannel = m_channels[channel];
+    dmaChannel.chcr.trigger = 0;
+
+    // Games may start reading the MDEC before sending it anything, the transfer waits for the decoded data
+    if (channel == (u32)DMA_CHANNEL::MDEC_OUT && !m_emulator.m_mdec.outputReady()) {
+        m_waiting |= 1 << channel;
+        return;
+    }
+    m_waiting &= ~(1 << channel);
+
+    m_emulator.log("DMA{}: Transfer started, MADR {:#x} BCR {:#x} CHCR {:#x}\n", channel, dmaChannel.madr,
+                   dmaChannel.bcr, dmaChannel.chcr.r);
+
+    u32 words = 0;
+    if (dmaChannel.chcr.syncMode == LINKED_LIST) {
+        words = linkedListTransfer(channel);
+    } else {
+        words = blockTransfer(channel);
+    }
+
+    // The bus is busy for about a cycle per word, the CPU carries on and sees the channel finish afterwards
+    m_emulator.m_scheduler.schedule(static_cast<EVENT>((u32)EVENT::DMA0 + channel), words + 1);
+}
+
+void Dma::requestTransfer(DMA_CHANNEL channel) {
+    const u32 index = (u32)channel;
+    if ((m_waiting >> index) & 1 && isActive(m_channels[index])) startTransfer(index);
+}
+
+void Dma::finishTransfer(u32 channel) {
+    m_channels[channel].chcr.busy = 0;
+
+    if ((m_dicr.channelEnable >> channel) & 1) {
+        m_dicr.channelFlags = m_dicr.channelFlags | (1 << channel);
+    }
+    updateMasterFlag();
+}
+
+void Dma::updateMasterFlag() {
+    const bool previous = m_dicr.masterFlag;
+    const bool flag = m_dicr.forceIrq || (m_dicr.masterEnable && (m_dicr.channelEnable & m_dicr.channelFlags) != 0);
+
+    m_dicr.masterFlag = flag;
+    if (flag && !previous) {
+        m_emulator.m_irq.trigger(IRQ::DMA);
+    }
+}
+
+// Move a contiguous run of words between RAM and the device on a channel
+static void transferSpan(Emulator& emulator, DMA_CHANNEL channel, bool fromRam, u32* ram, u32 words) {
+    switch (channel) {
+        case DMA_CHANNEL::MDEC_IN:
+            if (fromRam) {
+                emulator.m_mdec.dmaWrite(ram, words);
+            } else {
+                emulator.log("DMA0: Reads from the MDEC input are not supported, {} words dropped\n", words);
+            }
+            break;
+        case DMA_CHANNEL::MDEC_OUT:
+            if (fromRam) {
+                emulator.log("DMA1: Writes to the MDEC output are not supported, {} words dropped\n", words);
+            } else {
+                emulator.m_mdec.dmaRead(ram, words);
+            }
+            break;
+        case DMA_CHANNEL::GPU:
+            if (fromRam) {
+                emulator.m_gpu.dmaWrite(ram, words);
+            } else {
+                emulator.m_gpu.dmaRead(ram, words);
+            }
+            break;
+        case DMA_CHANNEL::CDROM:
+            if (fromRam) {
+                emulator.log("DMA3: Writes to the CD-ROM are not supported, {} words dropped\n", words);
+            } else {
+                emulator.m_cdrom.dmaRead(ram, words);
+            }
+            break;
+        case DMA_CHANNEL::SPU:
+            if (fromRam) {
+                emulator.m_spu.dmaWrite(ram, words);
+            } else {
+                emulator.m_spu.dmaRead(ram, words);
+            }
+            break;
+        default:
+            emulator.log("DMA{}: No device attached, {} words dropped\n", (u32)channel, words);
+            break;
+    }
+}
+
+u32 Dma::blockTransfer(u32 channel) {
+    auto& dmaChannel = m_channels[channel];
+    const u32 bcr = dmaChannel.bcr;
+    const bool fromRam = dmaChannel.chcr.fromRam;
+    const bool decrement = dmaChannel.chcr.decrement;
+    const auto device = static_cast<DMA_CHANNEL>(channel);
+
+    u32 words = 0;
+    if (dmaChannel.chcr.syncMode == MANUAL) {
+        words = (bcr & 0xffff) ? (bcr & 0xffff) : 0x10000;
+    } else {
+        words = (bcr & 0xffff) * (bcr >> 16);
+    }
+
+    u32 address = dmaChannel.madr & 0x1ffffc;
+    auto& mem = m_emulator.m_mem;
+    u8* ram = mem.m_ram;
+
+    if (device == DMA_CHANNEL::OTC) {
+        clearOrderingTable(address, words);
+        address = (address - words * 4) & 0x1ffffc;
+    } else if (decrement) {
+        // Rare outside of OTC, go word by word
+        for (u32 i = 0; i < words; i++) {
+            transferSpan(m_emulator, device, fromRam, reinterpret_cast<u32*>(ram + address), 1);
+            if (!fromRam) mem.markDirty(address);
+            address = (address - 4) & 0x1ffffc;
+        }
+    } else {
+        // Split at the end of RAM so every span is a single contiguous block
+        u32 remaining = words;
+        while (remaining) {
+            const u32 span = std::min(remaining, (RAM_SIZE - address) / 4);
+            transferSpan(m_emulator, device, fromRam, reinterpret_cast<u32*>(ram + address), span);
+            if (!fromRam) mem.markDirty(address, span * 4);
+            address = (address + span * 4) & 0x1ffffc;
+            remaining -= span;
+        }
+    }
+
+    if (dmaChannel.chcr.syncMode == BLOCK) {
+        dmaChannel.madr = address;
+        dmaChannel.bcr &= 0xffff;
+    }
+    return words;
+}
+
+u32 Dma::linkedListTransfer(u32 channel) {
+    auto& dmaChannel = m_channels[channel];
+    if (static_cast<DMA_CHANNEL>(channel) != DMA_CHANNEL::GPU || !dmaChannel.chcr.fromRam) {
+        m_emulator.log("DMA{}: Linked list mode is only supported from RAM to the GPU\n", channel);
+        return 0;
+    }
+
+    u8* ram = m_emulator.m_mem.m_ram;
+    u32 address = dmaChannel.madr & 0x1ffffc;
+    u32 words = 0;
+
+    // A malformed list can loop forever, stop after as many nodes as RAM could hold
+    for (u32 nodes = 0; nodes < RAM_SIZE / 4; nodes++) {
+        const u32 header = Memory::load<u32>(ram, address);
+        const u32 count = header >> 24;
+
+        if (count) {
+            const u32 payload = (address + 4) & 0x1ffffc;
+            if (payload + count * 4 <= RAM_SIZE) {
+                m_emulator.m_gpu.dmaWrite(reinterpret_cast<u32*>(ram + payload), count);
+            } else {
+                for (u32 i = 0; i < count; i++) {
+                    m_emulator.m_gpu.writeGP0(Memory::load<u32>(ram, (payload + i * 4) & 0x1ffffc));
+                }
+            }
+        }
+
+        words += count + 1;
+        if (header & 0x800000) break;
+        address = header & 0x1ffffc;
+    }
+
+    dmaChannel.madr = 0xffffff;
+    return words;
+}
+
+// Build an empty ordering table: every entry links to the one before it, the first entry ends the list
+void Dma::clearOrderingTable(u32 address, u32 words) {
+    if (words == 0) return;
+    auto& mem = m_emulator.m_mem;
+    u8* ram = mem.m_ram;
+    const u32 start = address - (words - 1) * 4;
+
+    // The table wraps around the start of RAM, fall back to one word at a time
+    if (start > address || address >= RAM_SIZE) {
+        for (u32 i = 0; i < words; i++) {
+            const u32 entry = (address - i * 4) & 0x1ffffc;
+            Memory::store<u32>(ram, entry, i == words - 1 ? 0xffffff : (entry - 4) & 0xffffff);
+            mem.markDirty(entry);
+        }
+        return;
+    }
+    mem.markDirty(start, words * 4);
+
+    // Fill in ascending address order so the loop can be vectorized
+    u32* table = reinterpret_cast<u32*>(ram + start);
+    u32 i = 0;
+
+#if defined(__SSE2__)
+    __m128i links = _mm_setr_epi32(start - 4, start, start + 4, start + 8);
+    const __m128i step = _mm_set1_epi32(16);
+    const __m128i mask = _mm_set1_epi32(0xffffff);
+    for (; i + 4 <= words; i += 4) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(table + i), _mm_and_si128(links, mask));
+        links = _mm_add_epi32(links, step);
+    }
+#endif
+
+    for (; i < words; i++) {
+        table[i] = (start + i * 4 - 4) & 0xffffff;
+    }
+    table[0] = 0xffffff;
+}
@@ -1,42 +1,225 @@
 #include "emulator.hpp"
 
+#include <filesystem>
+
+#include "SaveFile/SaveFile.hpp"
 #include "fmt/format.h"
 
 void Emulator::step() {
-    if (!m_biosLoaded) return;
+    if (!canRun()) return;
     log("Step\n");
     m_cpu.step();
+    m_scheduler.tick(CYCLES_PER_INSTRUCTION);
+    checkSideload();
     log("\n");
 }
 
 void Emulator::runFrame() {
-    if (!m_biosLoaded) return;
+    if (!canRun()) return;
     log("Frame {}\n", framesPassed++);
     m_cpu.step();
+    m_scheduler.tick(CYCLES_PER_INSTRUCTION);
+    checkSideload();
+    if (m_rewind.enabled() && !m_runAhead.speculating()) m_rewind.poll(m_gpu.m_frameCount);
 }
 
 void Emulator::loadBios(const std::string& path) {
     log("Loading BIOS file {}\n", path);
 
-    auto [bios, hash] = Helpers::loadROMWithHash(path);
-
+    auto [size, hash] = Helpers::loadROMWithHash(path, m_mem.m_bios, BIOS_SIZE);
+    m_mem.markBiosDirty();
 
-    if (!bios.size()) {
+    if (!size) {
         log("Invalid BIOS File\n");
         m_biosLoaded = false;
         return;
     }
 
-    log("BIOS Size: {}kb\n", bios.size() / 1024);
+    log("BIOS Size: {}kb\n", size / 1024);
     log("BIOS SHA1 Checksum: {}\n", hash);
 
-    std::memcpy(m_mem.m_bios, bios.data(), bios.size());
     m_cpu.fetch();
     m_biosLoaded = true;
 }
 
+void Emulator::loadExe(const std::string& path) {
+    log("Loading EXE file {}\n", path);
+
+    auto file = Helpers::mapROM(path);
+
+    if (!file.is_mapped() || file.size() < EXE_HEADER_SIZE) {
+        Helpers::warn("Couldn't map EXE file {}\n", path);
+        return;
+    }
+
+    const auto header = reinterpret_cast<const ExeHeader*>(file.data());
+    if (!header->valid()) {
+        Helpers::warn("Invalid EXE header in {}\n", path);
+        return;
+    }
+
+    log("EXE PC: {:#x} GP: {:#x} Text: {:#x} ({}kb)\n", header->pc0, header->gp0, header->t_addr,
+        header->t_size / 1024);
+
+    // With a BIOS the kernel gets to initialize itself, and the EXE replaces the shell. The shell entry point may
+    // already be behind us, so reboot to make sure it's reached again
+    if (m_biosLoaded) {
+        const bool wasRunning = isRunning;
+        reset();
+        m_cpu.fetch();
+        isRunning = wasRunning;
+
+        m_exeFile = std::move(file);
+        m_exeLoaded = true;
+        m_sideloadPending = true;
+        log("Rebooting, EXE will be loaded once the BIOS reaches the shell\n");
+    } else {
+        m_exeFile = std::move(file);
+        m_exeLoaded = true;
+        log("No BIOS loaded, starting EXE right away\n");
+        sideloadExe();
+    }
+}
+
+void Emulator::loadDisc(const std::string& path) {
+    log("Loading disc image {}\n", path);
+
+    auto disc = Disc::open(path);
+    if (!disc) {
+        log("Couldn't open disc image {}\n", path);
+        return;
+    }
+
+    const auto& tracks = disc->tracks();
+    log("Disc: {} track(s), {} sectors\n", tracks.size(), disc->end());
+    m_cdrom.insertDisc(std::move(disc));
+}
+
+void Emulator::serialize(Serializer& s) {
+    m_scheduler.serialize(s);
+    m_mem.serialize(s);
+    m_cpu.serialize(s);
+    m_irq.serialize(s);
+    m_dma.serialize(s);
+    m_timers.serialize(s);
+    m_gpu.serialize(s);
+    m_spu.serialize(s);
+    m_cdrom.serialize(s);
+    m_mdec.serialize(s);
+    s(framesPassed);
+}
+
+// The state is measured first, then written straight into the mapped file
+bool Emulator::saveState(const std::string& path) {
+    Serializer measure(Serializer::MODE::MEASURE);
+    serialize(measure);
+    SaveStateHeader header;
+    header.size = measure.position();
+
+    // SaveFile maps a file of a fixed size and won't take an existing file of another size
+    std::error_code error;
+    std::filesystem::remove(path, error);
+    SaveFile file(std::filesystem::path(path), sizeof(header) + header.size);
+    if (file.data() == nullptr) {
+        Helpers::warn("Couldn't create save state {}\n", path);
+        return false;
+    }
+
+    std::memcpy(file.data(), &header, sizeof(header));
+    Serializer writer(Serializer::MODE::SAVE, file.data() + sizeof(header), header.size);
+    serialize(writer);
+    file.flush();
+    log("Saved state to {}, {}kb\n", path, (sizeof(header) + header.size) / 1024);
+    return writer.ok();
+}
+
+bool Emulator::loadState(const std::string& path) {
+    std::error_code error;
+    const auto size = std::filesystem::file_size(path, error);
+    if (error || size < sizeof(SaveStateHeader)) {
+        Helpers::warn("Couldn't open save state {}\n", path);
+        return false;
+    }
+
+    SaveFile file(std::filesystem::path(path), size, false);
+    SaveStateHeader header;
+    if (file.data() != nullptr) std::memcpy(&header, file.data(), sizeof(header));
+    if (file.data() == nullptr || header.magic != SAVESTATE_MAGIC || header.size != size - sizeof(header)) {
+        Helpers::warn("{} is not a save state\n", path);
+        return false;
+    }
+    if (header.version != SAVESTATE_VERSION) {
+        Helpers::warn("Save state {} is version {}, expected {}\n", path, header.version, SAVESTATE_VERSION);
+        return false;
+    }
+
+    Serializer reader(Serializer::MODE::LOAD, file.data() + sizeof(header), header.size);
+    serialize(reader);
+    if (!reader.ok() || reader.position() != header.size) {
+        Helpers::warn("Save state {} is corrupt, resetting\n", path);
+        reset();
+        return false;
+    }
+
+    // The BIOS came with the state, and an EXE waiting to be sideloaded is either in RAM by now or never will be
+    m_biosLoaded = true;
+    m_sideloadPending = false;
+    m_exeFile.unmap();
+    m_rewind.clear();
+    log("Loaded state from {}\n", path);
+    return true;
+}
+
+void Emulator::sideloadExe() {
+    const auto header = reinterpret_cast<const ExeHeader*>(m_exeFile.data());
+    const u8* text = m_exeFile.data() + EXE_HEADER_SIZE;
+
+    u32 textOffset = header->t_addr & (RAM_SIZE - 1);
+    size_t textSize = std::min<size_t>(header->t_size, m_exeFile.size() - EXE_HEADER_SIZE);
+    textSize = std::min<size_t>(textSize, RAM_SIZE - textOffset);
+    std::memcpy(m_mem.m_ram + textOffset, text, textSize);
+    m_mem.markDirty(textOffset, textSize);
+
+    if (header->b_size) {
+        u32 bssOffset = header->b_addr & (RAM_SIZE - 1);
+        const size_t bssSize = std::min<size_t>(header->b_size, RAM_SIZE - bssOffset);
+        std::memset(m_mem.m_ram + bssOffset, 0, bssSize);
+        m_mem.markDirty(bssOffset, bssSize);
+    }
+
+    auto& regs = m_cpu.m_regs;
+    regs.pc = header->pc0;
+    regs.next_pc = header->pc0 + 4;
+    regs.gpr.gp = header->gp0;
+    if (header->s_addr) {
+        regs.gpr.sp = header->s_addr + header->s_size;
+        regs.gpr.fp = regs.gpr.sp;
+    }
+
+    m_cpu.clearLoadDelay();
+    m_cpu.m_branchDelay = false;
+    m_cpu.m_inBranchDelaySlot = false;
+    m_cpu.fetch();
+
+    m_sideloadPending = false;
+    m_exeFile.unmap();
+    log("EXE loaded, jumping to {:#x}\n", regs.pc);
+}
+
 void Emulator::reset() {
     isRunning = false;
+    m_scheduler.reset();
     m_mem.reset();
     m_cpu.reset();
+    m_irq.reset();
+    m_dma.reset();
+    m_timers.reset();
+    m_gpu.reset();
+    m_spu.reset();
+    m_cdrom.reset();
+    m_mdec.reset();
+    m_rewind.clear();
+    m_exeLoaded = false;
+    m_sideloadPending = false;
+    m_exeFile.unmap();
 }
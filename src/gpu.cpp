@@ -0,0 +1,432 @@
+#include "gpu.hpp"
+
+#include <algorithm>
+
+#include "emulator.hpp"
+
+#define MAX_PACKET_SIZE (4096)        // Bounds runaway polylines
+#define VRAM_WRITE_CHUNK_SIZE (2048)  // In words
+
+Gpu::Gpu(Emulator& emulator) : m_emulator(emulator) {
+    m_fifo.reserve(VRAM_WRITE_CHUNK_SIZE);
+    reset();
+}
+
+void Gpu::reset() {
+    writeGP1(0);
+    m_frameCount = 0;
+    m_frameStart = m_emulator.m_scheduler.now();
+    m_emulator.m_scheduler.schedule(EVENT::VBLANK, cyclesPerFrame());
+}
+
+void Gpu::serialize(Serializer& s) {
+    s(m_stat.r);
+    s(m_display);
+    s(m_frameCount);
+    s(m_mode);
+    s(m_fifo);
+    s(m_packetLength);
+    s(m_vramWriteRemaining);
+    s(m_readBuffer);
+    s(m_readPosition);
+    s(m_gpuRead);
+    s(m_texWindow);
+    s(m_drawAreaTopLeft);
+    s(m_drawAreaBottomRight);
+    s(m_drawOffset);
+    s(m_frameStart);
+    m_renderer.serialize(s);
+
+    // Convert the whole display area again
+    if (s.loading()) {
+        m_displaySource = {};
+        if (m_presentFrames) updateFramebuffer();
+    }
+}
+
+u32 Gpu::dotClockDivider() const {
+    if (m_stat.hres2) return 7;
+
+    static constexpr u32 dividers[4] = {10, 8, 5, 4};  // 256, 320, 512 and 640 dots wide
+    return dividers[m_stat.hres1];
+}
+
+u32 Gpu::cyclesPerScanline() const { return m_stat.pal ? GPU_CYCLES_PER_SCANLINE_PAL : GPU_CYCLES_PER_SCANLINE_NTSC; }
+
+u64 Gpu::cyclesPerFrame() const {
+    const u64 scanlines = m_stat.pal ? SCANLINES_PAL : SCANLINES_NTSC;
+    return scanlines * cyclesPerScanline() * GPU_CLOCK_DEN / GPU_CLOCK_NUM;
+}
+
+u32 Gpu::displayWidth() const {
+    if (m_stat.hres2) return 368;
+
+    static constexpr u32 widths[4] = {256, 320, 512, 640};
+    return widths[m_stat.hres1];
+}
+
+// Visible lines from the vertical display range, doubled in 480i
+u32 Gpu::displayHeight() const {
+    const u32 maxLines = m_stat.pal ? 288 : 240;
+    const u32 lines = std::clamp<u32>(m_display.rangeY2 - m_display.rangeY1, 1, maxLines);
+    return (m_stat.vres && m_stat.interlace) ? lines * 2 : lines;
+}
+
+u32 Gpu::read(u32 offset) {
+    switch (offset) {
+        case 0x810: return readData();
+        case 0x814: return status();
+        default: return 0;
+    }
+}
+
+void Gpu::write(u32 offset, u32 value) {
+    switch (offset) {
+        case 0x810: writeGP0(value); break;
+        case 0x814: writeGP1(value); break;
+        default: break;
+    }
+}
+
+u32 Gpu::status() {
+    // The command FIFO drains instantly, so the GPU is always ready for commands and DMA blocks
+    m_stat.readyCommand = 1;
+    m_stat.readyDmaBlock = 1;
+    m_stat.readyVramToCpu = m_readPosition < m_readBuffer.size();
+
+    switch (m_stat.dmaDirection) {
+        case 0: m_stat.dmaRequest = 0; break;
+        case 1:
+        case 2: m_stat.dmaRequest = 1; break;
+        case 3: m_stat.dmaRequest = m_stat.readyVramToCpu; break;
+    }
+
+    // The scanline is derived from the cycles since VBlank. Bit 31 stays low during VBlank
+    const u64 gpuCycles = (m_emulator.m_scheduler.now() - m_frameStart) * GPU_CLOCK_NUM / GPU_CLOCK_DEN;
+    const u64 scanline = gpuCycles / cyclesPerScanline();
+    const u64 vblankLines = (m_stat.pal ? SCANLINES_PAL - 288 : SCANLINES_NTSC - 240);
+    if (scanline < vblankLines) {
+        m_stat.oddLine = 0;
+    } else if (m_stat.vres && m_stat.interlace) {
+        m_stat.oddLine = m_stat.interlaceField;
+    } else {
+        m_stat.oddLine = scanline & 1;
+    }
+
+    return m_stat.r;
+}
+
+u32 Gpu::readData() {
+    if (m_readPosition < m_readBuffer.size()) {
+        const u32 value = m_readBuffer[m_readPosition++];
+        if (m_readPosition == m_readBuffer.size()) {
+            m_readBuffer.clear();
+            m_readPosition = 0;
+        }
+        return value;
+    }
+
+    return m_gpuRead;
+}
+
+// Packet size in words from the command byte. Polylines are terminated by a marker word instead
+static u32 packetLength(u32 command) {
+    switch (command >> 5) {
+        case 1: {  // Polygon
+            const u32 vertices = (command & 0x8) ? 4 : 3;
+            const u32 wordsPerVertex = (command & 0x4) ? 2 : 1;
+            const u32 colors = (command & 0x10) ? vertices - 1 : 0;
+            return 1 + vertices * wordsPerVertex + colors;
+        }
+        case 2: return (command & 0x10) ? 4 : 3;  // Line
+        case 3: {  // Rectangle, variable sized ones have a size word
+            const u32 size = ((command >> 3) & 3) == 0 ? 1 : 0;
+            return 2 + ((command & 0x4) ? 1 : 0) + size;
+        }
+        case 4: return 4;  // VRAM to VRAM
+        case 5:
+        case 6: return 3;  // CPU to VRAM, VRAM to CPU
+        default: return command == 0x02 ? 3 : 1;
+    }
+}
+
+void Gpu::writeGP0(u32 value) {
+    switch (m_mode) {
+        case GP0_MODE::VRAM_WRITE:
+            m_fifo.push_back(value);
+            if (--m_vramWriteRemaining == 0 || m_fifo.size() == VRAM_WRITE_CHUNK_SIZE) flushVramWrite();
+            return;
+
+        case GP0_MODE::POLYLINE: {
+            // The terminator replaces the next vertex, or the next color for shaded lines
+            const bool shaded = (m_fifo[0] >> 24) & 0x10;
+            const size_t index = m_fifo.size();
+            const bool vertexStart = shaded ? (index % 2 == 0) : true;
+            if ((vertexStart && (value & 0xf000f000) == 0x50005000) || index == MAX_PACKET_SIZE) {
+                executePacket();
+                return;
+            }
+            m_fifo.push_back(value);
+            return;
+        }
+
+        case GP0_MODE::COMMAND:
+            if (m_fifo.empty()) {
+                const u32 command = value >> 24;
+                m_packetLength = packetLength(command);
+            }
+
+            m_fifo.push_back(value);
+            if (m_fifo.size() < m_packetLength) return;
+
+            if ((m_fifo[0] >> 29) == 2 && (m_fifo[0] & 0x08000000)) {
+                m_mode = GP0_MODE::POLYLINE;  // The first segment is complete, wait for the terminator
+                return;
+            }
+            executePacket();
+            return;
+    }
+}
+
+void Gpu::executePacket() {
+    const u32 command = m_fifo[0] >> 24;
+    m_mode = GP0_MODE::COMMAND;
+
+    switch (command >> 5) {
+        case 1:
+            if (command & 0x4) {  // Textured polygons update the texpage bits of GPUSTAT
+                const u32 page = m_fifo[(command & 0x10) ? 5 : 4] >> 16;
+                m_stat.r = (m_stat.r & ~0x81ff) | (page & 0x1ff) | ((page & 0x800) << 4);
+            }
+            break;
+
+        case 5: {  // CPU to VRAM
+            const u32 width = ((m_fifo[2] - 1) & 0x3ff) + 1;
+            const u32 height = (((m_fifo[2] >> 16) - 1) & 0x1ff) + 1;
+            render(RENDER_COMMAND::GP0, m_fifo.data(), m_fifo.size());
+            m_fifo.clear();
+
+            m_vramWriteRemaining = (width * height + 1) / 2;
+            m_mode = GP0_MODE::VRAM_WRITE;
+            return;
+        }
+
+        case 6:  // VRAM to CPU
+            startVramRead(m_fifo[1], m_fifo[2]);
+            m_fifo.clear();
+            return;
+
+        case 0:
+            if (command == 0x1f) {  // Interrupt request
+                m_stat.irq = 1;
+                m_emulator.m_irq.trigger(IRQ::GPU);
+            }
+            break;
+
+        case 7: {
+            const u32 value = m_fifo[0];
+            switch (command) {
+                case 0xe1: m_stat.r = (m_stat.r & ~0x87ff) | (value & 0x7ff) | ((value & 0x800) << 4); break;
+                case 0xe2: m_texWindow = value & 0xfffff; break;
+                case 0xe3: m_drawAreaTopLeft = value & 0xfffff; break;
+                case 0xe4: m_drawAreaBottomRight = value & 0xfffff; break;
+                case 0xe5: m_drawOffset = value & 0x3fffff; break;
+                case 0xe6:
+                    m_stat.setMask = value & 1;
+                    m_stat.checkMask = (value >> 1) & 1;
+                    break;
+                default: break;
+            }
+            break;
+        }
+
+        default: break;
+    }
+
+    render(RENDER_COMMAND::GP0, m_fifo.data(), m_fifo.size());
+    m_fifo.clear();
+}
+
+void Gpu::flushVramWrite() {
+    if (!m_fifo.empty()) render(RENDER_COMMAND::VRAM_WRITE, m_fifo.data(), m_fifo.size());
+    m_fifo.clear();
+    if (m_vramWriteRemaining == 0) m_mode = GP0_MODE::COMMAND;
+}
+
+void Gpu::startVramRead(u32 position, u32 size) {
+    const u32 x = position & 0x3ff;
+    const u32 y = (position >> 16) & 0x1ff;
+    const u32 width = ((size - 1) & 0x3ff) + 1;
+    const u32 height = (((size >> 16) - 1) & 0x1ff) + 1;
+
+    m_renderer.sync();
+    const u16* vram = m_renderer.vram();
+
+    m_readBuffer.assign((width * height + 1) / 2, 0);
+    m_readPosition = 0;
+    for (u32 i = 0; i < width * height; i++) {
+        const u32 px = (x + i % width) & (VRAM_WIDTH - 1);
+        const u32 py = (y + i / width) & (VRAM_HEIGHT - 1);
+        m_readBuffer[i / 2] |= vram[py * VRAM_WIDTH + px] << ((i & 1) * 16);
+    }
+}
+
+void Gpu::writeGP1(u32 value) {
+    const u32 command = (value >> 24) & 0x3f;
+    if (m_recorder.active()) m_recorder.gp1(value);
+
+    switch (command) {
+        case 0x00:  // Reset
+            m_stat.r = 0x14802000;
+            m_display = DisplayState();
+            m_texWindow = m_drawAreaTopLeft = m_drawAreaBottomRight = m_drawOffset = 0;
+            m_readBuffer.clear();
+            m_readPosition = 0;
+            m_fifo.clear();
+            m_mode = GP0_MODE::COMMAND;
+            render(RENDER_COMMAND::RESET, nullptr, 0);
+            m_emulator.m_timers.updateVideoClocks();
+            break;
+        case 0x01:  // Reset command buffer
+            if (m_mode == GP0_MODE::VRAM_WRITE) {
+                m_vramWriteRemaining = 0;
+                flushVramWrite();
+            }
+            m_fifo.clear();
+            m_mode = GP0_MODE::COMMAND;
+            break;
+        case 0x02: m_stat.irq = 0; break;
+        case 0x03: m_stat.displayDisable = value & 1; break;
+        case 0x04: m_stat.dmaDirection = value & 3; break;
+        case 0x05:
+            m_display.startX = value & 0x3fe;
+            m_display.startY = (value >> 10) & 0x1ff;
+            break;
+        case 0x06:
+            m_display.rangeX1 = value & 0xfff;
+            m_display.rangeX2 = (value >> 12) & 0xfff;
+            break;
+        case 0x07:
+            m_display.rangeY1 = value & 0x3ff;
+            m_display.rangeY2 = (value >> 10) & 0x3ff;
+            break;
+        case 0x08:  // Display mode
+            m_stat.hres1 = value & 3;
+            m_stat.vres = (value >> 2) & 1;
+            m_stat.pal = (value >> 3) & 1;
+            m_stat.colorDepth24 = (value >> 4) & 1;
+            m_stat.interlace = (value >> 5) & 1;
+            m_stat.hres2 = (value >> 6) & 1;
+            m_stat.reverse = (value >> 7) & 1;
+            m_emulator.m_timers.updateVideoClocks();
+            break;
+        default:
+            if ((command & 0xf0) == 0x10) {  // GPU info
+                switch (value & 7) {
+                    case 2: m_gpuRead = m_texWindow; break;
+                    case 3: m_gpuRead = m_drawAreaTopLeft; break;
+                    case 4: m_gpuRead = m_drawAreaBottomRight; break;
+                    case 5: m_gpuRead = m_drawOffset; break;
+                    case 7: m_gpuRead = 2; break;  // GPU version
+                    default: break;
+                }
+                break;
+            }
+            m_emulator.log("GPU: Unhandled GP1 command {:#x}\n", value);
+            break;
+    }
+}
+
+void Gpu::dmaWrite(const u32* words, u32 count) {
+    u32 i = 0;
+    while (i < count) {
+        // Large uploads skip the per word path and go to the renderer in chunks
+        if (m_mode == GP0_MODE::VRAM_WRITE && m_fifo.empty()) {
+            const u32 chunk = std::min({count - i, m_vramWriteRemaining, (u32)VRAM_WRITE_CHUNK_SIZE});
+            render(RENDER_COMMAND::VRAM_WRITE, words + i, chunk);
+            m_vramWriteRemaining -= chunk;
+            if (m_vramWriteRemaining == 0) m_mode = GP0_MODE::COMMAND;
+            i += chunk;
+            continue;
+        }
+
+        writeGP0(words[i++]);
+    }
+}
+
+void Gpu::dmaRead(u32* words, u32 count) {
+    for (u32 i = 0; i < count; i++) words[i] = readData();
+}
+
+// Present the frame: wait for the renderer so VRAM holds everything drawn this frame
+void Gpu::vblank() {
+    m_emulator.m_irq.trigger(IRQ::VBlank);
+    m_renderer.sync();
+    if (m_presentFrames) updateFramebuffer();
+    if (m_recorder.active()) m_recorder.vblank();
+
+    m_frameCount++;
+    m_emulator.m_mem.endFrame();
+    if (m_stat.interlace) m_stat.interlaceField = !m_stat.interlaceField;
+
+    m_frameStart = m_emulator.m_scheduler.now();
+    m_emulator.m_scheduler.schedule(EVENT::VBLANK, cyclesPerFrame());
+}
+
+// Convert the display area to RGBA. While the display mode stays the same only the lines whose VRAM was written
+// since the last frame are converted again
+void Gpu::updateFramebuffer() {
+    DisplaySource source;
+    source.x = m_display.startX;
+    source.y = m_display.startY;
+    source.width = displayWidth();
+    source.height = displayHeight();
+    source.depth24 = m_stat.colorDepth24;
+    source.disabled = m_stat.displayDisable;
+
+    const u32 halfwords = source.depth24 ? (source.width * 3 + 1) / 2 : source.width;
+    source.vramVersion =
+        m_renderer.vramVersion(source.x, source.y, source.x + halfwords - 1, source.y + source.height - 1);
+    if (source == m_displaySource && m_framebuffer.generation != 0) return;
+
+    auto sameMode = [](DisplaySource a, const DisplaySource& b) {
+        a.vramVersion = b.vramVersion;
+        return a == b;
+    };
+    const bool partial = sameMode(source, m_displaySource) && m_framebuffer.generation != 0 && !source.disabled;
+    const u64 lastVersion = m_displaySource.vramVersion;
+    m_displaySource = source;
+
+    auto& frame = m_framebuffer;
+    frame.width = source.width;
+    frame.height = source.height;
+    frame.pixels.resize(frame.width * frame.height);
+    frame.rowGenerations.resize(frame.height);
+    frame.generation++;
+
+    if (source.disabled) {
+        std::fill(frame.pixels.begin(), frame.pixels.end(), 0xff000000);
+        std::fill(frame.rowGenerations.begin(), frame.rowGenerations.end(), frame.generation);
+        return;
+    }
+
+    for (u32 line = 0; line < source.height; line++) {
+        const u32 y = (source.y + line) & (VRAM_HEIGHT - 1);
+        if (partial && m_renderer.vramVersion(source.x, y, source.x + halfwords - 1, y) <= lastVersion) continue;
+
+        // Convert the whole run of changed lines at once
+        u32 end = line + 1;
+        while (end < source.height) {
+            const u32 nextY = (source.y + end) & (VRAM_HEIGHT - 1);
+            if (partial && m_renderer.vramVersion(source.x, nextY, source.x + halfwords - 1, nextY) <= lastVersion) {
+                break;
+            }
+            end++;
+        }
+
+        Display::convert(m_renderer.vram(), source.x, y, source.width, end - line, source.depth24,
+                         frame.pixels.data() + line * frame.width);
+        std::fill(frame.rowGenerations.begin() + line, frame.rowGenerations.begin() + end, frame.generation);
+        line = end;
+    }
+}
@@ -0,0 +1,120 @@
+#include "headless.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+#include "benchmark.hpp"
+#include "fmt/format.h"
+#include "recorder.hpp"
+
+using Helpers::warn;
+
+Options::Options(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+
+        if (arg == "--headless") {
+            headless = true;
+        } else if (arg == "--bios" && hasValue) {
+            biosPath = argv[++i];
+        } else if (arg == "--exe" && hasValue) {
+            exePath = argv[++i];
+        } else if (arg == "--disc" && hasValue) {
+            discPath = argv[++i];
+        } else if (arg == "--cd-speed" && hasValue) {
+            cdromSpeed.readMultiplier = std::stoul(argv[++i]);
+        } else if (arg == "--instant-seek") {
+            cdromSpeed.instantSeek = true;
+        } else if (arg == "--state" && hasValue) {
+            statePath = argv[++i];
+        } else if (arg == "--run-ahead" && hasValue) {
+            runAheadFrames = std::stoul(argv[++i]);
+        } else if (arg == "--bench" && hasValue) {
+            headless = true;
+            benchmark = argv[++i];
+        } else if (arg == "--instructions" && hasValue) {
+            instructions = std::stoull(argv[++i]);
+        } else if (arg == "--record" && hasValue) {
+            recordPath = argv[++i];
+        } else if (arg == "--frames" && hasValue) {
+            recordFrames = std::stoul(argv[++i]);
+        } else if (arg == "--replay" && hasValue) {
+            headless = true;
+            replayPath = argv[++i];
+        } else if (arg == "--threads" && hasValue) {
+            renderThreads = std::stoul(argv[++i]);
+        } else {
+            warn("Unknown option {}\n", arg);
+            fmt::print("Usage: {} [--headless] [--bios <file>] [--exe <file>] [--disc <file>]\n"
+                       "          [--cd-speed <multiplier>] [--instant-seek] [--instructions <count>]\n"
+                       "          [--state <file>] [--run-ahead <frames>] [--record <file> [--frames <count>]]\n"
+                       "       {} --bench <name|all>\n"
+                       "       {} --replay <file> [--threads <count>]\n",
+                       argv[0], argv[0], argv[0]);
+        }
+    }
+}
+
+int Headless::run() {
+    using Clock = std::chrono::steady_clock;
+
+    if (!m_options.benchmark.empty()) {
+        return Benchmark::run(m_options.benchmark);
+    }
+
+    if (!m_options.replayPath.empty()) {
+        return replay();
+    }
+
+    if (!m_emulator.canRun()) {
+        warn("Nothing to run, pass a BIOS with --bios, an EXE with --exe or a save state with --state\n");
+        return 1;
+    }
+
+    const auto start = Clock::now();
+    bool waitingForExe = m_emulator.m_sideloadPending;
+    u64 executed = 0;
+
+    if (!waitingForExe && m_emulator.m_exeLoaded) {
+        fmt::print("EXE started without BIOS\n");
+    }
+
+    m_emulator.isRunning = true;
+    while (m_emulator.isRunning) {
+        m_emulator.runFrame();
+        executed++;
+
+        if (waitingForExe && !m_emulator.m_sideloadPending) {
+            const auto elapsed = std::chrono::duration<double, std::milli>(Clock::now() - start);
+            fmt::print("EXE started after {} instructions, {:.2f}ms\n", executed, elapsed.count());
+            waitingForExe = false;
+        }
+
+        if (m_options.instructions && executed >= m_options.instructions) break;
+    }
+
+    const auto elapsed = std::chrono::duration<double>(Clock::now() - start);
+    fmt::print("Executed {} instructions in {:.3f}s\n", executed, elapsed.count());
+    return 0;
+}
+
+// Replay a GPU recording with no CPU emulation and report how long the renderer took
+int Headless::replay() {
+    const u32 threads = m_options.renderThreads ? m_options.renderThreads : m_emulator.m_gpu.m_renderer.threads();
+
+    ReplayStats stats;
+    if (!::replay(m_options.replayPath, threads, stats)) {
+        warn("{} is not a GPU recording\n", m_options.replayPath);
+        return 1;
+    }
+
+    const double frames = std::max<u64>(stats.frames, 1);
+    fmt::print("Replayed {} frames, {} commands with {} render threads\n", stats.frames, stats.commands, threads);
+    fmt::print("Frame time: {:.3f}ms average, {:.3f}ms worst\n", stats.totalTime * 1000.0 / frames,
+               stats.worstFrame * 1000.0);
+    fmt::print("Pixels drawn: {} ({:.2f} Mpx/s)\n", stats.pixels,
+               stats.totalTime > 0.0 ? stats.pixels / stats.totalTime / 1000000.0 : 0.0);
+    fmt::print("VRAM SHA-1: {}\n", stats.vramHash);
+    return 0;
+}
@@ -62,13 +62,13 @@ void Cpu::LUI() { m_regs.set(m_instruction.rt, m_instruction.imm << 16); }
 void Cpu::LB() {
     checkPendingLoad();
     u32 addr = m_regs.get(m_instruction.rs) + m_instruction.immse;
-    pendingLoad(m_instruction.rt, SExtend<u32, u8>(m_emulator.m_mem.psxRead8(addr)));
+    pendingLoad(m_instruction.rt, SExtend<u32, u8>(m_emulator.m_mem.read<u8>(addr)));
 }
 
 void Cpu::LBU() {
     checkPendingLoad();
     u32 address = m_regs.get(m_instruction.rs) + m_instruction.immse;
-    pendingLoad(m_instruction.rt, m_emulator.m_mem.psxRead8(address));
+    pendingLoad(m_instruction.rt, m_emulator.m_mem.read<u8>(address));
 }
 
 void Cpu::LH() {
@@ -78,7 +78,7 @@ void Cpu::LH() {
         return;
     }
     checkPendingLoad();
-    pendingLoad(m_instruction.rt, SExtend<u32, u16>(m_emulator.m_mem.psxRead16(address)));
+    pendingLoad(m_instruction.rt, SExtend<u32, u16>(m_emulator.m_mem.read<u16>(address)));
 }
 
 void Cpu::LHU() {
@@ -88,7 +88,7 @@ void Cpu::LHU() {
         return;
     }
     checkPendingLoad();
-    pendingLoad(m_instruction.rt, m_emulator.m_mem.psxRead16(address));
+    pendingLoad(m_instruction.rt, m_emulator.m_mem.read<u16>(address));
 }
 
 void Cpu::LW() {
@@ -98,18 +98,14 @@ void Cpu::LW() {
         return;
     }
     checkPendingLoad();
-    pendingLoad(m_instruction.rt, m_emulator.m_mem.psxRead32(address));
-
-    // TEMP FIX FOR MISSING GPU
-    if (address == 0x1f801814) m_regs.ld_value = 0x10000000;
-    if (address == 0x1f801810) m_regs.ld_value = 0;
+    pendingLoad(m_instruction.rt, m_emulator.m_mem.read<u32>(address));
 }
 
 void Cpu::LWL() {
     u32 address = m_regs.get(m_instruction.rs) + m_instruction.immse;
 
     u32 addr_aligned = address & ~3;
-    u32 value = m_emulator.m_mem.psxRead32(addr_aligned);
+    u32 value = m_emulator.m_mem.read<u32>(addr_aligned);
 
     u32 final = value;
 
@@ -147,7 +143,7 @@ void Cpu::SB() {
 
     u32 address = m_regs.get(m_instruction.rs) + m_instruction.immse;
     u8 value = m_regs.get(m_instruction.rt);
-    m_emulator.m_mem.psxWrite8(address, value);
+    m_emulator.m_mem.write<u8>(address, value);
 }
 
 void Cpu::SH() {
@@ -163,7 +159,7 @@ void Cpu::SH() {
     }
 
     u16 value = m_regs.get(m_instruction.rt);
-    m_emulator.m_mem.psxWrite16(address, value);
+    m_emulator.m_mem.write<u16>(address, value);
 }
 
 void Cpu::SW() {
@@ -180,7 +176,7 @@ void Cpu::SW() {
     }
 
     u32 value = m_regs.get(m_instruction.rt);
-    m_emulator.m_mem.psxWrite32(address, value);
+    m_emulator.m_mem.write<u32>(address, value);
 }
 
 // ALU
@@ -566,6 +562,8 @@ void Cpu::MTC0() {
 void Cpu::MFC0() {
     checkPendingLoad();
     u32 value = m_regs.getcopr(m_instruction.rd);
+    // IP2 is wired to the interrupt controller, it clears as soon as I_STAT is acknowledged
+    if (m_instruction.rd == COP0_CAUSE) value = (value & ~(1 << 10)) | u32(m_emulator.m_irq.pending()) << 10;
     pendingLoad(m_instruction.rt, value);
 }
 
@@ -0,0 +1,44 @@
+#include "io.hpp"
+
+#include "emulator.hpp"
+
+void IO::init() {
+    for (size_t i = 0; i < m_table.size(); i++) {
+        m_table[i] = &m_handlers[(size_t)deviceLayout[i]];
+    }
+
+    attach(DEVICE::IRQ, m_emulator.m_irq);
+    attach(DEVICE::DMA, m_emulator.m_dma);
+    attach(DEVICE::TIMERS, m_emulator.m_timers);
+    attach(DEVICE::CDROM, m_emulator.m_cdrom);
+    attach(DEVICE::GPU, m_emulator.m_gpu);
+    attach(DEVICE::MDEC, m_emulator.m_mdec);
+    attach(DEVICE::SPU, m_emulator.m_spu);
+}
+
+template <MemoryAccess T>
+T IO::read(u32 offset) {
+    const Handler* handler = m_table[offset >> 2];
+    if (handler->device == nullptr) {
+        return Memory::load<T>(m_emulator.m_mem.m_hw, offset);
+    }
+    return static_cast<T>(handler->read(handler->device, offset, sizeof(T)));
+}
+
+template <MemoryAccess T>
+void IO::write(u32 offset, T value) {
+    const Handler* handler = m_table[offset >> 2];
+    if (handler->device == nullptr) {
+        Memory::store<T>(m_emulator.m_mem.m_hw, offset, value);
+        return;
+    }
+    handler->write(handler->device, offset, value, sizeof(T));
+}
+
+template u8 IO::read<u8>(u32 offset);
+template u16 IO::read<u16>(u32 offset);
+template u32 IO::read<u32>(u32 offset);
+
+template void IO::write<u8>(u32 offset, u8 value);
+template void IO::write<u16>(u32 offset, u16 value);
+template void IO::write<u32>(u32 offset, u32 value);
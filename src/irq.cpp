@@ -0,0 +1,39 @@
+#include "irq.hpp"
+
+#include "emulator.hpp"
+
+void InterruptController::reset() {
+    m_stat = 0;
+    m_mask = 0;
+}
+
+void InterruptController::serialize(Serializer& s) {
+    s(m_stat);
+    s(m_mask);
+}
+
+u32 InterruptController::read(u32 offset) {
+    switch (offset) {
+        case 0x70:
+            return m_stat;
+        case 0x74:
+            return m_mask;
+        default:
+            m_emulator.log("IRQ: Unhandled read at offset {:#x}\n", offset);
+            return 0;
+    }
+}
+
+void InterruptController::write(u32 offset, u32 value) {
+    switch (offset) {
+        case 0x70:
+            // Writing 0 to a bit acknowledges it
+            m_stat &= value & 0x7ff;
+            break;
+        case 0x74:
+            m_mask = value & 0x7ff;
+            break;
+        default:
+            m_emulator.log("IRQ: Unhandled write at offset {:#x}, value {:#x}\n", offset, value);
+    }
+}
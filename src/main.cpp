@@ -1,16 +1,37 @@
 #include "emulator.hpp"
 #include "gui.hpp"
+#include "headless.hpp"
 #include "BitField.hpp"
 #include "fmt/format.h"
 
-int main() {
+int main(int argc, char** argv) {
     fmt::print("Start of Main\n");
 
+    const auto options = Options(argc, argv);
     auto emulator = Emulator();  // Initialize emulator object
+
+    if (!options.biosPath.empty()) emulator.loadBios(options.biosPath);
+    if (!options.exePath.empty()) emulator.loadExe(options.exePath);
+    if (!options.discPath.empty()) emulator.loadDisc(options.discPath);
+    emulator.m_cdrom.m_speed = options.cdromSpeed;
+    if (!options.statePath.empty()) emulator.loadState(options.statePath);
+    emulator.m_runAhead.setFrames(options.runAheadFrames);
+    if (!options.recordPath.empty()) {
+        auto& gpu = emulator.m_gpu;
+        if (!gpu.m_recorder.start(options.recordPath, gpu.m_renderer, options.recordFrames)) {
+            Helpers::warn("Couldn't open {} for recording\n", options.recordPath);
+        }
+    }
+
+    if (options.headless) {
+        auto headless = Headless(emulator, options);  // Run without a window
+        return headless.run();
+    }
+
     auto gui = GUI(emulator);    // Initialize GUI
 
     while (gui.isOpen())  // Main loop: This is run while the window hasn't been closed
         gui.update();     // GUI update handles rendering the GUI, and also running a frame if the emulator is running
 
     ImGui::SFML::Shutdown();  // Shut down ImGui SFML if we're down
-}
\ No newline at end of file
+}
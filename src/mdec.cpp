@@ -0,0 +1,342 @@
+#include "mdec.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+#include "emulator.hpp"
+
+#define MDEC_END_CODE (0xfe00)  // Run of 63, ends a block. Also pads the stream between blocks
+
+// Position in the block of each coefficient, in the order they are sent
+static constexpr u8 zigzag[MDEC_BLOCK_SIZE] = {
+    0,  1,  8,  16, 9,  2,  3,  10, 17, 24, 32, 25, 18, 11, 4,  5,  12, 19, 26, 33, 40, 48,
+    41, 34, 27, 20, 13, 6,  7,  14, 21, 28, 35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23,
+    30, 37, 44, 51, 58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63,
+};
+
+// Output words of a macroblock, 8x8 pixels for the monochrome depths and 16x16 for colour
+static constexpr u32 macroblockWords[4] = {8, 16, 192, 128};
+
+namespace MDEC {
+
+void idctScalar(s16* block, const s32* scale) {
+    s32 temp[MDEC_BLOCK_SIZE];
+    for (u32 y = 0; y < 8; y++) {
+        for (u32 x = 0; x < 8; x++) {
+            s32 sum = 0;
+            for (u32 z = 0; z < 8; z++) sum += block[y + z * 8] * scale[x + z * 8];
+            temp[x + y * 8] = (sum + 0xfff) >> 13;
+        }
+    }
+    for (u32 y = 0; y < 8; y++) {
+        for (u32 x = 0; x < 8; x++) {
+            s32 sum = 0;
+            for (u32 z = 0; z < 8; z++) sum += temp[y + z * 8] * scale[x + z * 8];
+            block[x + y * 8] = s16((sum + 0xfff) >> 13);
+        }
+    }
+}
+
+}  // namespace MDEC
+
+static s32 signExtend10(u16 value) { return s32(Helpers::signExtend32(value & 0x3ff, 10)); }
+
+// Skips a block, returns false if the data ends first
+static bool skipBlock(const u16* input, u32 size, u32& position) {
+    while (position < size && input[position] == MDEC_END_CODE) position++;
+    if (position++ >= size) return false;
+
+    for (u32 index = 0;;) {
+        if (position >= size) return false;
+        index += (input[position++] >> 10) + 1;
+        if (index >= 63) return true;
+    }
+}
+
+// Run-length decoding and dequantization of a block that is known to be complete
+static void decodeBlock(const u16* input, u32& position, const u8* quant, s16* block) {
+    std::fill(block, block + MDEC_BLOCK_SIZE, 0);
+    while (input[position] == MDEC_END_CODE) position++;
+
+    // A quantizer scale of 0 sends raw coefficients in raster order
+    const u16 dc = input[position++];
+    const s32 scale = dc >> 10;
+    auto store = [&](u32 index, s32 value) {
+        block[scale ? zigzag[index] : index] = s16(std::clamp(value, -0x400, 0x3ff));
+    };
+
+    store(0, scale ? signExtend10(dc) * quant[0] : signExtend10(dc) * 2);
+    for (u32 index = 0;;) {
+        const u16 code = input[position++];
+        index += (code >> 10) + 1;
+        if (index > 63) break;
+
+        const s32 level = signExtend10(code);
+        store(index, scale ? (level * quant[index] * scale + 4) / 8 : level * 2);
+        if (index == 63) break;
+    }
+}
+
+Mdec::Mdec(Emulator& emulator) : m_emulator(emulator) {
+    m_idct = Helpers::avx2Supported() ? MDEC::idctAVX2 : MDEC::idctScalar;
+    m_pool.resize(std::clamp(std::thread::hardware_concurrency() / 2, 1u, u32(MDEC_MAX_THREADS)));
+    reset();
+}
+
+void Mdec::reset() {
+    abort();
+    m_dataInEnable = m_dataOutEnable = false;
+    m_lumaQuant.fill(0);
+    m_chromaQuant.fill(0);
+    m_scale.fill(0);
+}
+
+void Mdec::abort() {
+    m_command = NONE;
+    m_commandBits = 0;
+    m_remaining = 0;
+    m_depth = MDEC_DEPTH::BIT4;
+    m_signed = m_bit15 = false;
+    m_input.clear();
+    m_output.clear();
+    m_outputIndex = 0;
+}
+
+void Mdec::serialize(Serializer& s) {
+    s(m_command);
+    s(m_commandBits);
+    s(m_remaining);
+    s(m_depth);
+    s(m_signed);
+    s(m_bit15);
+    s(m_colorQuant);
+    s(m_dataInEnable);
+    s(m_dataOutEnable);
+    s(m_input);
+    s(m_output);
+    s(m_outputIndex);
+    s(m_lumaQuant);
+    s(m_chromaQuant);
+    s(m_scale);
+}
+
+u32 Mdec::read(u32 offset) {
+    switch (offset & ~3) {
+        case 0x820:
+            if (!outputReady()) return 0;
+            return m_output[m_outputIndex++];
+        case 0x824:
+            return status() >> ((offset & 3) * 8);
+        default:
+            return 0;
+    }
+}
+
+void Mdec::write(u32 offset, u32 value) {
+    switch (offset & ~3) {
+        case 0x820:
+            receive(&value, 1);
+            break;
+        case 0x824:
+            if (value & (1u << 31)) abort();
+            m_dataInEnable = (value >> 30) & 1;
+            m_dataOutEnable = (value >> 29) & 1;
+            break;
+        default:
+            break;
+    }
+}
+
+void Mdec::dmaWrite(const u32* data, u32 words) { receive(data, words); }
+
+void Mdec::dmaRead(u32* data, u32 words) {
+    const u32 available = std::min<size_t>(words, m_output.size() - m_outputIndex);
+    std::copy_n(m_output.begin() + m_outputIndex, available, data);
+    m_outputIndex += available;
+
+    if (available < words) {
+        m_emulator.log("MDEC: DMA read {} words past the decoded data\n", words - available);
+        std::fill(data + available, data + words, 0);
+    }
+}
+
+u32 Mdec::status() const {
+    u32 status = m_commandBits << 23;
+    if (!outputReady()) status |= 1u << 31;
+    if (m_remaining || outputReady()) status |= 1 << 29;
+    if (m_dataInEnable) status |= 1 << 28;  // Input is taken as fast as it comes
+    if (m_dataOutEnable && outputReady()) status |= 1 << 27;
+    status |= 4 << 16;  // Current block, decoding isn't observable halfway
+    status |= (m_remaining - 1) & 0xffff;
+    return status;
+}
+
+void Mdec::receive(const u32* data, u32 words) {
+    while (words) {
+        if (m_remaining == 0) {
+            startCommand(*data++);
+            words--;
+            continue;
+        }
+
+        const u32 count = std::min(words, m_remaining);
+        const size_t size = m_input.size();
+        m_input.resize(size + count * 2);
+        std::memcpy(&m_input[size], data, count * 4);
+        data += count;
+        words -= count;
+        m_remaining -= count;
+        if (m_remaining == 0) finishCommand();
+    }
+}
+
+void Mdec::startCommand(u32 word) {
+    m_commandBits = (word >> 25) & 0xf;
+    m_input.clear();
+
+    switch (word >> 29) {
+        case 1:
+            m_command = DECODE;
+            m_depth = static_cast<MDEC_DEPTH>((word >> 27) & 3);
+            m_signed = (word >> 26) & 1;
+            m_bit15 = (word >> 25) & 1;
+            m_remaining = word & 0xffff;
+            break;
+        case 2:
+            m_command = SET_QUANT;
+            m_colorQuant = word & 1;
+            m_remaining = m_colorQuant ? 32 : 16;
+            break;
+        case 3:
+            m_command = SET_SCALE;
+            m_remaining = 32;
+            break;
+        default:
+            m_emulator.log("MDEC: Unhandled command {:#x}\n", word);
+            m_command = NONE;
+            m_remaining = 0;
+            break;
+    }
+    if (m_remaining == 0) finishCommand();
+}
+
+void Mdec::finishCommand() {
+    switch (m_command) {
+        case DECODE:
+            decode();
+            break;
+        case SET_QUANT: {
+            const u8* bytes = reinterpret_cast<const u8*>(m_input.data());
+            std::copy_n(bytes, MDEC_BLOCK_SIZE, m_lumaQuant.begin());
+            if (m_colorQuant) std::copy_n(bytes + MDEC_BLOCK_SIZE, MDEC_BLOCK_SIZE, m_chromaQuant.begin());
+            break;
+        }
+        case SET_SCALE:
+            for (u32 i = 0; i < MDEC_BLOCK_SIZE; i++) m_scale[i] = s16(m_input[i]) / 8;
+            break;
+        default:
+            break;
+    }
+    m_command = NONE;
+}
+
+void Mdec::decode() {
+    const bool color = m_depth == MDEC_DEPTH::BIT24 || m_depth == MDEC_DEPTH::BIT15;
+    const u32 blocks = color ? 6 : 1;
+    const u16* input = m_input.data();
+    const u32 size = m_input.size();
+
+    // Macroblocks only depend on their own data. Finding where each one starts takes following the run lengths,
+    // which is cheap next to decoding them
+    std::vector<u32> starts;
+    u32 position = 0;
+    u32 end = 0;
+    while (true) {
+        bool complete = true;
+        for (u32 block = 0; block < blocks && complete; block++) complete = skipBlock(input, size, position);
+        if (!complete) break;
+        starts.push_back(end);
+        end = position;
+    }
+    if (std::any_of(input + end, input + size, [](u16 halfword) { return halfword != MDEC_END_CODE; })) {
+        m_emulator.log("MDEC: Data ends in the middle of a macroblock, dropped\n");
+    }
+
+    // Output that wasn't read yet stays in front of the new one
+    m_output.erase(m_output.begin(), m_output.begin() + m_outputIndex);
+    m_outputIndex = 0;
+    const u32 words = macroblockWords[(u32)m_depth];
+    const size_t base = m_output.size();
+    m_output.resize(base + starts.size() * words);
+    u32* output = m_output.data() + base;
+
+    auto decodeRange = [&](size_t first, size_t last) {
+        for (size_t i = first; i < last; i++) decodeMacroblock(input, starts[i], output + i * words);
+    };
+    if (starts.size() < MDEC_PARALLEL_MIN) {
+        decodeRange(0, starts.size());
+    } else {
+        m_pool.run((starts.size() + MDEC_TASK_SIZE - 1) / MDEC_TASK_SIZE, [&](size_t task) {
+            decodeRange(task * MDEC_TASK_SIZE, std::min(starts.size(), (task + 1) * MDEC_TASK_SIZE));
+        });
+    }
+
+    if (!starts.empty()) m_emulator.m_dma.requestTransfer(DMA_CHANNEL::MDEC_OUT);
+}
+
+// Colour macroblocks are Cr, Cb and 4 luma blocks, monochrome ones a single luma block
+void Mdec::decodeMacroblock(const u16* input, u32 position, u32* output) const {
+    const u8 flip = m_signed ? 0 : 0x80;
+    u8* bytes = reinterpret_cast<u8*>(output);
+
+    if (m_depth == MDEC_DEPTH::BIT4 || m_depth == MDEC_DEPTH::BIT8) {
+        alignas(32) s16 luma[MDEC_BLOCK_SIZE];
+        decodeBlock(input, position, m_lumaQuant.data(), luma);
+        m_idct(luma, m_scale.data());
+
+        for (u32 i = 0; i < MDEC_BLOCK_SIZE; i++) {
+            const s32 y = s32(Helpers::signExtend32(u32(luma[i]) & 0x1ff, 9));
+            const u8 value = u8(std::clamp(y, -128, 127)) ^ flip;
+            if (m_depth == MDEC_DEPTH::BIT8) {
+                bytes[i] = value;
+            } else if (i & 1) {
+                bytes[i / 2] |= value & 0xf0;
+            } else {
+                bytes[i / 2] = value >> 4;
+            }
+        }
+        return;
+    }
+
+    alignas(32) s16 blocks[6][MDEC_BLOCK_SIZE];
+    for (u32 block = 0; block < 6; block++) {
+        const u8* quant = block < 2 ? m_chromaQuant.data() : m_lumaQuant.data();
+        decodeBlock(input, position, quant, blocks[block]);
+        m_idct(blocks[block], m_scale.data());
+    }
+
+    const u16 bit15 = m_bit15 ? 0x8000 : 0;
+    for (u32 y = 0; y < 16; y++) {
+        for (u32 x = 0; x < 16; x++) {
+            const s32 cr = blocks[0][(y / 2) * 8 + x / 2];
+            const s32 cb = blocks[1][(y / 2) * 8 + x / 2];
+            const s32 luma = blocks[2 + (y / 8) * 2 + x / 8][(y % 8) * 8 + x % 8];
+
+            // 1.402, 0.344, 0.714 and 1.772 in 10 bit fixed point
+            const u8 r = u8(std::clamp(luma + ((1436 * cr) >> 10), -128, 127)) ^ flip;
+            const u8 g = u8(std::clamp(luma + ((-352 * cb - 731 * cr) >> 10), -128, 127)) ^ flip;
+            const u8 b = u8(std::clamp(luma + ((1815 * cb) >> 10), -128, 127)) ^ flip;
+
+            const u32 pixel = y * 16 + x;
+            if (m_depth == MDEC_DEPTH::BIT24) {
+                bytes[pixel * 3] = r;
+                bytes[pixel * 3 + 1] = g;
+                bytes[pixel * 3 + 2] = b;
+            } else {
+                const u16 color = (r >> 3) | ((g >> 3) << 5) | ((b >> 3) << 10) | bit15;
+                std::memcpy(bytes + pixel * 2, &color, sizeof(color));
+            }
+        }
+    }
+}
@@ -0,0 +1,74 @@
+#include "mdec.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#define AVX2_TARGET
+#else
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+namespace MDEC {
+
+// One IDCT pass on the transposed layout: out[x] = sum over z of scale[z][x] * rows[z], rounded like the scalar
+// path. Every row stays in a register, the coefficients are broadcast
+AVX2_TARGET static inline void pass(const __m256i* rows, __m256i* out, const s32* scale) {
+    const __m256i round = _mm256_set1_epi32(0xfff);
+    for (u32 x = 0; x < 8; x++) {
+        __m256i sum = _mm256_setzero_si256();
+        for (u32 z = 0; z < 8; z++) {
+            sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(_mm256_set1_epi32(scale[x + z * 8]), rows[z]));
+        }
+        out[x] = _mm256_srai_epi32(_mm256_add_epi32(sum, round), 13);
+    }
+}
+
+AVX2_TARGET static inline void transpose(__m256i* rows) {
+    __m256i t[8], u[8];
+    for (u32 i = 0; i < 8; i += 2) {
+        t[i] = _mm256_unpacklo_epi32(rows[i], rows[i + 1]);
+        t[i + 1] = _mm256_unpackhi_epi32(rows[i], rows[i + 1]);
+    }
+    for (u32 i = 0; i < 8; i += 4) {
+        u[i] = _mm256_unpacklo_epi64(t[i], t[i + 2]);
+        u[i + 1] = _mm256_unpackhi_epi64(t[i], t[i + 2]);
+        u[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+        u[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+    }
+    for (u32 i = 0; i < 4; i++) {
+        rows[i] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x20);
+        rows[i + 4] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x31);
+    }
+}
+
+// The scalar path computes round(round(B^T S)^T S). A pass here gives the transpose of a scalar pass, so the
+// block goes through pass, transpose, pass, transpose
+AVX2_TARGET void idctAVX2(s16* block, const s32* scale) {
+    __m256i rows[8], temp[8];
+    for (u32 z = 0; z < 8; z++) {
+        rows[z] = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block + z * 8)));
+    }
+
+    pass(rows, temp, scale);
+    transpose(temp);
+    pass(temp, rows, scale);
+    transpose(rows);
+
+    // Results fit in 16 bits since the coefficients are clamped to 11
+    for (u32 y = 0; y < 8; y += 2) {
+        const __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(rows[y], rows[y + 1]), 0xd8);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(block + y * 8), packed);
+    }
+}
+
+}  // namespace MDEC
+
+#else
+
+namespace MDEC {
+
+void idctAVX2(s16* block, const s32* scale) { idctScalar(block, scale); }
+
+}  // namespace MDEC
+
+#endif
@@ -1,360 +1,189 @@
 #include "mem.hpp"
 
+#include <algorithm>
+#include <cstring>
 #include <memory>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
 #include "emulator.hpp"
 
 void Memory::init() {
-    try {
-        m_ram = new u8[RAM_SIZE];
-        m_bios = new u8[BIOS_SIZE];
-        m_scratch = new u8[SCRATCHPAD_SIZE];
-        m_hw = new u8[HWREG_SIZE];
-        m_para = new u8[PARAPORT_SIZE];
-    } catch (...) {
+    m_arena = allocateArena();
+    if (m_arena == nullptr) {
         throw std::runtime_error("Error allocating memory for Emulator\n");
     }
-}
 
-Memory::~Memory() {
-    delete[] m_ram;
-    delete[] m_bios;
-    delete[] m_scratch;
-    delete[] m_hw;
-    delete[] m_para;
+    m_ram = m_arena + ARENA_RAM_OFFSET;
+    m_scratch = m_arena + ARENA_SCRATCHPAD_OFFSET;
+    m_hw = m_arena + ARENA_HWREG_OFFSET;
+    m_para = m_arena + ARENA_PARAPORT_OFFSET;
+    m_bios = m_arena + ARENA_BIOS_OFFSET;
 }
 
-void Memory::reset() {
-    std::fill(m_ram, m_ram + (RAM_SIZE - 1), 0);
-    std::fill(m_scratch, m_scratch + (SCRATCHPAD_SIZE - 1), 0);
-    std::fill(m_hw, m_hw + (HWREG_SIZE - 1), 0);
-    std::fill(m_para, m_para + (PARAPORT_SIZE - 1), 0);
+Memory::~Memory() { freeArena(m_arena); }
+
+// Map the arena aligned to a huge page boundary, and ask the kernel to back it with huge pages where it can
+u8* Memory::allocateArena() {
+#ifdef _WIN32
+    return static_cast<u8*>(VirtualAlloc(nullptr, ARENA_SIZE, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+#else
+    const size_t mapSize = ARENA_SIZE + ARENA_ALIGNMENT;
+    void* map = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) return nullptr;
+
+    // Trim the unaligned head and the tail of the over-sized mapping
+    auto start = reinterpret_cast<uintptr_t>(map);
+    auto aligned = (start + ARENA_ALIGNMENT - 1) & ~uintptr_t(ARENA_ALIGNMENT - 1);
+    if (aligned != start) munmap(map, aligned - start);
+    munmap(reinterpret_cast<void*>(aligned + ARENA_SIZE), mapSize - ARENA_SIZE - (aligned - start));
+
+#ifdef MADV_HUGEPAGE
+    madvise(reinterpret_cast<void*>(aligned), ARENA_SIZE, MADV_HUGEPAGE);
+#endif
+    return reinterpret_cast<u8*>(aligned);
+#endif
 }
 
-u8 Memory::psxRead8(u32 address) {
-    u32 hw_address = address & 0x1fffffff;
-
-    // Placeholder for expansion slot
-    if (EXP1.contains(address)) {
-        return 0xff;
-    }
-
-    if (CACHECONTROL.contains(address)) {
-        m_emulator.log("psxRead8 CACHECONTROL address: {:#x}, hw_address {:#x}\n", address, hw_address);
-        u8 final = m_cacheControl;
-        return final;
-    }
-
-    if (BIOS.contains(hw_address)) {
-        m_emulator.log("psxRead8 BIOS address: {:#x}, hw_address {:#x}\n", address, hw_address);
-        auto offset = BIOS.offset(hw_address);
-        return read8(m_bios, offset);
-    }
-
-    if (RAM.contains(hw_address)) {
-        m_emulator.log("psxRead8 RAM address: {:#x}, hw_address {:#x}\n", address, hw_address);
-        auto offset = RAM.offset(hw_address);
-        return read8(m_ram, offset);
-    }
-
-    if (SCRATCHPAD.contains(hw_address)) {
-        m_emulator.log("psxRead8 ScratchPad address: {:#x}, hw_address {:#x}\n", address, hw_address);
-        auto offset = SCRATCHPAD.offset(hw_address);
-        return read16(m_scratch, offset);
-    }
-
-    if (MEMCONTROL.contains(hw_address)) {
-        m_emulator.log("MEMCONTROL Read at address: {:#x}, masked {:#x}\n", address, hw_address);
-        auto offset = MEMCONTROL.offset(hw_address);
-        return read16(m_hw, offset);
-    }
-
-    if (HWREG.contains(hw_address)) {
-        m_emulator.log("psxRead8 HWREG address: {:#x}, hw_address {:#x}\n", address, hw_address);
-        auto offset = HWREG.offset(hw_address);
-        return read16(m_hw, offset);
-    }
-
-    if (PARAPORT.contains(hw_address)) {
-        m_emulator.log("psxRead8 Parallel address: {:#x}, hw_address {:#x}\n", address, hw_address);
-        auto offset = PARAPORT.offset(hw_address);
-        return read16(m_para, offset);
-    }
-
-    m_emulator.log("psxRead8: Unmatched memory region at address {:#x}, hw_address {:#x}\n", address, hw_address);
-    return 0;
+void Memory::freeArena(u8* arena) {
+    if (arena == nullptr) return;
+#ifdef _WIN32
+    VirtualFree(arena, 0, MEM_RELEASE);
+#else
+    munmap(arena, ARENA_SIZE);
+#endif
 }
 
-u16 Memory::psxRead16(u32 address) {
-    if (address % 2 != 0) {
-        m_emulator.log("Unaligned psxRead32 at address {:#x}\n", address);
-        return 0;
-    }
-    u32 hw_address = address & 0x1fffffff;
-
-    // Temporary fix
-    if (address == 0x1F801074) return 0;
-
-    if (CACHECONTROL.contains(address)) {
-        m_emulator.log("psxRead16 CACHECONTROL address: {:#x}, hw_address {:#x}\n", address, hw_address);
-        u16 final = m_cacheControl;
-        return final;
-    }
-
-    if (BIOS.contains(hw_address)) {
-        m_emulator.log("psxRead16 BIOS address: {:#x}, hw_address {:#x}\n", address, hw_address);
-        auto offset = BIOS.offset(hw_address);
-        return read16(m_bios, offset);
-    }
-
-    if (RAM.contains(hw_address)) {
-        m_emulator.log("psxRead16 RAM address: {:#x}, hw_address {:#x}\n", address, hw_address);
-        auto offset = RAM.offset(hw_address);
-        return read16(m_ram, offset);
-    }
-
-    if (SCRATCHPAD.contains(hw_address)) {
-        m_emulator.log("psxRead16 ScratchPad address: {:#x}, hw_address {:#x}\n", address, hw_address);
-        auto offset = SCRATCHPAD.offset(hw_address);
-        return read16(m_scratch, offset);
-    }
-
-    if (MEMCONTROL.contains(hw_address)) {
-        m_emulator.log("MEMCONTROL Read at address: {:#x}, masked {:#x}\n", address, hw_address);
-        auto offset = MEMCONTROL.offset(hw_address);
-        return read16(m_hw, offset);
-    }
-
-    if (HWREG.contains(hw_address)) {
-        m_emulator.log("psxRead16 HWREG address: {:#x}, hw_address {:#x}\n", address, hw_address);
-        auto offset = HWREG.offset(hw_address);
-        return read16(m_hw, offset);
-    }
-
-    if (PARAPORT.contains(hw_address)) {
-        m_emulator.log("psxRead16 Parallel address: {:#x}, hw_address {:#x}\n", address, hw_address);
-        auto offset = PARAPORT.offset(hw_address);
-        return read16(m_para, offset);
-    }
-
-    m_emulator.log("psxRead16: Unmatched memory region at address {:#x}, hw_address {:#x}\n", address, hw_address);
-    return 0;
+// Clears RAM, scratchpad, I/O and the parallel port in one go. The BIOS is kept
+void Memory::reset() {
+    std::memset(m_arena, 0, ARENA_BIOS_OFFSET);
+    markDirty(0, RAM_SIZE);
 }
 
-u32 Memory::psxRead32(u32 address) {
-    if (address % 4 != 0) {
-        m_emulator.log("Unaligned psxRead32 at address {:#x}\n", address);
-        return 0;
-    }
-
-    u32 hw_address = address & 0x1fffffff;
-
-    if (CACHECONTROL.contains(address)) {
-        m_emulator.log("psxRead32 CACHECONTROL address: {:#x}, hw_address {:#x}\n", address, hw_address);
-        u32 final = m_cacheControl;
-        return final;
-    }
-
-    if (BIOS.contains(hw_address)) {
-        m_emulator.log("psxRead32 BIOS address: {:#x}, hw_address {:#x}\n", address, hw_address);
-        auto offset = BIOS.offset(hw_address);
-        return read32(m_bios, offset);
-    }
-
-    if (RAM.contains(hw_address)) {
-        m_emulator.log("psxRead32 RAM address: {:#x}, hw_address {:#x}\n", address, hw_address);
-        auto offset = RAM.offset(hw_address);
-        return read32(m_ram, offset);
-    }
-
-    if (SCRATCHPAD.contains(hw_address)) {
-        m_emulator.log("psxRead32 ScratchPad address: {:#x}, hw_address {:#x}\n", address, hw_address);
-        auto offset = SCRATCHPAD.offset(hw_address);
-        return read32(m_scratch, offset);
-    }
-
-    if (MEMCONTROL.contains(hw_address)) {
-        m_emulator.log("MEMCONTROL Read at address: {:#x}, masked {:#x}\n", address, hw_address);
-        auto offset = MEMCONTROL.offset(hw_address);
-        return read32(m_hw, offset);
-    }
-
-    if (HWREG.contains(hw_address)) {
-        m_emulator.log("psxRead32 HWREG address: {:#x}, hw_address {:#x}\n", address, hw_address);
-        auto offset = HWREG.offset(hw_address);
-        return read32(m_hw, offset);
-    }
-
-    if (PARAPORT.contains(hw_address)) {
-        m_emulator.log("psxRead32 Parallel address: {:#x}, hw_address {:#x}\n", address, hw_address);
-        auto offset = PARAPORT.offset(hw_address);
-        return read32(m_para, offset);
-    }
-
-    m_emulator.log("psxRead32: Unmatched memory region at address {:#x}, hw_address {:#x}\n", address, hw_address);
-    return 0;
+// RAM goes page by page, so an incremental save or load can skip the pages not written since its checkpoint, and
+// the BIOS is skipped the same way. Scratchpad, the I/O page and the expansion region are one block in between
+void Memory::serialize(Serializer& s) {
+    for (u32 page = 0; page < RAM_PAGES; page++) {
+        if (s.since() && !dirtySince(page, s.since())) {
+            s.skip(RAM_PAGE_SIZE);
+            continue;
+        }
+        s.bytes(m_ram + (page << RAM_PAGE_SHIFT), RAM_PAGE_SIZE);
+        if (s.loading()) m_pageStamps[page] = m_epoch;
+    }
+    s.bytes(m_arena + ARENA_SCRATCHPAD_OFFSET, ARENA_BIOS_OFFSET - ARENA_SCRATCHPAD_OFFSET);
+    if (s.since() && m_biosStamp <= s.since()) {
+        s.skip(BIOS_SIZE);
+    } else {
+        s.bytes(m_bios, BIOS_SIZE);
+        if (s.loading()) m_biosStamp = m_epoch;
+    }
+    s(m_cacheControl);
+    s(cacheControl.r);
 }
 
-void Memory::psxWrite8(u32 address, u8 value) {
-    u32 hw_address = address & 0x1fffffff;
-
-    if (CACHECONTROL.contains(address)) {
-        m_emulator.log("psxWrite8 CACHECONTROL address: {:#x}, hw_address {:#x}, value: {:#x}\n", address, hw_address,
-                       value);
-        m_cacheControl = value;
-        return;
-    }
-
-    if (RAM.contains(hw_address)) {
-        auto offset = RAM.offset(hw_address);
-        write8(m_ram, offset, value);
-        m_emulator.log("psxWrite8 RAM address: {:#x}, offset: {:#x}, value: {:#x}\n", hw_address, offset, value);
-        return;
-    }
-
-    if (SCRATCHPAD.contains(hw_address)) {
-        auto offset = SCRATCHPAD.offset(hw_address);
-        write8(m_scratch, offset, value);
-        m_emulator.log("psxWrite8 ScratchPad address: {:#x}, offset: {:#x}, value: {:#x}\n", hw_address, offset, value);
-        return;
-    }
-
-    if (MEMCONTROL.contains(hw_address)) {
-        u32 offset = MEMCONTROL.offset(hw_address);
-        m_emulator.log("psxWrite8 MEMCONTROL address: {:#x}, offset: {:#x}, value: {:#x}\n", hw_address, offset, value);
-        write8(m_hw, offset, value);
-        return;
-    }
-
-    if (HWREG.contains(hw_address)) {
-        auto offset = HWREG.offset(hw_address);
-        write8(m_hw, offset, value);
-        m_emulator.log("psxWrite8 HWREG address: {:#x}, offset: {:#x}, value: {:#x}\n", hw_address, offset, value);
-        return;
-    }
-
-    if (PARAPORT.contains(hw_address)) {
-        auto offset = PARAPORT.offset(hw_address);
-        write8(m_para, offset, value);
-        m_emulator.log("psxWrite8 Parallel address: {:#x}, offset: {:#x}, value: {:#x}\n", hw_address, offset, value);
-        return;
-    }
-
-    m_emulator.log("psxWrite8: Unmatched memory region at address {:#x}, hw_address {:#x}, value: {:#x}\n", address,
-                   hw_address, value);
+void Memory::markDirty(u32 offset, u32 size) {
+    if (size == 0) return;
+    const u32 first = offset >> RAM_PAGE_SHIFT;
+    const u32 last = std::min<u32>((offset + size - 1) >> RAM_PAGE_SHIFT, RAM_PAGES - 1);
+    std::fill(m_pageStamps.begin() + first, m_pageStamps.begin() + last + 1, m_epoch);
 }
 
-void Memory::psxWrite16(u32 address, u16 value) {
-    if (address % 2 != 0) {
-        m_emulator.log("Unaligned psxWrite16 at address {:#x}\n", address);
-        return;
-    }
-
-    u32 hw_address = address & 0x1fffffff;
-
-    if (CACHECONTROL.contains(address)) {
-        m_emulator.log("psxWrite16 CACHECONTROL address: {:#x}, hw_address {:#x}, value: {:#x}\n", address, hw_address,
-                       value);
-        m_cacheControl = value;
-        return;
-    }
-
-    if (RAM.contains(hw_address)) {
-        auto offset = RAM.offset(hw_address);
-        write16(m_ram, offset, value);
-        m_emulator.log("psxWrite16 RAM address: {:#x}, offset: {:#x}, value: {:#x}\n", hw_address, offset, value);
-        return;
-    }
-
-    if (SCRATCHPAD.contains(hw_address)) {
-        auto offset = SCRATCHPAD.offset(hw_address);
-        write16(m_scratch, offset, value);
-        m_emulator.log("psxWrite16 ScratchPad address: {:#x}, offset: {:#x}, value: {:#x}\n", hw_address, offset,
-                       value);
-        return;
-    }
-
-    if (MEMCONTROL.contains(hw_address)) {
-        u32 offset = MEMCONTROL.offset(hw_address);
-        m_emulator.log("psxWrite16 MEMCONTROL address: {:#x}, offset: {:#x}, value: {:#x}\n", hw_address, offset,
-                       value);
-        write16(m_hw, offset, value);
-        return;
-    }
-
-    if (HWREG.contains(hw_address)) {
-        auto offset = HWREG.offset(hw_address);
-        write16(m_hw, offset, value);
-        m_emulator.log("psxWrite16 HWREG address: {:#x}, offset: {:#x}, value: {:#x}\n", hw_address, offset, value);
-        return;
-    }
-
-    if (PARAPORT.contains(hw_address)) {
-        auto offset = PARAPORT.offset(hw_address);
-        write16(m_para, offset, value);
-        m_emulator.log("psxWrite16 Parallel address: {:#x}, offset: {:#x}, value: {:#x}\n", hw_address, offset, value);
-        return;
-    }
-
-    m_emulator.log("psxWrite16: Unmatched memory region at address {:#x}, hw_address {:#x}, value: {:#x}\n", address,
-                   hw_address, value);
+void Memory::endFrame() {
+    if (m_emulator.m_runAhead.speculating()) return;
+    m_lastFrameDirtyPages = std::count_if(m_pageStamps.begin(), m_pageStamps.end(),
+                                          [&](u32 stamp) { return stamp >= m_frameEpoch; });
+    m_dirtyPagesTotal += m_lastFrameDirtyPages;
+    m_frameEpoch = ++m_epoch;
 }
 
-void Memory::psxWrite32(u32 address, u32 value) {
-    if (address % 4 != 0) {
-        m_emulator.log("Unaligned psxWrite32 at address {:#x}\n", address);
-        return;
-    }
-
-    u32 hw_address = address & 0x1fffffff;
-
-    if (CACHECONTROL.contains(address)) {
-        m_emulator.log("psxWrite32 CACHECONTROL address: {:#x}, hw_address {:#x}, value: {:#x}\n", address, hw_address,
-                       value);
-        m_cacheControl = value;
-        return;
-    }
+static const char* regionNames[] = {"Unmatched", "BIOS",     "RAM",      "ScratchPad",
+                                    "HWREG",     "EXP1",     "Parallel", "CACHECONTROL"};
 
-    if (RAM.contains(hw_address)) {
-        auto offset = RAM.offset(hw_address);
-        write32(m_ram, offset, value);
-        m_emulator.log("psxWrite32 RAM address: {:#x}, offset: {:#x}, value: {:#x}\n", hw_address, offset, value);
-        return;
+template <MemoryAccess T>
+T Memory::read(u32 address) {
+    if (address % sizeof(T) != 0) {
+        m_emulator.log("Unaligned read{} at address {:#x}\n", sizeof(T) * 8, address);
+        return 0;
     }
 
-    if (SCRATCHPAD.contains(hw_address)) {
-        auto offset = SCRATCHPAD.offset(hw_address);
-        write32(m_scratch, offset, value);
-        m_emulator.log("psxWrite32 ScratchPad address: {:#x}, offset: {:#x}, value: {:#x}\n", hw_address, offset,
-                       value);
-        return;
+    const u32 hw_address = address & 0x1fffffff;
+    const REGION region = regionOf(address);
+    m_emulator.log("read{} {} address: {:#x}, hw_address {:#x}\n", sizeof(T) * 8, regionNames[(int)region], address,
+                   hw_address);
+
+    switch (region) {
+        case REGION::RAM:
+            return load<T>(m_ram, RAM.offset(hw_address));
+        case REGION::BIOS:
+            return load<T>(m_bios, BIOS.offset(hw_address));
+        case REGION::SCRATCHPAD:
+            return load<T>(m_scratch, SCRATCHPAD.offset(hw_address));
+        case REGION::IO:
+            return m_emulator.m_io.read<T>(HWREG.offset(hw_address));
+        case REGION::EXP1:
+            // Placeholder for expansion slot
+            return static_cast<T>(~0);
+        case REGION::PARAPORT:
+            return load<T>(m_para, PARAPORT.offset(hw_address));
+        case REGION::CACHE_CONTROL:
+            return static_cast<T>(m_cacheControl);
+        case REGION::NONE:
+            break;
     }
 
-    if (MEMCONTROL.contains(hw_address)) {
-        u32 offset = MEMCONTROL.offset(hw_address);
-        m_emulator.log("psxWrite32 MEMCONTROL address: {:#x}, offset: {:#x}, value: {:#x}\n", hw_address, offset,
-                       value);
-        write32(m_hw, offset, value);
-        return;
-    }
+    return 0;
+}
 
-    if (HWREG.contains(hw_address)) {
-        auto offset = HWREG.offset(hw_address);
-        write32(m_hw, offset, value);
-        m_emulator.log("psxWrite32 HWREG address: {:#x}, offset: {:#x}, value: {:#x}\n", hw_address, offset, value);
-        return;
+template <MemoryAccess T>
+void Memory::write(u32 address, T value) {
+    if (address % sizeof(T) != 0) {
+        m_emulator.log("Unaligned write{} at address {:#x}\n", sizeof(T) * 8, address);
+        return;
+    }
+
+    const u32 hw_address = address & 0x1fffffff;
+    const REGION region = regionOf(address);
+    m_emulator.log("write{} {} address: {:#x}, hw_address {:#x}, value: {:#x}\n", sizeof(T) * 8,
+                   regionNames[(int)region], address, hw_address, value);
+
+    switch (region) {
+        case REGION::RAM: {
+            const u32 offset = RAM.offset(hw_address);
+            store<T>(m_ram, offset, value);
+            markDirty(offset);
+            break;
+        }
+        case REGION::SCRATCHPAD:
+            store<T>(m_scratch, SCRATCHPAD.offset(hw_address), value);
+            break;
+        case REGION::IO:
+            m_emulator.m_io.write<T>(HWREG.offset(hw_address), value);
+            break;
+        case REGION::EXP1:
+        case REGION::PARAPORT:
+            store<T>(m_para, PARAPORT.offset(hw_address), value);
+            break;
+        case REGION::CACHE_CONTROL:
+            m_cacheControl = value;
+            break;
+        case REGION::BIOS:
+        case REGION::NONE:
+            break;
     }
+}
 
-    if (PARAPORT.contains(hw_address)) {
-        auto offset = PARAPORT.offset(hw_address);
-        write32(m_para, offset, value);
-        m_emulator.log("psxWrite32 Parallel address: {:#x}, offset: {:#x}, value: {:#x}\n", hw_address, offset, value);
-        return;
-    }
+template u8 Memory::read<u8>(u32 address);
+template u16 Memory::read<u16>(u32 address);
+template u32 Memory::read<u32>(u32 address);
 
-    m_emulator.log("psxWrite32: Unmatched memory region at address {:#x}, hw_address {:#x}, value: {:#x}\n", address,
-                   hw_address, value);
-}
+template void Memory::write<u8>(u32 address, u8 value);
+template void Memory::write<u16>(u32 address, u16 value);
+template void Memory::write<u32>(u32 address, u32 value);
 
 u8 Memory::read8(u8* region, u32 offset) { return *(region + offset); }
 
@@ -362,8 +191,17 @@ u16 Memory::read16(u8* region, u32 offset) { return *(u16*)(region + offset); }
 
 u32 Memory::read32(u8* region, u32 offset) { return *(u32*)(region + offset); }
 
-void Memory::write8(u8* region, u32 offset, u8 value) { *(region + offset) = value; }
+void Memory::write8(u8* region, u32 offset, u8 value) {
+    *(region + offset) = value;
+    if (region == m_ram) markDirty(offset);
+}
 
-void Memory::write16(u8* region, u32 offset, u16 value) { *(u16*)(region + offset) = value; }
+void Memory::write16(u8* region, u32 offset, u16 value) {
+    *(u16*)(region + offset) = value;
+    if (region == m_ram) markDirty(offset);
+}
 
-void Memory::write32(u8* region, u32 offset, u32 value) { *(u32*)(region + offset) = value; }
\ No newline at end of file
+void Memory::write32(u8* region, u32 offset, u32 value) {
+    *(u32*)(region + offset) = value;
+    if (region == m_ram) markDirty(offset);
+}
\ No newline at end of file
@@ -0,0 +1,200 @@
+#include "rasterizer.hpp"
+
+#include <algorithm>
+#include <vector>
+
+#include "rasterizer_span.hpp"
+
+namespace Rasterizer {
+
+// Only degenerate slivers have steeper gradients. Keeps base + dx * 1023 + dy * 511 within 32 bits
+static constexpr s64 MAX_GRADIENT = 1 << 20;
+
+static BACKEND s_backend = Helpers::avx2Supported() ? BACKEND::AVX2 : BACKEND::SCALAR;
+static SpanShader s_shadeSpan = Helpers::avx2Supported() ? shadeSpanAVX2 : shadeSpanScalar;
+
+bool supported(BACKEND backend) { return backend == BACKEND::SCALAR || Helpers::avx2Supported(); }
+
+BACKEND backend() { return s_backend; }
+
+void setBackend(BACKEND backend) {
+    if (!supported(backend)) return;
+    s_backend = backend;
+    s_shadeSpan = backend == BACKEND::AVX2 ? shadeSpanAVX2 : shadeSpanScalar;
+}
+
+void shadeSpanScalar(u16* vram, const DrawState& state, const Primitive& prim, const Gradients& grad, s32 y, s32 left,
+                     s32 right) {
+    for (s32 x = left; x <= right; x++) shadeSpanPixel(vram, state, prim, grad, x, y);
+}
+
+static inline s64 floorDiv(s64 a, s64 b) { return a / b - ((a % b != 0) && ((a < 0) != (b < 0))); }
+static inline s64 ceilDiv(s64 a, s64 b) { return -floorDiv(-a, b); }
+
+// Edge function a*x + b*y + c, positive inside. Pixels exactly on an edge only belong to top and left edges
+struct Edge {
+    s64 a, b, c;
+
+    Edge(const Vertex& from, const Vertex& to) {
+        a = from.y - to.y;
+        b = to.x - from.x;
+        c = (s64)(to.y - from.y) * from.x - (s64)(to.x - from.x) * from.y;
+        const bool topLeft = (to.y == from.y && to.x > from.x) || to.y < from.y;
+        if (!topLeft) c -= 1;
+    }
+
+    // Narrow [left, right] to the pixels of row y on the inner side of the edge
+    inline void clipSpan(s32 y, s32& left, s32& right) const {
+        const s64 k = b * y + c;
+        if (a > 0) {
+            left = std::max<s64>(left, ceilDiv(-k, a));
+        } else if (a < 0) {
+            right = std::min<s64>(right, floorDiv(k, -a));
+        } else if (k < 0) {
+            right = left - 1;
+        }
+    }
+};
+
+u32 triangle(u16* vram, const DrawState& state, const Primitive& prim, const Vertex* vertices, const ClipRect& clip) {
+    const Vertex* v0 = &vertices[0];
+    const Vertex* v1 = &vertices[1];
+    const Vertex* v2 = &vertices[2];
+
+    s64 area = (s64)(v1->x - v0->x) * (v2->y - v0->y) - (s64)(v1->y - v0->y) * (v2->x - v0->x);
+    if (area == 0) return 0;
+    if (area < 0) {
+        std::swap(v1, v2);
+        area = -area;
+    }
+
+    const s32 minX = std::min({v0->x, v1->x, v2->x});
+    const s32 maxX = std::max({v0->x, v1->x, v2->x});
+    const s32 minY = std::min({v0->y, v1->y, v2->y});
+    const s32 maxY = std::max({v0->y, v1->y, v2->y});
+    if (maxX - minX >= VRAM_WIDTH || maxY - minY >= VRAM_HEIGHT) return 0;  // The GPU skips oversized polygons
+
+    const s32 top = std::max(minY, clip.top);
+    const s32 bottom = std::min(maxY, clip.bottom);
+    const s32 left = std::max(minX, clip.left);
+    const s32 right = std::min(maxX, clip.right);
+    if (top > bottom || left > right) return 0;
+
+    Gradients grad;
+    grad.originX = v0->x;
+    grad.originY = v0->y;
+    const s32 values[3][ATTRIBUTE_COUNT] = {
+        {v0->r, v0->g, v0->b, v0->u, v0->v},
+        {v1->r, v1->g, v1->b, v1->u, v1->v},
+        {v2->r, v2->g, v2->b, v2->u, v2->v},
+    };
+    for (int i = 0; i < ATTRIBUTE_COUNT; i++) {
+        const s64 d1 = values[1][i] - values[0][i];
+        const s64 d2 = values[2][i] - values[0][i];
+        const s64 dx = floorDiv((d1 * (v2->y - v0->y) - d2 * (v1->y - v0->y)) << FRACTION_BITS, area);
+        const s64 dy = floorDiv((d2 * (v1->x - v0->x) - d1 * (v2->x - v0->x)) << FRACTION_BITS, area);
+        grad.base[i] = (values[0][i] << FRACTION_BITS) + (1 << (FRACTION_BITS - 1));
+        grad.dx[i] = std::clamp(dx, -MAX_GRADIENT, MAX_GRADIENT);
+        grad.dy[i] = std::clamp(dy, -MAX_GRADIENT, MAX_GRADIENT);
+    }
+
+    const Edge edges[3] = {Edge(*v0, *v1), Edge(*v1, *v2), Edge(*v2, *v0)};
+    u32 pixels = 0;
+    for (s32 y = top; y <= bottom; y++) {
+        s32 spanLeft = left;
+        s32 spanRight = right;
+        for (const auto& edge : edges) edge.clipSpan(y, spanLeft, spanRight);
+        if (spanLeft <= spanRight) {
+            s_shadeSpan(vram, state, prim, grad, y, spanLeft, spanRight);
+            pixels += spanRight - spanLeft + 1;
+        }
+    }
+    return pixels;
+}
+
+u32 rectangle(u16* vram, const DrawState& state, const Primitive& prim, const Vertex& origin, s32 width, s32 height,
+              const ClipRect& clip) {
+    const s32 top = std::max(origin.y, clip.top);
+    const s32 bottom = std::min(origin.y + height - 1, clip.bottom);
+    const s32 left = std::max(origin.x, clip.left);
+    const s32 right = std::min(origin.x + width - 1, clip.right);
+
+    if (top > bottom || left > right) return 0;
+
+    // Texture coordinates step by one texel per pixel and wrap around
+    Gradients grad{};
+    grad.originX = origin.x;
+    grad.originY = origin.y;
+    grad.base[R] = origin.r << FRACTION_BITS;
+    grad.base[G] = origin.g << FRACTION_BITS;
+    grad.base[B] = origin.b << FRACTION_BITS;
+    grad.base[U] = origin.u << FRACTION_BITS;
+    grad.base[V] = origin.v << FRACTION_BITS;
+    grad.dx[U] = state.flipX ? -(1 << FRACTION_BITS) : (1 << FRACTION_BITS);
+    grad.dy[V] = state.flipY ? -(1 << FRACTION_BITS) : (1 << FRACTION_BITS);
+
+    for (s32 y = top; y <= bottom; y++) s_shadeSpan(vram, state, prim, grad, y, left, right);
+    return (bottom - top + 1) * (right - left + 1);
+}
+
+u32 line(u16* vram, const DrawState& state, const Primitive& prim, const Vertex& a, const Vertex& b,
+         const ClipRect& clip) {
+    const s32 dx = b.x - a.x;
+    const s32 dy = b.y - a.y;
+    if (std::abs(dx) >= VRAM_WIDTH || std::abs(dy) >= VRAM_HEIGHT) return 0;
+
+    const s32 steps = std::max(std::abs(dx), std::abs(dy));
+    if (steps == 0) {
+        if (a.x >= clip.left && a.x <= clip.right && a.y >= clip.top && a.y <= clip.bottom) {
+            shadePixel(vram, state, prim, a.x, a.y, a.r, a.g, a.b, 0, 0);
+            return 1;
+        }
+        return 0;
+    }
+
+    // Position and color of each step are computed from the start point, not accumulated
+    auto lerp = [steps](s32 from, s32 delta, s32 i) -> s32 {
+        return from + (s32)floorDiv((s64)delta * i * 2 + steps, (s64)steps * 2);
+    };
+
+    u32 pixels = 0;
+    for (s32 i = 0; i <= steps; i++) {
+        const s32 x = lerp(a.x, dx, i);
+        const s32 y = lerp(a.y, dy, i);
+        if (x < clip.left || x > clip.right || y < clip.top || y > clip.bottom) continue;
+
+        const s32 r = lerp(a.r, b.r - a.r, i);
+        const s32 g = lerp(a.g, b.g - a.g, i);
+        const s32 bl = lerp(a.b, b.b - a.b, i);
+        shadePixel(vram, state, prim, x, y, r, g, bl, 0, 0);
+        pixels++;
+    }
+    return pixels;
+}
+
+void fill(u16* vram, u32 x, u32 y, u32 width, u32 height, u16 color) {
+    // Rows only wrap when the rectangle crosses the right edge of VRAM
+    const u32 first = std::min(width, VRAM_WIDTH - x);
+    for (u32 row = 0; row < height; row++) {
+        u16* line = pixelAt(vram, 0, y + row);
+        std::fill_n(line + x, first, color);
+        std::fill_n(line, width - first, color);
+    }
+}
+
+void copy(u16* vram, const DrawState& state, u32 srcX, u32 srcY, u32 dstX, u32 dstY, u32 width, u32 height) {
+    const u16 maskBit = state.setMask ? 0x8000 : 0;
+    std::vector<u16> row(width);
+
+    for (u32 y = 0; y < height; y++) {
+        // Read the whole row first in case the source and destination overlap
+        for (u32 x = 0; x < width; x++) row[x] = *pixelAt(vram, srcX + x, srcY + y);
+        for (u32 x = 0; x < width; x++) {
+            u16& dst = *pixelAt(vram, dstX + x, dstY + y);
+            if (state.checkMask && (dst & 0x8000)) continue;
+            dst = row[x] | maskBit;
+        }
+    }
+}
+
+}  // namespace Rasterizer
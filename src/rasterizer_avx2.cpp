@@ -0,0 +1,177 @@
+#include "rasterizer_span.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#define AVX2_TARGET
+#else
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+namespace Rasterizer {
+
+AVX2_TARGET static inline __m256i clampColor(__m256i value) {
+    return _mm256_min_epi32(_mm256_max_epi32(value, _mm256_setzero_si256()), _mm256_set1_epi32(255));
+}
+
+AVX2_TARGET static inline __m256i gather16(const u16* vram, __m256i index) {
+    const __m256i words = _mm256_i32gather_epi32(reinterpret_cast<const int*>(vram), index, 2);
+    return _mm256_and_si256(words, _mm256_set1_epi32(0xffff));
+}
+
+AVX2_TARGET static inline __m256i fetchTexels(const u16* vram, const Primitive& prim, __m256i u, __m256i v) {
+    if (prim.texture) return gather16(prim.texture, _mm256_add_epi32(_mm256_slli_epi32(v, 8), u));
+
+    const __m256i widthMask = _mm256_set1_epi32(VRAM_WIDTH - 1);
+    const __m256i heightMask = _mm256_set1_epi32(VRAM_HEIGHT - 1);
+    const __m256i y = _mm256_and_si256(_mm256_add_epi32(v, _mm256_set1_epi32(prim.texBaseY)), heightMask);
+    const __m256i row = _mm256_slli_epi32(y, 10);
+    const __m256i baseX = _mm256_set1_epi32(prim.texBaseX);
+
+    if (prim.texDepth >= 2) {
+        return gather16(vram, _mm256_add_epi32(row, _mm256_and_si256(_mm256_add_epi32(u, baseX), widthMask)));
+    }
+
+    // 4bpp packs 4 CLUT indices per halfword, 8bpp packs 2
+    const bool is4bpp = prim.texDepth == 0;
+    const __m256i column = is4bpp ? _mm256_srli_epi32(u, 2) : _mm256_srli_epi32(u, 1);
+    const __m256i shift = is4bpp ? _mm256_slli_epi32(_mm256_and_si256(u, _mm256_set1_epi32(3)), 2)
+                                 : _mm256_slli_epi32(_mm256_and_si256(u, _mm256_set1_epi32(1)), 3);
+    const __m256i indexMask = _mm256_set1_epi32(is4bpp ? 0xf : 0xff);
+
+    const __m256i x = _mm256_and_si256(_mm256_add_epi32(column, baseX), widthMask);
+    const __m256i words = gather16(vram, _mm256_add_epi32(row, x));
+    const __m256i index = _mm256_and_si256(_mm256_srlv_epi32(words, shift), indexMask);
+    const __m256i clut = _mm256_add_epi32(
+        _mm256_set1_epi32(prim.clutY * VRAM_WIDTH),
+        _mm256_and_si256(_mm256_add_epi32(index, _mm256_set1_epi32(prim.clutX)), widthMask));
+    return gather16(vram, clut);
+}
+
+AVX2_TARGET static inline __m256i blendChannel(__m256i back, __m256i front, u32 mode) {
+    const __m256i max = _mm256_set1_epi32(31);
+    switch (mode) {
+        case 0: return _mm256_srli_epi32(_mm256_add_epi32(back, front), 1);
+        case 1: return _mm256_min_epi32(_mm256_add_epi32(back, front), max);
+        case 2: return _mm256_max_epi32(_mm256_sub_epi32(back, front), _mm256_setzero_si256());
+        default: return _mm256_min_epi32(_mm256_add_epi32(back, _mm256_srli_epi32(front, 2)), max);
+    }
+}
+
+AVX2_TARGET static inline __m256i blendColors(__m256i back, __m256i front, u32 mode) {
+    const __m256i mask = _mm256_set1_epi32(0x1f);
+    __m256i result = _mm256_setzero_si256();
+    for (int shift = 0; shift < 15; shift += 5) {
+        const __m256i b = _mm256_and_si256(_mm256_srli_epi32(back, shift), mask);
+        const __m256i f = _mm256_and_si256(_mm256_srli_epi32(front, shift), mask);
+        result = _mm256_or_si256(result, _mm256_slli_epi32(blendChannel(b, f, mode), shift));
+    }
+    return result;
+}
+
+AVX2_TARGET static inline __m256i modulate(__m256i texel, __m256i color) {
+    return _mm256_min_epi32(_mm256_srli_epi32(_mm256_mullo_epi32(texel, color), 7), _mm256_set1_epi32(255));
+}
+
+// 8 pixels per iteration with the same per pixel math as shadePixel. The tail goes through the scalar path, so
+// nothing outside [left, right] is ever written
+AVX2_TARGET void shadeSpanAVX2(u16* vram, const DrawState& state, const Primitive& prim, const Gradients& grad, s32 y,
+                               s32 left, s32 right) {
+    u16* row = vram + y * VRAM_WIDTH;
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i ones = _mm256_set1_epi32(-1);
+    const __m256i channel = _mm256_set1_epi32(0x1f);
+    const __m256i bit15 = _mm256_set1_epi32(0x8000);
+
+    __m256i attributes[ATTRIBUTE_COUNT];
+    __m256i steps[ATTRIBUTE_COUNT];
+    for (int i = 0; i < ATTRIBUTE_COUNT; i++) {
+        attributes[i] = _mm256_add_epi32(_mm256_set1_epi32(grad.at(i, left, y)),
+                                         _mm256_mullo_epi32(lanes, _mm256_set1_epi32(grad.dx[i])));
+        steps[i] = _mm256_set1_epi32(grad.dx[i] * 8);
+    }
+
+    const auto& dither = ditherTable[y & 3];
+    const __m256i ditherRow = _mm256_setr_epi32(dither[0], dither[1], dither[2], dither[3], dither[0], dither[1],
+                                                dither[2], dither[3]);
+    const __m256i windowMaskU = _mm256_set1_epi32(~(state.windowMaskX * 8));
+    const __m256i windowMaskV = _mm256_set1_epi32(~(state.windowMaskY * 8));
+    const __m256i windowOffsetU = _mm256_set1_epi32((state.windowOffsetX & state.windowMaskX) * 8);
+    const __m256i windowOffsetV = _mm256_set1_epi32((state.windowOffsetY & state.windowMaskY) * 8);
+    const __m256i setMask = _mm256_set1_epi32(state.setMask ? 0x8000 : 0);
+    const __m256i semiTransparent = prim.semiTransparent ? ones : zero;
+
+    s32 x = left;
+    for (; x + 7 <= right; x += 8) {
+        const __m256i dst = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row + x)));
+        __m256i write = state.checkMask ? _mm256_cmpeq_epi32(_mm256_and_si256(dst, bit15), zero) : ones;
+        __m256i semi = semiTransparent;
+        __m256i maskBit = setMask;
+
+        __m256i r = clampColor(_mm256_srai_epi32(attributes[R], FRACTION_BITS));
+        __m256i g = clampColor(_mm256_srai_epi32(attributes[G], FRACTION_BITS));
+        __m256i b = clampColor(_mm256_srai_epi32(attributes[B], FRACTION_BITS));
+
+        if (prim.textured) {
+            __m256i u = _mm256_and_si256(_mm256_srai_epi32(attributes[U], FRACTION_BITS), _mm256_set1_epi32(0xff));
+            __m256i v = _mm256_and_si256(_mm256_srai_epi32(attributes[V], FRACTION_BITS), _mm256_set1_epi32(0xff));
+            u = _mm256_or_si256(_mm256_and_si256(u, windowMaskU), windowOffsetU);
+            v = _mm256_or_si256(_mm256_and_si256(v, windowMaskV), windowOffsetV);
+
+            const __m256i texel = fetchTexels(vram, prim, u, v);
+            write = _mm256_andnot_si256(_mm256_cmpeq_epi32(texel, zero), write);
+            semi = _mm256_and_si256(semi, _mm256_srai_epi32(_mm256_slli_epi32(texel, 16), 31));
+            maskBit = _mm256_or_si256(maskBit, _mm256_and_si256(texel, bit15));
+
+            const __m256i tr = _mm256_slli_epi32(_mm256_and_si256(texel, channel), 3);
+            const __m256i tg = _mm256_slli_epi32(_mm256_and_si256(_mm256_srli_epi32(texel, 5), channel), 3);
+            const __m256i tb = _mm256_slli_epi32(_mm256_and_si256(_mm256_srli_epi32(texel, 10), channel), 3);
+            if (prim.rawTexture) {
+                r = tr, g = tg, b = tb;
+            } else {
+                r = modulate(tr, r);
+                g = modulate(tg, g);
+                b = modulate(tb, b);
+            }
+        }
+
+        if (prim.dither) {
+            const __m256i xs = _mm256_add_epi32(_mm256_set1_epi32(x), lanes);
+            const __m256i offset = _mm256_permutevar8x32_epi32(ditherRow, _mm256_and_si256(xs, _mm256_set1_epi32(3)));
+            r = clampColor(_mm256_add_epi32(r, offset));
+            g = clampColor(_mm256_add_epi32(g, offset));
+            b = clampColor(_mm256_add_epi32(b, offset));
+        }
+
+        __m256i color = _mm256_or_si256(_mm256_srli_epi32(r, 3),
+                                        _mm256_or_si256(_mm256_slli_epi32(_mm256_srli_epi32(g, 3), 5),
+                                                        _mm256_slli_epi32(_mm256_srli_epi32(b, 3), 10)));
+        if (prim.semiTransparent) color = _mm256_blendv_epi8(color, blendColors(dst, color, prim.semiMode), semi);
+        color = _mm256_or_si256(color, maskBit);
+
+        // Pack back to 16 bits, packus works within 128-bit lanes
+        const __m256i result = _mm256_blendv_epi8(dst, color, write);
+        const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(result, result), 0b1000);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(row + x), _mm256_castsi256_si128(packed));
+
+        for (int i = 0; i < ATTRIBUTE_COUNT; i++) attributes[i] = _mm256_add_epi32(attributes[i], steps[i]);
+    }
+
+    for (; x <= right; x++) shadeSpanPixel(vram, state, prim, grad, x, y);
+}
+
+}  // namespace Rasterizer
+
+#else
+
+namespace Rasterizer {
+
+void shadeSpanAVX2(u16* vram, const DrawState& state, const Primitive& prim, const Gradients& grad, s32 y, s32 left,
+                   s32 right) {
+    shadeSpanScalar(vram, state, prim, grad, y, left, right);
+}
+
+}  // namespace Rasterizer
+
+#endif
@@ -0,0 +1,125 @@
+#include "recorder.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+#include "sha1.hpp"
+
+#define SNAPSHOT_CHUNK_SIZE (4096)  // In words, has to fit in the render queue
+
+static u32 texpageWord(const DrawState& state) {
+    return (state.texBaseX / 64) | (state.texBaseY / 256) << 4 | state.semiMode << 5 | state.texDepth << 7 |
+           state.dither << 9 | state.drawToDisplay << 10 | state.texDisable << 11 | state.flipX << 12 |
+           state.flipY << 13;
+}
+
+bool Recorder::start(const std::string& path, Renderer& renderer, u32 frames) {
+    stop();
+    m_file.open(path, std::ios::binary | std::ios::trunc);
+    if (!m_file.is_open()) return false;
+
+    const u32 header[2] = {RECORDING_MAGIC, RECORDING_VERSION};
+    m_file.write(reinterpret_cast<const char*>(header), sizeof(header));
+    m_framesLeft = frames;
+
+    // Snapshot VRAM as a full size CPU to VRAM transfer, then the drawing environment as GP0 E1-E6
+    renderer.sync();
+    const u32 transfer[3] = {0xa0000000, 0, (VRAM_HEIGHT << 16) | VRAM_WIDTH};
+    command(RENDER_COMMAND::RESET, nullptr, 0);
+    command(RENDER_COMMAND::GP0, transfer, 3);
+
+    const u32* vram = reinterpret_cast<const u32*>(renderer.vram());
+    for (u32 i = 0; i < VRAM_WIDTH * VRAM_HEIGHT / 2; i += SNAPSHOT_CHUNK_SIZE) {
+        command(RENDER_COMMAND::VRAM_WRITE, vram + i, SNAPSHOT_CHUNK_SIZE);
+    }
+
+    const auto& state = renderer.state();
+    const u32 environment[6] = {
+        0xe1000000 | texpageWord(state),
+        0xe2000000 | state.windowMaskX | state.windowMaskY << 5 | state.windowOffsetX << 10 |
+            state.windowOffsetY << 15,
+        0xe3000000 | state.area.left | state.area.top << 10,
+        0xe4000000 | state.area.right | state.area.bottom << 10,
+        0xe5000000 | (state.offsetX & 0x7ff) | (state.offsetY & 0x7ff) << 11,
+        0xe6000000 | state.setMask | state.checkMask << 1,
+    };
+    for (const u32 word : environment) command(RENDER_COMMAND::GP0, &word, 1);
+
+    return true;
+}
+
+void Recorder::stop() {
+    if (m_file.is_open()) m_file.close();
+}
+
+void Recorder::vblank() {
+    write(RECORD::VBLANK, nullptr, 0);
+    if (m_framesLeft != 0 && --m_framesLeft == 0) stop();
+}
+
+void Recorder::write(RECORD type, const u32* words, u32 count) {
+    const u32 header = (static_cast<u32>(type) << 24) | count;
+    m_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    m_file.write(reinterpret_cast<const char*>(words), count * sizeof(u32));
+}
+
+// Frames are timed between VBlank records, the snapshot and the partial frame before the first VBlank are not
+bool replay(const std::string& path, u32 threads, ReplayStats& stats) {
+    using Clock = std::chrono::steady_clock;
+
+    auto file = Helpers::mapROM(path);
+    if (!file.is_mapped() || file.size() < 8) return false;
+
+    const u32* words = reinterpret_cast<const u32*>(file.data());
+    const size_t count = file.size() / sizeof(u32);
+    if (words[0] != RECORDING_MAGIC || words[1] != RECORDING_VERSION) return false;
+
+    auto renderer = std::make_unique<Renderer>(false);
+    renderer->setThreads(threads);
+
+    auto frameStart = Clock::now();
+    u64 firstPixels = 0;
+    u64 lastPixels = 0;
+    bool timing = false;
+
+    for (size_t i = 2; i < count;) {
+        const u32 header = words[i];
+        const auto type = static_cast<RECORD>(header >> 24);
+        const u32 length = header & 0xffffff;
+        if (i + 1 + length > count) break;  // Truncated recording
+        const u32* data = words + i + 1;
+        i += length + 1;
+
+        switch (type) {
+            case RECORD::GP0:
+            case RECORD::VRAM_WRITE:
+            case RECORD::RESET:
+                renderer->push(static_cast<RENDER_COMMAND>(type), data, length);
+                stats.commands++;
+                break;
+            case RECORD::VBLANK: {
+                renderer->sync();
+                const auto now = Clock::now();
+                if (timing) {
+                    const double elapsed = std::chrono::duration<double>(now - frameStart).count();
+                    stats.frames++;
+                    stats.totalTime += elapsed;
+                    stats.worstFrame = std::max(stats.worstFrame, elapsed);
+                    lastPixels = renderer->pixelsDrawn();
+                } else {
+                    firstPixels = lastPixels = renderer->pixelsDrawn();
+                    timing = true;
+                }
+                frameStart = now;
+                break;
+            }
+            default: break;
+        }
+    }
+
+    renderer->sync();
+    stats.pixels = lastPixels - firstPixels;
+    stats.vramHash = SHA1::from_buffer(reinterpret_cast<const u8*>(renderer->vram()), VRAM_WIDTH * VRAM_HEIGHT * 2);
+    return true;
+}
@@ -0,0 +1,322 @@
+#include "renderer.hpp"
+
+#include <algorithm>
+
+#include "savestate.hpp"
+
+Renderer::Renderer(bool threaded) : m_threaded(threaded), m_vram(VRAM_ALLOCATION_SIZE, 0) {
+    m_packet.reserve(256);
+    m_binner.setThreads(std::max(2u, std::thread::hardware_concurrency()) - 1);  // Leave a core for the CPU
+    if (m_threaded) m_thread = std::thread(&Renderer::threadMain, this);
+}
+
+Renderer::~Renderer() {
+    if (m_threaded) {
+        push(RENDER_COMMAND::QUIT, nullptr, 0);
+        m_thread.join();
+    }
+}
+
+void Renderer::push(RENDER_COMMAND command, const u32* words, u32 count) {
+    const u32 header = (static_cast<u32>(command) << 24) | count;
+
+    m_queue.waitForSpace(count + 1);
+    m_queue.write(&header, 1);
+    m_queue.write(words, count);
+    m_queue.publish();
+
+    if (!m_threaded) runQueued();
+}
+
+void Renderer::sync() {
+    if (m_threaded) {
+        m_queue.waitEmpty();
+    } else {
+        m_binner.flush();
+    }
+}
+
+void Renderer::serialize(Serializer& s) {
+    sync();
+    s.bytes(m_vram.data(), VRAM_WIDTH * VRAM_HEIGHT * sizeof(u16));
+    s(m_state);
+    s(m_transfer);
+    // Texture pages decoded from the old VRAM are stale now
+    if (s.loading()) m_binner.invalidate(0, 0, VRAM_WIDTH - 1, VRAM_HEIGHT - 1);
+}
+
+void Renderer::threadMain() {
+    while (true) {
+        m_queue.waitForData();
+        if (!runQueued()) return;
+    }
+}
+
+// Execute everything in the queue. Commands are popped after running, so an empty queue means the renderer is idle
+bool Renderer::runQueued() {
+    while (m_queue.available()) {
+        const u32 header = m_queue.peek(0);
+        const auto command = static_cast<RENDER_COMMAND>(header >> 24);
+        const u32 count = header & 0xffffff;
+
+        m_packet.resize(count);
+        m_queue.read(1, m_packet.data(), count);
+        execute(command, m_packet.data(), count);
+        // Draw the batch before the queue runs dry, sync() relies on an empty queue meaning VRAM is up to date
+        if (m_threaded && m_queue.available() == count + 1) m_binner.flush();
+        m_queue.pop(count + 1);
+
+        if (command == RENDER_COMMAND::QUIT) return false;
+    }
+    return true;
+}
+
+void Renderer::execute(RENDER_COMMAND command, const u32* words, u32 count) {
+    switch (command) {
+        case RENDER_COMMAND::GP0: gp0(words, count); break;
+        case RENDER_COMMAND::VRAM_WRITE: vramWrite(words, count); break;
+        case RENDER_COMMAND::RESET:
+            m_binner.flush();
+            m_state = DrawState();
+            m_transfer = {};
+            break;
+        default: break;
+    }
+}
+
+static inline u32 transferWidth(u32 size) { return ((size - 1) & 0x3ff) + 1; }
+static inline u32 transferHeight(u32 size) { return (((size >> 16) - 1) & 0x1ff) + 1; }
+
+void Renderer::gp0(const u32* words, u32 count) {
+    const u32 command = words[0] >> 24;
+
+    switch (command >> 5) {
+        case 0:
+            if (command == 0x02) {  // Fill rectangle, ignores the drawing area and mask settings
+                const u32 color = words[0];
+                const u16 pixel =
+                    ((color >> 3) & 0x1f) | (((color >> 11) & 0x1f) << 5) | (((color >> 19) & 0x1f) << 10);
+                const u32 x = words[1] & 0x3f0;
+                const u32 y = (words[1] >> 16) & 0x1ff;
+                const u32 width = ((words[2] & 0x3ff) + 0xf) & ~0xf;
+                const u32 height = (words[2] >> 16) & 0x1ff;
+                m_binner.flush();
+                m_binner.invalidate(x, y, x + width - 1, y + height - 1);
+                Rasterizer::fill(m_vram.data(), x, y, width, height, pixel);
+            }
+            break;
+        case 1: polygon(words); break;
+        case 2: line(words, count); break;
+        case 3: rectangle(words); break;
+        case 4: {  // VRAM to VRAM copy
+            const u32 x = words[2] & 0x3ff;
+            const u32 y = (words[2] >> 16) & 0x1ff;
+            const u32 width = transferWidth(words[3]);
+            const u32 height = transferHeight(words[3]);
+            m_binner.flush();
+            m_binner.invalidate(x, y, x + width - 1, y + height - 1);
+            Rasterizer::copy(m_vram.data(), m_state, words[1] & 0x3ff, (words[1] >> 16) & 0x1ff, x, y, width, height);
+            break;
+        }
+        case 5:  // CPU to VRAM, the data follows as VRAM_WRITE commands
+            m_binner.flush();
+            m_transfer.x = words[1] & 0x3ff;
+            m_transfer.y = (words[1] >> 16) & 0x1ff;
+            m_transfer.width = transferWidth(words[2]);
+            m_transfer.height = transferHeight(words[2]);
+            m_transfer.position = 0;
+            m_binner.invalidate(m_transfer.x, m_transfer.y, m_transfer.x + m_transfer.width - 1,
+                                m_transfer.y + m_transfer.height - 1);
+            break;
+        case 6: break;  // VRAM to CPU is served by the GPU after a sync
+        case 7: {
+            const u32 value = words[0];
+            switch (command) {
+                case 0xe1: setTexpage(value); break;
+                case 0xe2:
+                    m_state.windowMaskX = value & 0x1f;
+                    m_state.windowMaskY = (value >> 5) & 0x1f;
+                    m_state.windowOffsetX = (value >> 10) & 0x1f;
+                    m_state.windowOffsetY = (value >> 15) & 0x1f;
+                    break;
+                case 0xe3:
+                    m_state.area.left = value & 0x3ff;
+                    m_state.area.top = (value >> 10) & 0x1ff;
+                    break;
+                case 0xe4:
+                    m_state.area.right = value & 0x3ff;
+                    m_state.area.bottom = (value >> 10) & 0x1ff;
+                    break;
+                case 0xe5:
+                    m_state.offsetX = Helpers::signExtend32(value & 0x7ff, 11);
+                    m_state.offsetY = Helpers::signExtend32((value >> 11) & 0x7ff, 11);
+                    break;
+                case 0xe6:
+                    m_state.setMask = value & 1;
+                    m_state.checkMask = value & 2;
+                    break;
+                default: break;
+            }
+            break;
+        }
+    }
+}
+
+void Renderer::setTexpage(u32 value) {
+    m_state.texBaseX = (value & 0xf) * 64;
+    m_state.texBaseY = ((value >> 4) & 1) * 256;
+    m_state.semiMode = (value >> 5) & 3;
+    m_state.texDepth = (value >> 7) & 3;
+    m_state.dither = (value >> 9) & 1;
+    m_state.drawToDisplay = (value >> 10) & 1;
+    m_state.texDisable = (value >> 11) & 1;
+    m_state.flipX = (value >> 12) & 1;
+    m_state.flipY = (value >> 13) & 1;
+}
+
+static inline void decodePosition(Vertex& vertex, u32 word, const DrawState& state) {
+    vertex.x = Helpers::signExtend32(word & 0x7ff, 11) + state.offsetX;
+    vertex.y = Helpers::signExtend32((word >> 16) & 0x7ff, 11) + state.offsetY;
+}
+
+static inline void decodeColor(Vertex& vertex, u32 word) {
+    vertex.r = word & 0xff;
+    vertex.g = (word >> 8) & 0xff;
+    vertex.b = (word >> 16) & 0xff;
+}
+
+static inline void decodeClut(Primitive& prim, u32 uv) {
+    prim.clutX = ((uv >> 16) & 0x3f) * 16;
+    prim.clutY = (uv >> 22) & 0x1ff;
+}
+
+void Renderer::polygon(const u32* words) {
+    const u32 command = words[0] >> 24;
+    const int vertexCount = (command & 0x8) ? 4 : 3;
+
+    Primitive prim;
+    prim.shaded = command & 0x10;
+    prim.textured = command & 0x4;
+    prim.rawTexture = prim.textured && (command & 0x1);
+    prim.semiTransparent = command & 0x2;
+
+    Vertex vertices[4]{};
+    u32 color = words[0];
+    u32 index = 1;
+    for (int i = 0; i < vertexCount; i++) {
+        if (prim.shaded && i > 0) color = words[index++];
+        decodeColor(vertices[i], color);
+        decodePosition(vertices[i], words[index++], m_state);
+
+        if (prim.textured) {
+            const u32 uv = words[index++];
+            vertices[i].u = uv & 0xff;
+            vertices[i].v = (uv >> 8) & 0xff;
+            if (i == 0) decodeClut(prim, uv);
+        }
+    }
+
+    // The texpage of a textured polygon replaces the one of the drawing environment
+    if (prim.textured) {
+        const u32 page = words[prim.shaded ? 5 : 4] >> 16;
+        m_state.texBaseX = (page & 0xf) * 64;
+        m_state.texBaseY = ((page >> 4) & 1) * 256;
+        m_state.semiMode = (page >> 5) & 3;
+        m_state.texDepth = (page >> 7) & 3;
+        m_state.texDisable = (page >> 11) & 1;
+    }
+
+    prim.semiMode = m_state.semiMode;
+    prim.texDepth = m_state.texDepth;
+    prim.texBaseX = m_state.texBaseX;
+    prim.texBaseY = m_state.texBaseY;
+    prim.dither = m_state.dither && (prim.shaded || (prim.textured && !prim.rawTexture));
+
+    DrawCommand triangle{DrawCommand::TYPE::TRIANGLE, m_state, prim, {vertices[0], vertices[1], vertices[2]}};
+    submit(triangle);
+    if (vertexCount == 4) {
+        std::copy_n(&vertices[1], 3, triangle.vertices);
+        submit(triangle);
+    }
+}
+
+// Polylines arrive without their terminator word
+void Renderer::line(const u32* words, u32 count) {
+    const u32 command = words[0] >> 24;
+
+    Primitive prim;
+    prim.shaded = command & 0x10;
+    prim.semiTransparent = command & 0x2;
+    prim.semiMode = m_state.semiMode;
+    prim.dither = m_state.dither && prim.shaded;
+
+    Vertex from{};
+    decodeColor(from, words[0]);
+    decodePosition(from, words[1], m_state);
+
+    u32 index = 2;
+    u32 color = words[0];
+    while (index < count) {
+        if (prim.shaded) color = words[index++];
+        if (index >= count) break;
+
+        Vertex to{};
+        decodeColor(to, color);
+        decodePosition(to, words[index++], m_state);
+        submit({DrawCommand::TYPE::LINE, m_state, prim, {from, to}});
+        from = to;
+    }
+}
+
+void Renderer::rectangle(const u32* words) {
+    const u32 command = words[0] >> 24;
+
+    Primitive prim;
+    prim.textured = command & 0x4;
+    prim.rawTexture = prim.textured && (command & 0x1);
+    prim.semiTransparent = command & 0x2;
+    prim.semiMode = m_state.semiMode;
+    prim.texDepth = m_state.texDepth;
+    prim.texBaseX = m_state.texBaseX;
+    prim.texBaseY = m_state.texBaseY;
+
+    Vertex origin{};
+    decodeColor(origin, words[0]);
+    decodePosition(origin, words[1], m_state);
+
+    u32 index = 2;
+    if (prim.textured) {
+        const u32 uv = words[index++];
+        origin.u = uv & 0xff;
+        origin.v = (uv >> 8) & 0xff;
+        decodeClut(prim, uv);
+    }
+
+    s32 width, height;
+    switch ((command >> 3) & 3) {
+        case 0:
+            width = words[index] & 0x3ff;
+            height = (words[index] >> 16) & 0x1ff;
+            break;
+        case 1: width = height = 1; break;
+        case 2: width = height = 8; break;
+        default: width = height = 16; break;
+    }
+
+    submit({DrawCommand::TYPE::RECTANGLE, m_state, prim, {origin}, width, height});
+}
+
+void Renderer::vramWrite(const u32* words, u32 count) {
+    auto& transfer = m_transfer;
+    const u32 total = transfer.width * transfer.height;
+    const u16 maskBit = m_state.setMask ? 0x8000 : 0;
+
+    for (u32 i = 0; i < count * 2 && transfer.position < total; i++, transfer.position++) {
+        const u32 x = (transfer.x + transfer.position % transfer.width) & (VRAM_WIDTH - 1);
+        const u32 y = (transfer.y + transfer.position / transfer.width) & (VRAM_HEIGHT - 1);
+        u16& dst = m_vram[y * VRAM_WIDTH + x];
+
+        if (m_state.checkMask && (dst & 0x8000)) continue;
+        dst = static_cast<u16>(words[i / 2] >> ((i & 1) * 16)) | maskBit;
+    }
+}
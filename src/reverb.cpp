@@ -0,0 +1,334 @@
+#include "reverb.hpp"
+
+#include <algorithm>
+
+// Register indices from 0x1f801dc0
+enum REVERB_REG : u32 {
+    dAPF1, dAPF2, vIIR, vCOMB1, vCOMB2, vCOMB3, vCOMB4, vWALL, vAPF1, vAPF2, mLSAME, mRSAME, mLCOMB1, mRCOMB1,
+    mLCOMB2, mRCOMB2, dLSAME, dRSAME, mLDIFF, mRDIFF, mLCOMB3, mRCOMB3, mLCOMB4, mRCOMB4, dLDIFF, dRDIFF, mLAPF1,
+    mRAPF1, mLAPF2, mRAPF2, vLIN, vRIN,
+};
+
+// Half-band filter used to go between 44.1 and 22.05 kHz. Every other tap is zero apart from the center one
+static constexpr s32 resampleFilter[REVERB_RESAMPLE_TAPS] = {
+    -1,    0, 2,     0, -10,  0, 35,   0, -103, 0, 266, 0, -616, 0, 1332, 0, -2960, 0, 10246, 16384,
+    10246, 0, -2960, 0, 1332, 0, -616, 0, 266,  0, -103, 0, 35, 0, -10, 0, 2, 0, -1,
+};
+static constexpr s32 resampleCenter = 16384;
+static constexpr s32 resampleTaps[REVERB_OUTPUT_HISTORY + 1] = {
+    -1, 2, -10, 35, -103, 266, -616, 1332, -2960, 10246, 10246, -2960, 1332, -616, 266, -103, 35, -10, 2, -1,
+};
+
+static inline s32 saturate(s32 value) { return std::clamp(value, -0x8000, 0x7fff); }
+static inline s32 mul(s32 a, s32 b) { return (a * b) >> 15; }
+
+void Reverb::reset() {
+    m_regs.fill(0);
+    m_volumeLeft = m_volumeRight = 0;
+    m_base = m_current = 0;
+    m_layoutChanged = true;
+    for (auto& history : m_input) history.fill(0);
+    for (auto& history : m_output) history.fill(0);
+}
+
+void Reverb::write(u32 offset, u16 value) {
+    m_layoutChanged = true;
+    switch (offset) {
+        case 0xd84: m_volumeLeft = s16(value); break;
+        case 0xd86: m_volumeRight = s16(value); break;
+        case 0xda2: m_base = m_current = u32(value) * 4; break;
+        default:
+            if (offset >= 0xdc0) m_regs[(offset - 0xdc0) >> 1] = value;
+            break;
+    }
+}
+
+// Offsets wrap inside the buffer, from the base to the end of sound RAM
+u32 Reverb::address(s32 offset) const {
+    const s64 size = REVERB_RAM_END - m_base;
+    const s64 relative = (s64(m_current - m_base) + offset) % size;
+    return m_base + u32(relative < 0 ? relative + size : relative);
+}
+
+// Whether any tap reads or writes a halfword that another tap writes less than a block earlier or later. The
+// previous sample of each IIR filter is the one exception, process() carries it between steps instead
+bool Reverb::tapsOverlap() const {
+    const s64 size = REVERB_RAM_END - m_base;
+    if (size < REVERB_STEPS * 2) return true;
+
+    const s32 writes[WRITE_TAPS] = {
+        offset(mLSAME), offset(mRSAME), offset(mLDIFF), offset(mRDIFF),
+        offset(mLAPF1), offset(mRAPF1), offset(mLAPF2), offset(mRAPF2),
+    };
+    struct Read {
+        s32 offset;
+        u32 carried;  // Write tap this one reads a step later, or WRITE_TAPS
+    };
+    const Read reads[] = {
+        {offset(dLSAME), WRITE_TAPS},
+        {offset(dRSAME), WRITE_TAPS},
+        {offset(dLDIFF), WRITE_TAPS},
+        {offset(dRDIFF), WRITE_TAPS},
+        {offset(mLSAME) - 1, SAME_LEFT},
+        {offset(mRSAME) - 1, SAME_RIGHT},
+        {offset(mLDIFF) - 1, DIFF_LEFT},
+        {offset(mRDIFF) - 1, DIFF_RIGHT},
+        {offset(mLCOMB1), WRITE_TAPS},
+        {offset(mRCOMB1), WRITE_TAPS},
+        {offset(mLCOMB2), WRITE_TAPS},
+        {offset(mRCOMB2), WRITE_TAPS},
+        {offset(mLCOMB3), WRITE_TAPS},
+        {offset(mRCOMB3), WRITE_TAPS},
+        {offset(mLCOMB4), WRITE_TAPS},
+        {offset(mRCOMB4), WRITE_TAPS},
+        {offset(mLAPF1) - offset(dAPF1), WRITE_TAPS},
+        {offset(mRAPF1) - offset(dAPF1), WRITE_TAPS},
+        {offset(mLAPF2) - offset(dAPF2), WRITE_TAPS},
+        {offset(mRAPF2) - offset(dAPF2), WRITE_TAPS},
+    };
+
+    auto near = [size](s32 a, s32 b) {
+        s64 distance = (s64(a) - b) % size;
+        if (distance < 0) distance += size;
+        return distance < REVERB_STEPS || distance > size - REVERB_STEPS;
+    };
+
+    for (u32 write = 0; write < WRITE_TAPS; write++) {
+        for (u32 other = write + 1; other < WRITE_TAPS; other++) {
+            if (near(writes[write], writes[other])) return true;
+        }
+        for (const auto& read : reads) {
+            if (read.carried != write && near(read.offset, writes[write])) return true;
+        }
+    }
+    return false;
+}
+
+// One 22.05 kHz step, reading and writing the buffer a halfword at a time
+void Reverb::step(u16* ram, s32 inputLeft, s32 inputRight, s32& outputLeft, s32& outputRight) {
+    auto load = [&](s32 offset) { return s32(s16(ram[address(offset)])); };
+    auto store = [&](s32 offset, s32 value) { ram[address(offset)] = u16(value); };
+
+    const s32 wall = s16(m_regs[vWALL]);
+    const s32 iir = s16(m_regs[vIIR]);
+    auto filter = [&](s32 input, s32 reflection, u32 reg) {
+        const s32 previous = load(offset(reg) - 1);
+        store(offset(reg), saturate(mul(saturate(input + mul(load(reflection), wall) - previous), iir) + previous));
+    };
+
+    const s32 left = mul(inputLeft, s16(m_regs[vLIN]));
+    const s32 right = mul(inputRight, s16(m_regs[vRIN]));
+    filter(left, offset(dLSAME), mLSAME);
+    filter(right, offset(dRSAME), mRSAME);
+    filter(left, offset(dRDIFF), mLDIFF);
+    filter(right, offset(dLDIFF), mRDIFF);
+
+    auto comb = [&](u32 first) {
+        return saturate(mul(load(offset(first)), s16(m_regs[vCOMB1])) +
+                        mul(load(offset(first + 2)), s16(m_regs[vCOMB2])) +
+                        mul(load(offset(first + mLCOMB3 - mLCOMB1)), s16(m_regs[vCOMB3])) +
+                        mul(load(offset(first + mLCOMB4 - mLCOMB1)), s16(m_regs[vCOMB4])));
+    };
+    auto allPass = [&](s32 input, u32 reg, u32 delay, u32 volume) {
+        const s32 factor = s16(m_regs[volume]);
+        const s32 delayed = load(offset(reg) - offset(delay));
+        const s32 value = saturate(input - mul(delayed, factor));
+        store(offset(reg), value);
+        return saturate(mul(value, factor) + delayed);
+    };
+
+    s32 outLeft = comb(mLCOMB1);
+    s32 outRight = comb(mRCOMB1);
+    outLeft = allPass(outLeft, mLAPF1, dAPF1, vAPF1);
+    outRight = allPass(outRight, mRAPF1, dAPF1, vAPF1);
+    outLeft = allPass(outLeft, mLAPF2, dAPF2, vAPF2);
+    outRight = allPass(outRight, mRAPF2, dAPF2, vAPF2);
+    outputLeft = mul(outLeft, m_volumeLeft);
+    outputRight = mul(outRight, m_volumeRight);
+
+    m_current = m_current + 1 >= REVERB_RAM_END ? m_base : m_current + 1;
+}
+
+// Copy the REVERB_STEPS halfwords a tap covers in this block, in at most two spans
+void Reverb::gather(const u16* ram, s32 offset, s32* values) const {
+    const u32 start = address(offset);
+    const u32 first = std::min<u32>(REVERB_STEPS, REVERB_RAM_END - start);
+    for (u32 i = 0; i < first; i++) values[i] = s16(ram[start + i]);
+    for (u32 i = first; i < REVERB_STEPS; i++) values[i] = s16(ram[m_base + i - first]);
+}
+
+void Reverb::scatter(u16* ram, s32 offset, const s32* values) const {
+    const u32 start = address(offset);
+    const u32 first = std::min<u32>(REVERB_STEPS, REVERB_RAM_END - start);
+    for (u32 i = 0; i < first; i++) ram[start + i] = u16(values[i]);
+    for (u32 i = first; i < REVERB_STEPS; i++) ram[m_base + i - first] = u16(values[i]);
+}
+
+// A block of steps, one filter stage at a time over all of them
+void Reverb::steps(u16* ram, const s32* inputLeft, const s32* inputRight, s32* outputLeft, s32* outputRight) {
+    alignas(32) s32 inputs[2][REVERB_STEPS];
+    alignas(32) s32 taps[4][REVERB_STEPS];
+    alignas(32) s32 values[REVERB_STEPS];
+    alignas(32) s32 outputs[2][REVERB_STEPS];
+
+    const s32 volumeLeft = s16(m_regs[vLIN]);
+    const s32 volumeRight = s16(m_regs[vRIN]);
+    for (u32 i = 0; i < REVERB_STEPS; i++) {
+        inputs[0][i] = mul(inputLeft[i], volumeLeft);
+        inputs[1][i] = mul(inputRight[i], volumeRight);
+    }
+
+    // The IIR filters depend on their previous output, only that part goes step by step
+    const s32 wall = s16(m_regs[vWALL]);
+    const s32 iir = s16(m_regs[vIIR]);
+    auto filter = [&](const s32* input, s32 reflection, u32 reg) {
+        gather(ram, reflection, taps[0]);
+        for (u32 i = 0; i < REVERB_STEPS; i++) values[i] = input[i] + mul(taps[0][i], wall);
+
+        s32 previous = s16(ram[address(offset(reg) - 1)]);
+        for (u32 i = 0; i < REVERB_STEPS; i++) {
+            previous = saturate(mul(saturate(values[i] - previous), iir) + previous);
+            values[i] = previous;
+        }
+        scatter(ram, offset(reg), values);
+    };
+
+    filter(inputs[0], offset(dLSAME), mLSAME);
+    filter(inputs[1], offset(dRSAME), mRSAME);
+    filter(inputs[0], offset(dRDIFF), mLDIFF);
+    filter(inputs[1], offset(dLDIFF), mRDIFF);
+
+    const s32 comb1 = s16(m_regs[vCOMB1]);
+    const s32 comb2 = s16(m_regs[vCOMB2]);
+    const s32 comb3 = s16(m_regs[vCOMB3]);
+    const s32 comb4 = s16(m_regs[vCOMB4]);
+    for (u32 channel = 0; channel < 2; channel++) {
+        gather(ram, offset(mLCOMB1 + channel), taps[0]);
+        gather(ram, offset(mLCOMB2 + channel), taps[1]);
+        gather(ram, offset(mLCOMB3 + channel), taps[2]);
+        gather(ram, offset(mLCOMB4 + channel), taps[3]);
+        for (u32 i = 0; i < REVERB_STEPS; i++) {
+            outputs[channel][i] = saturate(mul(taps[0][i], comb1) + mul(taps[1][i], comb2) +
+                                           mul(taps[2][i], comb3) + mul(taps[3][i], comb4));
+        }
+    }
+
+    auto allPass = [&](s32* output, u32 reg, u32 delay, u32 volume) {
+        const s32 factor = s16(m_regs[volume]);
+        gather(ram, offset(reg) - offset(delay), taps[0]);
+        for (u32 i = 0; i < REVERB_STEPS; i++) values[i] = saturate(output[i] - mul(taps[0][i], factor));
+        scatter(ram, offset(reg), values);
+        for (u32 i = 0; i < REVERB_STEPS; i++) output[i] = saturate(mul(values[i], factor) + taps[0][i]);
+    };
+
+    allPass(outputs[0], mLAPF1, dAPF1, vAPF1);
+    allPass(outputs[1], mRAPF1, dAPF1, vAPF1);
+    allPass(outputs[0], mLAPF2, dAPF2, vAPF2);
+    allPass(outputs[1], mRAPF2, dAPF2, vAPF2);
+    for (u32 i = 0; i < REVERB_STEPS; i++) {
+        outputLeft[i] = mul(outputs[0][i], m_volumeLeft);
+        outputRight[i] = mul(outputs[1][i], m_volumeRight);
+    }
+
+    m_current += REVERB_STEPS;
+    if (m_current >= REVERB_RAM_END) m_current -= REVERB_RAM_END - m_base;
+}
+
+void Reverb::pushInput(const s32* inputLeft, const s32* inputRight) {
+    for (u32 i = 0; i < REVERB_BLOCK_SIZE; i++) {
+        m_input[0][REVERB_INPUT_HISTORY + i] = saturate(inputLeft[i]);
+        m_input[1][REVERB_INPUT_HISTORY + i] = saturate(inputRight[i]);
+    }
+}
+
+// Keep the end of the block as history for the next one
+void Reverb::popHistory() {
+    for (auto& input : m_input) std::copy(input.end() - REVERB_INPUT_HISTORY, input.end(), input.begin());
+    for (auto& output : m_output) std::copy(output.end() - REVERB_OUTPUT_HISTORY, output.end(), output.begin());
+}
+
+void Reverb::process(u16* ram, const s32* inputLeft, const s32* inputRight, s32* outputLeft, s32* outputRight) {
+    if (m_layoutChanged) {
+        m_overlap = tapsOverlap();
+        m_layoutChanged = false;
+    }
+
+    if (m_overlap) {
+        processReference(ram, inputLeft, inputRight, outputLeft, outputRight);
+        return;
+    }
+
+    pushInput(inputLeft, inputRight);
+
+    // Step i filters the input up to sample 2i + 1. Split the input by parity so every tap is a contiguous run
+    alignas(32) s32 downsampled[2][REVERB_STEPS];
+    for (u32 channel = 0; channel < 2; channel++) {
+        alignas(32) s32 even[(REVERB_INPUT_HISTORY + REVERB_BLOCK_SIZE) / 2];
+        alignas(32) s32 odd[(REVERB_INPUT_HISTORY + REVERB_BLOCK_SIZE) / 2];
+        for (u32 i = 0; i < std::size(even); i++) {
+            even[i] = m_input[channel][i * 2];
+            odd[i] = m_input[channel][i * 2 + 1];
+        }
+
+        constexpr u32 center = (REVERB_INPUT_HISTORY + 1 - REVERB_RESAMPLE_TAPS / 2) / 2;
+        alignas(32) s32 sums[REVERB_STEPS];
+        for (u32 i = 0; i < REVERB_STEPS; i++) sums[i] = even[i + center] * resampleCenter;
+        for (u32 tap = 0; tap < std::size(resampleTaps); tap++) {
+            for (u32 i = 0; i < REVERB_STEPS; i++) sums[i] += odd[i + REVERB_OUTPUT_HISTORY - tap] * resampleTaps[tap];
+        }
+        for (u32 i = 0; i < REVERB_STEPS; i++) downsampled[channel][i] = saturate(sums[i] >> 15);
+    }
+
+    steps(ram, downsampled[0], downsampled[1], &m_output[0][REVERB_OUTPUT_HISTORY],
+          &m_output[1][REVERB_OUTPUT_HISTORY]);
+
+    // Even outputs interpolate between steps, odd ones are the step half a sample later
+    s32* outputs[2] = {outputLeft, outputRight};
+    for (u32 channel = 0; channel < 2; channel++) {
+        const s32* history = m_output[channel].data();
+        alignas(32) s32 sums[REVERB_STEPS] = {};
+        for (u32 tap = 0; tap < std::size(resampleTaps); tap++) {
+            const s32 factor = resampleTaps[tap];
+            for (u32 i = 0; i < REVERB_STEPS; i++) sums[i] += history[i + REVERB_OUTPUT_HISTORY - tap] * factor;
+        }
+        for (u32 i = 0; i < REVERB_STEPS; i++) {
+            outputs[channel][i * 2] = saturate(sums[i] >> 14);
+            outputs[channel][i * 2 + 1] = history[i + REVERB_OUTPUT_HISTORY - 9];
+        }
+    }
+
+    popHistory();
+}
+
+void Reverb::processReference(u16* ram, const s32* inputLeft, const s32* inputRight, s32* outputLeft,
+                              s32* outputRight) {
+    pushInput(inputLeft, inputRight);
+
+    for (u32 i = 0; i < REVERB_STEPS; i++) {
+        s32 downsampled[2];
+        for (u32 channel = 0; channel < 2; channel++) {
+            s32 sum = 0;
+            for (u32 tap = 0; tap < REVERB_RESAMPLE_TAPS; tap++) {
+                sum += m_input[channel][i * 2 + 1 + REVERB_INPUT_HISTORY - tap] * resampleFilter[tap];
+            }
+            downsampled[channel] = saturate(sum >> 15);
+        }
+
+        step(ram, downsampled[0], downsampled[1], m_output[0][REVERB_OUTPUT_HISTORY + i],
+             m_output[1][REVERB_OUTPUT_HISTORY + i]);
+
+        // The zero stuffed output through the same filter, at twice the gain
+        s32* outputs[2] = {outputLeft, outputRight};
+        for (u32 channel = 0; channel < 2; channel++) {
+            const s32* history = m_output[channel].data() + i;
+            s32 sum = 0;
+            for (u32 tap = 0; tap < REVERB_RESAMPLE_TAPS; tap += 2) {
+                sum += history[REVERB_OUTPUT_HISTORY - tap / 2] * resampleFilter[tap];
+            }
+            outputs[channel][i * 2] = saturate(sum >> 14);
+            outputs[channel][i * 2 + 1] = history[REVERB_OUTPUT_HISTORY - 9];
+        }
+    }
+
+    popHistory();
+}
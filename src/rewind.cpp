@@ -0,0 +1,210 @@
+#include "rewind.hpp"
+
+#include <chrono>
+#include <cstring>
+
+#include "emulator.hpp"
+
+static u64 loadWord(const u8* data) {
+    u64 word;
+    std::memcpy(&word, data, sizeof(word));
+    return word;
+}
+
+// A delta is a list of runs over 8 byte words: the number of words to skip, the number of literal words, then the
+// literal words as older ^ newer. Equal words are never stored. Byte ranges in same are known to be equal and are
+// skipped without comparing
+static void encode(const u8* older, const u8* newer, size_t words, const std::vector<std::pair<size_t, size_t>>& same,
+                   std::vector<u8>& out) {
+    auto differs = [&](size_t i) { return loadWord(older + i * 8) != loadWord(newer + i * 8); };
+
+    out.clear();
+    size_t i = 0;
+    size_t range = 0;
+    while (true) {
+        const size_t start = i;
+        while (i < words) {
+            while (range < same.size() && same[range].second / 8 <= i) range++;
+            if (range < same.size() && (same[range].first + 7) / 8 <= i) {
+                i = same[range].second / 8;
+            } else if (differs(i)) {
+                break;
+            } else {
+                i++;
+            }
+        }
+        if (i == words) break;
+
+        // A single equal word is cheaper to keep in the literal than a new run header
+        const size_t literal = i;
+        while (i < words && (differs(i) || (i + 1 < words && differs(i + 1)))) i++;
+
+        const u32 header[2] = {u32(literal - start), u32(i - literal)};
+        const size_t position = out.size();
+        out.resize(position + sizeof(header) + (i - literal) * 8);
+        u8* data = out.data() + position;
+        std::memcpy(data, header, sizeof(header));
+        data += sizeof(header);
+        for (size_t word = literal; word < i; word++, data += 8) {
+            const u64 value = loadWord(older + word * 8) ^ loadWord(newer + word * 8);
+            std::memcpy(data, &value, sizeof(value));
+        }
+    }
+}
+
+// XOR a delta into a snapshot, turning it into the one the delta was taken against
+static void decode(const u8* delta, size_t size, u8* state) {
+    const u8* end = delta + size;
+    while (delta < end) {
+        u32 header[2];
+        std::memcpy(header, delta, sizeof(header));
+        delta += sizeof(header);
+        state += size_t(header[0]) * 8;
+        for (u32 word = 0; word < header[1]; word++, delta += 8, state += 8) {
+            const u64 value = loadWord(state) ^ loadWord(delta);
+            std::memcpy(state, &value, sizeof(value));
+        }
+    }
+}
+
+// Zero pad a snapshot of the given size up to a whole number of words, so snapshots of different sizes compare.
+// Reserving first keeps the vector from doubling its capacity over a few bytes
+static void pad(std::vector<u8>& state, size_t size, size_t padded) {
+    state.reserve(padded);
+    state.resize(size);
+    state.resize(padded);
+}
+
+static size_t paddedSize(size_t a, size_t b) { return (std::max(a, b) + 7) & ~size_t(7); }
+
+void Rewind::setEnabled(bool enabled) {
+    m_enabled = enabled;
+    clear();
+    if (enabled) {
+        m_ring.resize(m_budget);
+    } else {
+        std::vector<u8>().swap(m_ring);
+        std::vector<u8>().swap(m_latest);
+        std::vector<u8>().swap(m_next);
+        std::vector<u8>().swap(m_delta);
+    }
+}
+
+void Rewind::setBudget(size_t bytes) {
+    m_budget = bytes;
+    if (m_enabled) setEnabled(true);
+}
+
+void Rewind::clear() {
+    m_entries.clear();
+    m_head = 0;
+    m_used = 0;
+    m_latestSize = 0;
+    m_latestEpoch = 0;
+    m_nextEpoch = 0;
+    m_frame = 0;
+}
+
+void Rewind::onFrame(u64 frame) {
+    m_frame = frame;
+    m_frames++;
+    if (!m_latestSize || frame < m_latestFrame || frame - m_latestFrame >= m_interval) snapshot();
+}
+
+void Rewind::snapshot() {
+    const auto start = std::chrono::steady_clock::now();
+
+    Serializer measure(Serializer::MODE::MEASURE);
+    m_emulator.serialize(measure);
+    const size_t size = measure.position();
+    m_next.reserve(paddedSize(size, m_latestSize));
+    m_next.resize(size);
+
+    // m_next still holds the snapshot before the newest, so only RAM pages written since that one are copied. The
+    // pages skipped are also unchanged since the newest snapshot, and the delta doesn't compare them either
+    const u32 epoch = m_emulator.m_mem.checkpoint();
+    Serializer writer(Serializer::MODE::SAVE, m_next.data(), size, m_nextEpoch);
+    m_emulator.serialize(writer);
+
+    if (m_latestSize) {
+        const size_t padded = paddedSize(size, m_latestSize);
+        pad(m_latest, m_latestSize, padded);
+        pad(m_next, size, padded);
+        encode(m_latest.data(), m_next.data(), padded / 8, writer.skipped(), m_delta);
+        store(m_delta, m_latestSize);
+    }
+
+    std::swap(m_latest, m_next);
+    m_nextEpoch = m_latestEpoch;
+    m_latestEpoch = epoch;
+    m_latestSize = size;
+    m_latestFrame = m_emulator.m_gpu.m_frameCount;
+    m_latestCycle = m_emulator.m_scheduler.now();
+
+    m_lastCost = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    m_snapshotTime += m_lastCost;
+}
+
+// Keep the delta back to the current newest snapshot, dropping the oldest deltas that are in the way
+void Rewind::store(const std::vector<u8>& delta, u32 stateSize) {
+    const size_t size = delta.size();
+    if (size > m_ring.size()) {
+        m_entries.clear();
+        m_head = 0;
+        m_used = 0;
+        return;
+    }
+
+    size_t offset = m_head;
+    if (offset + size > m_ring.size()) {
+        // Wrap around. Whatever is left past the head is from the previous lap, so the oldest
+        while (!m_entries.empty() && m_entries.front().offset >= m_head) {
+            m_used -= m_entries.front().size;
+            m_entries.pop_front();
+        }
+        offset = 0;
+    }
+    while (!m_entries.empty() && m_entries.front().offset >= offset && m_entries.front().offset < offset + size) {
+        m_used -= m_entries.front().size;
+        m_entries.pop_front();
+    }
+
+    std::memcpy(m_ring.data() + offset, delta.data(), size);
+    m_entries.push_back({offset, u32(size), stateSize, m_latestFrame, m_latestCycle});
+    m_head = offset + size;
+    m_used += size;
+}
+
+bool Rewind::stepBack() {
+    if (!m_latestSize) return false;
+
+    // Back to the newest snapshot if the emulator moved on since, else undo one delta
+    if (m_emulator.m_scheduler.now() == m_latestCycle) {
+        if (m_entries.empty()) return false;
+
+        const Entry entry = m_entries.back();
+        m_entries.pop_back();
+        pad(m_latest, m_latestSize, paddedSize(m_latestSize, entry.stateSize));
+        decode(m_ring.data() + entry.offset, entry.size, m_latest.data());
+
+        m_latestSize = entry.stateSize;
+        m_latestFrame = entry.frame;
+        m_latestCycle = entry.cycle;
+        m_head = entry.offset;
+        m_used -= entry.size;
+    }
+
+    load();
+    return true;
+}
+
+void Rewind::load() {
+    Serializer reader(Serializer::MODE::LOAD, m_latest.data(), m_latestSize);
+    m_emulator.serialize(reader);
+    if (!reader.ok()) Helpers::warn("Couldn't restore rewind snapshot\n");
+    m_frame = m_latestFrame;
+
+    // RAM matches the newest snapshot again, m_next no longer holds the one before it
+    m_latestEpoch = m_emulator.m_mem.checkpoint();
+    m_nextEpoch = 0;
+}
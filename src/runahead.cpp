@@ -0,0 +1,101 @@
+#include "runahead.hpp"
+
+#include <chrono>
+
+#include "emulator.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+static double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void RunAhead::setFrames(u32 frames) {
+    m_frames = std::min<u32>(frames, RUNAHEAD_MAX_FRAMES);
+    if (m_frames == 0) {
+        std::vector<u8>().swap(m_state);
+        m_epoch = 0;
+        m_frameCost = m_saveCost = m_restoreCost = 0.0;
+    }
+}
+
+void RunAhead::frame() {
+    if (!m_emulator.canRun()) return;
+    // A GPU recording must only see the real frames
+    if (m_frames == 0 || m_emulator.m_gpu.m_recorder.active()) {
+        runFrame();
+        return;
+    }
+
+    // The real frame, heard but not shown
+    setOutput(true, false);
+    runFrame();
+    if (!m_emulator.isRunning) {
+        setOutput(true, true);
+        return;
+    }
+
+    const auto start = Clock::now();
+    m_speculating = true;
+    save();
+    const double saveTime = secondsSince(start);
+
+    for (u32 i = 1; i <= m_frames; i++) {
+        setOutput(false, i == m_frames);
+        runFrame();
+    }
+
+    // Restoring must not convert the display again, the speculative frame stays on screen
+    setOutput(false, false);
+    const auto restoreStart = Clock::now();
+    restore();
+    const double restoreTime = secondsSince(restoreStart);
+    m_speculating = false;
+    setOutput(true, true);
+
+    m_periodTime += secondsSince(start);
+    m_periodSave += saveTime;
+    m_periodRestore += restoreTime;
+    if (++m_periodFrames == RUNAHEAD_AVERAGE_FRAMES) {
+        m_frameCost = m_periodTime / m_periodFrames;
+        m_saveCost = m_periodSave / m_periodFrames;
+        m_restoreCost = m_periodRestore / m_periodFrames;
+        m_periodFrames = 0;
+        m_periodTime = m_periodSave = m_periodRestore = 0.0;
+    }
+}
+
+void RunAhead::runFrame() {
+    const u64 frame = m_emulator.m_gpu.m_frameCount;
+    while (m_emulator.isRunning && m_emulator.m_gpu.m_frameCount == frame) m_emulator.runFrame();
+}
+
+void RunAhead::setOutput(bool audio, bool video) {
+    m_emulator.m_spu.m_outputEnabled = audio;
+    m_emulator.m_gpu.m_presentFrames = video;
+}
+
+// RAM pages not written since the last save still match m_state, only the rest is copied. Pages restored or loaded
+// in between are stamped as written, so anything else that replaced RAM makes the next save a full one
+void RunAhead::save() {
+    Serializer measure(Serializer::MODE::MEASURE);
+    m_emulator.serialize(measure);
+    if (measure.position() != m_state.size()) {
+        m_state.resize(measure.position());
+        m_epoch = 0;
+    }
+
+    const u32 epoch = m_emulator.m_mem.checkpoint();
+    Serializer writer(Serializer::MODE::SAVE, m_state.data(), m_state.size(), m_epoch);
+    m_emulator.serialize(writer);
+    m_epoch = epoch;
+}
+
+void RunAhead::restore() {
+    Serializer reader(Serializer::MODE::LOAD, m_state.data(), m_state.size(), m_epoch);
+    m_emulator.serialize(reader);
+    if (!reader.ok()) Helpers::warn("Couldn't restore the run-ahead state\n");
+    // The state is from right after the real frame's vblank, the pages the speculative frames wrote and the restore
+    // put back aren't the next real frame's
+    m_emulator.m_mem.restartFrame();
+}
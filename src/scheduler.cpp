@@ -0,0 +1,76 @@
+#include "scheduler.hpp"
+
+#include "emulator.hpp"
+
+template <u32 channel>
+static void dmaFinished(Emulator& emulator) {
+    emulator.m_dma.finishTransfer(channel);
+}
+
+template <u32 index>
+static void timerEvent(Emulator& emulator) {
+    emulator.m_timers.onEvent(index);
+}
+
+static void vblank(Emulator& emulator) { emulator.m_gpu.vblank(); }
+static void spuBlock(Emulator& emulator) { emulator.m_spu.mixBlock(); }
+static void cdromCommand(Emulator& emulator) { emulator.m_cdrom.commandEvent(); }
+static void cdromDrive(Emulator& emulator) { emulator.m_cdrom.driveEvent(); }
+
+void Scheduler::init() {
+    m_handlers[(size_t)EVENT::DMA0] = dmaFinished<0>;
+    m_handlers[(size_t)EVENT::DMA1] = dmaFinished<1>;
+    m_handlers[(size_t)EVENT::DMA2] = dmaFinished<2>;
+    m_handlers[(size_t)EVENT::DMA3] = dmaFinished<3>;
+    m_handlers[(size_t)EVENT::DMA4] = dmaFinished<4>;
+    m_handlers[(size_t)EVENT::DMA5] = dmaFinished<5>;
+    m_handlers[(size_t)EVENT::DMA6] = dmaFinished<6>;
+    m_handlers[(size_t)EVENT::TIMER0] = timerEvent<0>;
+    m_handlers[(size_t)EVENT::TIMER1] = timerEvent<1>;
+    m_handlers[(size_t)EVENT::TIMER2] = timerEvent<2>;
+    m_handlers[(size_t)EVENT::VBLANK] = vblank;
+    m_handlers[(size_t)EVENT::SPU] = spuBlock;
+    m_handlers[(size_t)EVENT::CDROM] = cdromCommand;
+    m_handlers[(size_t)EVENT::CDROM_DRIVE] = cdromDrive;
+    reset();
+}
+
+void Scheduler::reset() {
+    m_cycles = 0;
+    m_deadlines.fill(NEVER);
+    m_nextDeadline = NEVER;
+}
+
+void Scheduler::serialize(Serializer& s) {
+    s(m_cycles);
+    s(m_deadlines);
+    if (s.loading()) updateNextDeadline();
+}
+
+void Scheduler::schedule(EVENT event, u64 cycles) {
+    m_deadlines[(size_t)event] = m_cycles + cycles;
+    updateNextDeadline();
+}
+
+void Scheduler::cancel(EVENT event) {
+    m_deadlines[(size_t)event] = NEVER;
+    updateNextDeadline();
+}
+
+void Scheduler::runEvents() {
+    // Handlers may schedule new events, including the one being run
+    for (size_t i = 0; i < m_deadlines.size(); i++) {
+        if (m_deadlines[i] <= m_cycles) {
+            m_deadlines[i] = NEVER;
+            m_handlers[i](m_emulator);
+        }
+    }
+    updateNextDeadline();
+}
+
+void Scheduler::updateNextDeadline() {
+    m_nextDeadline = NEVER;
+    for (auto deadline : m_deadlines) {
+        m_nextDeadline = std::min(m_nextDeadline, deadline);
+    }
+}
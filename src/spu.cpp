@@ -0,0 +1,426 @@
+#include "spu.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "emulator.hpp"
+
+#define SPU_RAM_MASK (SPU_RAM_SIZE - 1)
+#define SPUSTAT_IRQ (1 << 6)
+
+// ADPCM prediction filter coefficients, in 1/64ths
+static constexpr s32 positiveFilter[5] = {0, 60, 115, 98, 122};
+static constexpr s32 negativeFilter[5] = {0, 0, -52, -55, -60};
+
+Spu::Spu(Emulator& emulator) : m_emulator(emulator) { reset(); }
+
+void Spu::reset() {
+    std::fill(m_ram.get(), m_ram.get() + SPU_RAM_SIZE, 0);
+    m_voices.fill({});
+    m_regs.fill(0);
+    m_control.r = 0;
+    m_status = 0;
+    m_mainVolumeLeft = 0;
+    m_mainVolumeRight = 0;
+    m_cdVolumeLeft = m_cdVolumeRight = 0;
+    m_pitchModulation = 0;
+    m_noiseEnable = 0;
+    m_reverbEnable = 0;
+    m_reverb.reset();
+    m_endx = 0;
+    m_irqAddress = 0;
+    m_transferAddress = 0;
+    m_noiseLevel = 1;
+    m_noiseTimer = 0;
+    m_emulator.m_scheduler.schedule(EVENT::SPU, SPU_BLOCK_SIZE * SPU_CYCLES_PER_SAMPLE);
+}
+
+// The SPU bus is 16 bits wide, word accesses cover two registers and byte reads pick half of one
+u32 Spu::read(u32 offset, u32 size) {
+    if (size == 1) return readRegister(offset & ~1) >> ((offset & 1) * 8);
+    offset &= ~1;
+    const u32 high = size == 4 ? readRegister(offset + 2) : 0;
+    return readRegister(offset) | high << 16;
+}
+
+void Spu::write(u32 offset, u32 value, u32 size) {
+    offset &= ~1;
+    writeRegister(offset, u16(value));
+    if (size == 4) writeRegister(offset + 2, u16(value >> 16));
+}
+
+void Spu::serialize(Serializer& s) {
+    s.bytes(m_ram.get(), SPU_RAM_SIZE);
+    s(m_voices);
+    s(m_regs);
+    s(m_reverb);
+    s(m_control.r);
+    s(m_status);
+    s(m_mainVolumeLeft);
+    s(m_mainVolumeRight);
+    s(m_cdVolumeLeft);
+    s(m_cdVolumeRight);
+    s(m_pitchModulation);
+    s(m_noiseEnable);
+    s(m_reverbEnable);
+    s(m_endx);
+    s(m_irqAddress);
+    s(m_transferAddress);
+    s(m_noiseLevel);
+    s(m_noiseTimer);
+}
+
+u16 Spu::readRegister(u32 offset) {
+    if (offset < 0xd80 && (offset & 0xf) == 0xc) return u16(m_voices[(offset - 0xc00) >> 4].level);
+
+    switch (offset) {
+        case 0xd9c: return u16(m_endx);
+        case 0xd9e: return u16(m_endx >> 16);
+        case 0xdaa: return m_control.r;
+        case 0xdae: return (m_status & SPUSTAT_IRQ) | (m_control.r & 0x3f);
+        default: return m_regs[(offset - 0xc00) >> 1];
+    }
+}
+
+void Spu::writeRegister(u32 offset, u16 value) {
+    m_regs[(offset - 0xc00) >> 1] = value;
+    if (offset < 0xd80) {
+        writeVoice(m_voices[(offset - 0xc00) >> 4], offset & 0xf, value);
+        return;
+    }
+
+    switch (offset) {
+        case 0xd80: m_mainVolumeLeft = value; break;
+        case 0xd82: m_mainVolumeRight = value; break;
+        case 0xdb0: m_cdVolumeLeft = s16(value); break;
+        case 0xdb2: m_cdVolumeRight = s16(value); break;
+        case 0xd88: keyOn(value); break;
+        case 0xd8a: keyOn(u32(value) << 16); break;
+        case 0xd8c: keyOff(value); break;
+        case 0xd8e: keyOff(u32(value) << 16); break;
+        case 0xd90: m_pitchModulation = (m_pitchModulation & 0xff0000) | value; break;
+        case 0xd92: m_pitchModulation = (m_pitchModulation & 0xffff) | (value & 0xff) << 16; break;
+        case 0xd94: m_noiseEnable = (m_noiseEnable & 0xff0000) | value; break;
+        case 0xd96: m_noiseEnable = (m_noiseEnable & 0xffff) | (value & 0xff) << 16; break;
+        case 0xd98: m_reverbEnable = (m_reverbEnable & 0xff0000) | value; break;
+        case 0xd9a: m_reverbEnable = (m_reverbEnable & 0xffff) | (value & 0xff) << 16; break;
+        case 0xd84:
+        case 0xd86:
+        case 0xda2: m_reverb.write(offset, value); break;
+        case 0xda4: m_irqAddress = u32(value) << 3; break;
+        case 0xda6: m_transferAddress = u32(value) << 3; break;
+        case 0xda8: writeRam(value); break;
+        case 0xdaa:
+            m_control.r = value;
+            if (!m_control.irqEnable) m_status &= ~SPUSTAT_IRQ;  // Acknowledge
+            break;
+        default:
+            if (offset >= 0xdc0 && offset < 0xe00) m_reverb.write(offset, value);
+            break;
+    }
+}
+
+void Spu::writeVoice(Voice& voice, u32 reg, u16 value) {
+    switch (reg) {
+        case 0x0: voice.volumeLeft = value; break;
+        case 0x2: voice.volumeRight = value; break;
+        case 0x4: voice.pitch = value; break;
+        case 0x6: voice.startAddress = value; break;
+        case 0x8: voice.adsr = (voice.adsr & 0xffff0000) | value; break;
+        case 0xa: voice.adsr = (voice.adsr & 0xffff) | u32(value) << 16; break;
+        case 0xc: voice.level = value & 0x7fff; break;
+        case 0xe: voice.repeatAddress = value; break;
+    }
+}
+
+void Spu::keyOn(u32 mask) {
+    for (u32 i = 0; i < SPU_VOICE_COUNT; i++) {
+        if (!(mask & (1 << i))) continue;
+
+        auto& voice = m_voices[i];
+        voice.address = u32(voice.startAddress) << 3;
+        voice.counter = 0;
+        voice.history[0] = voice.history[1] = 0;
+        voice.samples[ADPCM_BLOCK_SAMPLES] = 0;
+        voice.phase = ADSR_PHASE::ATTACK;
+        voice.level = 0;
+        voice.envelopeWait = 0;
+        m_endx &= ~(1 << i);
+        decodeBlock(i);
+    }
+}
+
+void Spu::keyOff(u32 mask) {
+    for (u32 i = 0; i < SPU_VOICE_COUNT; i++) {
+        auto& voice = m_voices[i];
+        if ((mask & (1 << i)) && voice.phase != ADSR_PHASE::OFF) {
+            voice.phase = ADSR_PHASE::RELEASE;
+            voice.envelopeWait = 0;
+        }
+    }
+}
+
+void Spu::checkIrq(u32 address, u32 size) {
+    if (!m_control.irqEnable || (m_status & SPUSTAT_IRQ)) return;
+    if (((m_irqAddress - address) & SPU_RAM_MASK) < size) {
+        m_status |= SPUSTAT_IRQ;
+        m_emulator.m_irq.trigger(IRQ::SPU);
+    }
+}
+
+void Spu::writeRam(u16 value) {
+    checkIrq(m_transferAddress, 2);
+    m_ram[m_transferAddress] = u8(value);
+    m_ram[m_transferAddress + 1] = u8(value >> 8);
+    m_transferAddress = (m_transferAddress + 2) & SPU_RAM_MASK;
+}
+
+void Spu::dmaWrite(const u32* data, u32 words) {
+    const u8* source = reinterpret_cast<const u8*>(data);
+    u32 bytes = words * 4;
+    while (bytes) {
+        const u32 span = std::min(bytes, SPU_RAM_SIZE - m_transferAddress);
+        checkIrq(m_transferAddress, span);
+        std::memcpy(&m_ram[m_transferAddress], source, span);
+        source += span;
+        bytes -= span;
+        m_transferAddress = (m_transferAddress + span) & SPU_RAM_MASK;
+    }
+}
+
+void Spu::dmaRead(u32* data, u32 words) {
+    u8* destination = reinterpret_cast<u8*>(data);
+    u32 bytes = words * 4;
+    while (bytes) {
+        const u32 span = std::min(bytes, SPU_RAM_SIZE - m_transferAddress);
+        checkIrq(m_transferAddress, span);
+        std::memcpy(destination, &m_ram[m_transferAddress], span);
+        destination += span;
+        bytes -= span;
+        m_transferAddress = (m_transferAddress + span) & SPU_RAM_MASK;
+    }
+}
+
+// Decode the 28 samples of the block at the voice address. The last sample of the previous block is kept in front.
+// Addresses are only 8 byte aligned, a block at the end of sound RAM wraps around to the start
+void Spu::decodeBlock(u32 index) {
+    auto& voice = m_voices[index];
+    u8 block[ADPCM_BLOCK_SIZE];
+    for (u32 i = 0; i < ADPCM_BLOCK_SIZE; i++) block[i] = m_ram[(voice.address + i) & SPU_RAM_MASK];
+    checkIrq(voice.address, ADPCM_BLOCK_SIZE);
+
+    const u32 shift = (block[0] & 0xf) > 12 ? 9 : block[0] & 0xf;
+    const u32 filter = std::min(4, block[0] >> 4);
+    const s32 positive = positiveFilter[filter];
+    const s32 negative = negativeFilter[filter];
+    voice.flags = block[1];
+    if (voice.flags & 4) voice.repeatAddress = voice.address >> 3;  // Loop start
+
+    voice.samples[0] = voice.samples[ADPCM_BLOCK_SAMPLES];
+    s32 older = voice.history[1];
+    s32 old = voice.history[0];
+    for (u32 i = 0; i < ADPCM_BLOCK_SAMPLES; i++) {
+        const u32 nibble = (block[2 + i / 2] >> ((i & 1) * 4)) & 0xf;
+        s32 sample = s16(nibble << 12) >> shift;
+        sample += (old * positive + older * negative + 32) >> 6;
+        sample = std::clamp(sample, -0x8000, 0x7fff);
+
+        voice.samples[i + 1] = s16(sample);
+        older = old;
+        old = sample;
+    }
+    voice.history[0] = s16(old);
+    voice.history[1] = s16(older);
+}
+
+// Move past a finished block, following its loop flags
+void Spu::nextBlock(u32 index) {
+    auto& voice = m_voices[index];
+    if (voice.flags & 1) {  // Loop end
+        m_endx |= 1 << index;
+        voice.address = u32(voice.repeatAddress) << 3;
+        if (!(voice.flags & 2)) {  // No repeat, the voice stops
+            voice.phase = ADSR_PHASE::OFF;
+            voice.level = 0;
+        }
+    } else {
+        voice.address = (voice.address + ADPCM_BLOCK_SIZE) & SPU_RAM_MASK;
+    }
+    decodeBlock(index);
+}
+
+EnvelopeRate Spu::envelopeRate(const Voice& voice) const {
+    const u32 adsr = voice.adsr;
+    switch (voice.phase) {
+        case ADSR_PHASE::ATTACK: return {(adsr >> 10) & 0x1f, s32(7 - ((adsr >> 8) & 3)), bool(adsr & 0x8000), false};
+        case ADSR_PHASE::DECAY: return {((adsr >> 4) & 0xf) << 2, -8, true, true};
+        case ADSR_PHASE::SUSTAIN: {
+            const bool decreasing = adsr & (1 << 30);
+            const s32 step = (adsr >> 22) & 3;
+            return {(adsr >> 24) & 0x1f, decreasing ? -8 + step : 7 - step, bool(adsr & (1u << 31)), decreasing};
+        }
+        default: return {((adsr >> 16) & 0x1f) << 2, -8, bool(adsr & (1 << 21)), true};
+    }
+}
+
+// Advance the envelope by one sample. Slow rates wait several samples between steps, fast ones take bigger steps
+void Spu::tickEnvelope(Voice& voice) {
+    if (voice.envelopeWait > 0) {
+        voice.envelopeWait--;
+        return;
+    }
+
+    const auto rate = envelopeRate(voice);
+    u32 wait = 1 << std::max(0, s32(rate.shift) - 11);
+    s32 step = rate.step << std::max(0, 11 - s32(rate.shift));
+    if (rate.exponential && !rate.decreasing && voice.level > 0x6000) wait *= 4;
+    if (rate.exponential && rate.decreasing) step = (step * voice.level) >> 15;
+
+    voice.level = std::clamp(voice.level + step, 0, 0x7fff);
+    voice.envelopeWait = wait - 1;
+
+    const s32 sustainLevel = ((voice.adsr & 0xf) + 1) * 0x800;
+    switch (voice.phase) {
+        case ADSR_PHASE::ATTACK:
+            if (voice.level == 0x7fff) voice.phase = ADSR_PHASE::DECAY;
+            break;
+        case ADSR_PHASE::DECAY:
+            if (voice.level <= sustainLevel) voice.phase = ADSR_PHASE::SUSTAIN;
+            break;
+        case ADSR_PHASE::RELEASE:
+            if (voice.level == 0) voice.phase = ADSR_PHASE::OFF;
+            break;
+        default: break;
+    }
+}
+
+// Noise generator level for every sample of the block
+void Spu::updateNoise(s32* noise) {
+    const s32 step = m_control.noiseStep + 4;
+    const s32 period = 0x20000 >> m_control.noiseShift;
+    for (u32 i = 0; i < SPU_BLOCK_SIZE; i++) {
+        m_noiseTimer -= step;
+        if (m_noiseTimer < 0) {
+            const s32 parity = ((m_noiseLevel >> 15) ^ (m_noiseLevel >> 12) ^ (m_noiseLevel >> 11) ^
+                                (m_noiseLevel >> 10) ^ 1) & 1;
+            m_noiseLevel = s16((m_noiseLevel << 1) | parity);
+            m_noiseTimer += period;
+            if (m_noiseTimer < 0) m_noiseTimer += period;
+        }
+        noise[i] = m_noiseLevel;
+    }
+}
+
+// Fixed volumes are stored halved. Sweeps are not emulated and play at their full volume
+static inline s32 volume(u16 value) { return (value & 0x8000) ? 0x7fff : s16(value << 1); }
+
+// Render a block of one voice after its envelope. Sample positions and the envelope are stepped one sample at a
+// time, everything after works on the whole block
+void Spu::renderVoice(u32 index, const s32* modulation, const s32* noise, s32* output) {
+    auto& voice = m_voices[index];
+    const bool modulated = index > 0 && (m_pitchModulation & (1 << index));
+    const bool noiseVoice = m_noiseEnable & (1 << index);
+
+    s32 samples[SPU_BLOCK_SIZE];
+    s32 envelope[SPU_BLOCK_SIZE];
+    for (u32 i = 0; i < SPU_BLOCK_SIZE; i++) {
+        // Linear interpolation between the previous and current sample
+        const u32 position = voice.counter >> 12;
+        const s32 fraction = (voice.counter >> 4) & 0xff;
+        samples[i] = (voice.samples[position] * (256 - fraction) + voice.samples[position + 1] * fraction) >> 8;
+        envelope[i] = voice.level;
+
+        u32 step = voice.pitch;
+        if (modulated) step = u32((s32(step) * (modulation[i] + 0x8000)) >> 15) & 0xffff;
+        voice.counter += std::min<u32>(step, 0x4000);
+        if (voice.counter >= ADPCM_BLOCK_SAMPLES << 12) {
+            voice.counter -= ADPCM_BLOCK_SAMPLES << 12;
+            nextBlock(index);
+        }
+
+        tickEnvelope(voice);
+    }
+
+    if (noiseVoice) std::copy(noise, noise + SPU_BLOCK_SIZE, samples);
+    for (u32 i = 0; i < SPU_BLOCK_SIZE; i++) output[i] = (samples[i] * envelope[i]) >> 15;
+}
+
+void Spu::mixBlock() {
+    m_emulator.m_scheduler.schedule(EVENT::SPU, SPU_BLOCK_SIZE * SPU_CYCLES_PER_SAMPLE);
+
+    alignas(32) s32 left[SPU_BLOCK_SIZE] = {};
+    alignas(32) s32 right[SPU_BLOCK_SIZE] = {};
+    alignas(32) s32 reverbLeft[SPU_BLOCK_SIZE] = {};
+    alignas(32) s32 reverbRight[SPU_BLOCK_SIZE] = {};
+    alignas(32) s32 noise[SPU_BLOCK_SIZE];
+    alignas(32) s32 outputs[2][SPU_BLOCK_SIZE] = {};  // This voice and the previous one, for pitch modulation
+    updateNoise(noise);
+
+    for (u32 index = 0; index < SPU_VOICE_COUNT; index++) {
+        s32* output = outputs[index & 1];
+        const s32* previous = outputs[(index & 1) ^ 1];
+        auto& voice = m_voices[index];
+        if (voice.phase == ADSR_PHASE::OFF) {
+            std::fill(output, output + SPU_BLOCK_SIZE, 0);
+            continue;
+        }
+
+        renderVoice(index, previous, noise, output);
+        const s32 volumeLeft = volume(voice.volumeLeft);
+        const s32 volumeRight = volume(voice.volumeRight);
+        for (u32 i = 0; i < SPU_BLOCK_SIZE; i++) {
+            left[i] += (output[i] * volumeLeft) >> 15;
+            right[i] += (output[i] * volumeRight) >> 15;
+        }
+        if (m_reverbEnable & (1 << index)) {
+            for (u32 i = 0; i < SPU_BLOCK_SIZE; i++) {
+                reverbLeft[i] += (output[i] * volumeLeft) >> 15;
+                reverbRight[i] += (output[i] * volumeRight) >> 15;
+            }
+        }
+    }
+
+    // The CD audio stream advances whether or not it is enabled
+    alignas(32) s32 cdLeft[SPU_BLOCK_SIZE];
+    alignas(32) s32 cdRight[SPU_BLOCK_SIZE];
+    m_emulator.m_cdrom.readAudio(cdLeft, cdRight, SPU_BLOCK_SIZE);
+    if (m_control.cdAudio) {
+        for (u32 i = 0; i < SPU_BLOCK_SIZE; i++) {
+            const s32 l = (cdLeft[i] * m_cdVolumeLeft) >> 15;
+            const s32 r = (cdRight[i] * m_cdVolumeRight) >> 15;
+            left[i] += l;
+            right[i] += r;
+            if (m_control.cdReverb) {
+                reverbLeft[i] += l;
+                reverbRight[i] += r;
+            }
+        }
+    }
+
+    if (m_control.reverbEnable) {
+        alignas(32) s32 reverbOutput[2][SPU_BLOCK_SIZE];
+        m_reverb.process(reinterpret_cast<u16*>(m_ram.get()), reverbLeft, reverbRight, reverbOutput[0],
+                         reverbOutput[1]);
+        for (u32 i = 0; i < SPU_BLOCK_SIZE; i++) {
+            left[i] += reverbOutput[0][i];
+            right[i] += reverbOutput[1][i];
+        }
+    }
+
+    const bool audible = m_control.enable && m_control.unmute;
+    const s32 mainLeft = audible ? volume(m_mainVolumeLeft) : 0;
+    const s32 mainRight = audible ? volume(m_mainVolumeRight) : 0;
+    alignas(32) s16 block[SPU_BLOCK_SIZE * 2];
+    for (u32 i = 0; i < SPU_BLOCK_SIZE; i++) {
+        block[i * 2] = s16((std::clamp(left[i], -0x8000, 0x7fff) * mainLeft) >> 15);
+        block[i * 2 + 1] = s16((std::clamp(right[i], -0x8000, 0x7fff) * mainRight) >> 15);
+    }
+
+    // Never wait on the host, when it falls behind the block is lost
+    if (!m_outputEnabled) return;
+    if (m_output.freeSpace() >= SPU_BLOCK_SIZE * 2) {
+        m_output.push(block, SPU_BLOCK_SIZE * 2);
+    } else {
+        m_droppedSamples += SPU_BLOCK_SIZE;
+    }
+}
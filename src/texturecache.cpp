@@ -0,0 +1,110 @@
+#include "texturecache.hpp"
+
+#include <algorithm>
+
+TextureCache::TextureCache() {
+    m_entries.resize(TEXTURE_CACHE_SIZE);
+    for (auto& entry : m_entries) entry.texels = std::make_unique<u16[]>(TEXTURE_PAGE_TEXELS);
+}
+
+u32 TextureCache::keyOf(const Primitive& prim) {
+    return (prim.texBaseX / 64) | (prim.texBaseY / 256) << 4 | prim.texDepth << 5 | (prim.clutX / 16) << 6 |
+           prim.clutY << 12;
+}
+
+static inline u32 blockIndex(s32 x, s32 y) { return (y % VERSION_BLOCKS_Y) * VERSION_BLOCKS_X + x % VERSION_BLOCKS_X; }
+
+u64 TextureCache::latestWrite(s32 left, s32 top, s32 right, s32 bottom) const {
+    const s32 firstX = left / VERSION_BLOCK_WIDTH;
+    const s32 lastX = std::min(right / VERSION_BLOCK_WIDTH, firstX + VERSION_BLOCKS_X - 1);
+    const s32 firstY = top / VERSION_BLOCK_HEIGHT;
+    const s32 lastY = std::min(bottom / VERSION_BLOCK_HEIGHT, firstY + VERSION_BLOCKS_Y - 1);
+
+    u64 latest = 0;
+    for (s32 y = firstY; y <= lastY; y++) {
+        for (s32 x = firstX; x <= lastX; x++) {
+            latest = std::max(latest, m_blockVersions[blockIndex(x, y)]);
+        }
+    }
+    return latest;
+}
+
+// Highest block version among the texture page and CLUT of a primitive
+u64 TextureCache::latestWrite(const Primitive& prim) const {
+    const s32 pageWidth = prim.texDepth == 0 ? 64 : 128;
+    const s32 clutWidth = prim.texDepth == 0 ? 16 : 256;
+    return std::max(latestWrite(prim.texBaseX, prim.texBaseY, prim.texBaseX + pageWidth - 1, prim.texBaseY + 255),
+                    latestWrite(prim.clutX, prim.clutY, prim.clutX + clutWidth - 1, prim.clutY));
+}
+
+TextureCache::Entry* TextureCache::lookup(u32 key) {
+    for (u32 i = 0; i < m_used; i++) {
+        if (m_entries[i].key == key) return &m_entries[i];
+    }
+    return nullptr;
+}
+
+const u16* TextureCache::find(const Primitive& prim) {
+    const auto entry = lookup(keyOf(prim));
+    if (entry != nullptr && latestWrite(prim) > entry->version) entry->key = INVALID_KEY;  // Stale
+    if (entry == nullptr || entry->key == INVALID_KEY) {
+        m_misses.store(m_misses.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+
+    m_hits.store(m_hits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return entry->texels.get();
+}
+
+// Entries are never overwritten before clear(), so primitives still holding one keep valid texels
+const u16* TextureCache::insert(const u16* vram, const Primitive& prim) {
+    Entry* entry = &m_entries[m_used++];
+    entry->key = keyOf(prim);
+    entry->version = m_version;
+
+    u16 palette[256];
+    const u32 entries = prim.texDepth == 0 ? 16 : 256;
+    for (u32 i = 0; i < entries; i++) {
+        palette[i] = vram[prim.clutY * VRAM_WIDTH + ((prim.clutX + i) & (VRAM_WIDTH - 1))];
+    }
+
+    u16* texels = entry->texels.get();
+    for (u32 v = 0; v < 256; v++) {
+        const u16* row = vram + ((prim.texBaseY + v) & (VRAM_HEIGHT - 1)) * VRAM_WIDTH;
+        u16* dst = texels + v * 256;
+
+        if (prim.texDepth == 0) {  // 4 CLUT indices per halfword
+            for (u32 x = 0; x < 64; x++) {
+                const u16 word = row[(prim.texBaseX + x) & (VRAM_WIDTH - 1)];
+                for (u32 i = 0; i < 4; i++) dst[x * 4 + i] = palette[(word >> (i * 4)) & 0xf];
+            }
+        } else {
+            for (u32 x = 0; x < 128; x++) {
+                const u16 word = row[(prim.texBaseX + x) & (VRAM_WIDTH - 1)];
+                dst[x * 2] = palette[word & 0xff];
+                dst[x * 2 + 1] = palette[word >> 8];
+            }
+        }
+    }
+
+    return texels;
+}
+
+void TextureCache::clear() { m_used = 0; }
+
+void TextureCache::invalidate(s32 left, s32 top, s32 right, s32 bottom) {
+    if (left > right || top > bottom) return;
+    m_version++;
+
+    // Writes wrap around the edges of VRAM
+    const s32 firstX = left / VERSION_BLOCK_WIDTH;
+    const s32 lastX = std::min(right / VERSION_BLOCK_WIDTH, firstX + VERSION_BLOCKS_X - 1);
+    const s32 firstY = top / VERSION_BLOCK_HEIGHT;
+    const s32 lastY = std::min(bottom / VERSION_BLOCK_HEIGHT, firstY + VERSION_BLOCKS_Y - 1);
+
+    for (s32 y = firstY; y <= lastY; y++) {
+        for (s32 x = firstX; x <= lastX; x++) {
+            m_blockVersions[blockIndex(x, y)] = m_version;
+        }
+    }
+}
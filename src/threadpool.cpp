@@ -0,0 +1,57 @@
+#include "threadpool.hpp"
+
+void ThreadPool::resize(u32 threads) {
+    {
+        std::lock_guard lock(m_mutex);
+        m_quit = true;
+    }
+    m_start.notify_all();
+    for (auto& worker : m_workers) worker.join();
+    m_workers.clear();
+
+    m_quit = false;
+    for (u32 i = 1; i < threads; i++) m_workers.emplace_back(&ThreadPool::workerMain, this, m_generation);
+}
+
+void ThreadPool::dispatch(size_t count, Task task, void* context) {
+    if (m_workers.empty() || count <= 1) {
+        for (size_t i = 0; i < count; i++) task(context, i);
+        return;
+    }
+
+    {
+        std::lock_guard lock(m_mutex);
+        m_task = task;
+        m_context = context;
+        m_count = count;
+        m_next = 0;
+        m_busy = m_workers.size();
+        m_generation++;
+    }
+    m_start.notify_all();
+
+    work();
+
+    std::unique_lock lock(m_mutex);
+    m_done.wait(lock, [this] { return m_busy == 0; });
+}
+
+void ThreadPool::work() {
+    for (size_t i = m_next++; i < m_count; i = m_next++) m_task(m_context, i);
+}
+
+void ThreadPool::workerMain(u64 generation) {
+    while (true) {
+        {
+            std::unique_lock lock(m_mutex);
+            m_start.wait(lock, [&] { return m_quit || m_generation != generation; });
+            if (m_quit) return;
+            generation = m_generation;
+        }
+
+        work();
+
+        std::lock_guard lock(m_mutex);
+        if (--m_busy == 0) m_done.notify_one();
+    }
+}
@@ -0,0 +1,243 @@
+#include "timers.hpp"
+
+#include "emulator.hpp"
+
+static constexpr u64 NEVER = Scheduler::NEVER;
+
+void Timers::reset() {
+    for (u32 i = 0; i < m_timers.size(); i++) {
+        auto& timer = m_timers[i];
+        timer.mode.r = 0x400;
+        timer.target = 0;
+        timer.base = 0;
+        timer.stamp = m_emulator.m_scheduler.now();
+        timer.flagStamp = timer.stamp;
+        timer.rate = clockRate(i);
+        timer.irqFired = false;
+        m_emulator.m_scheduler.cancel(static_cast<EVENT>((u32)EVENT::TIMER0 + i));
+    }
+}
+
+void Timers::serialize(Serializer& s) {
+    for (auto& timer : m_timers) {
+        s(timer.mode.r);
+        s(timer.target);
+        s(timer.base);
+        s(timer.stamp);
+        s(timer.flagStamp);
+        s(timer.rate);
+        s(timer.irqFired);
+    }
+}
+
+u32 Timers::read(u32 offset) {
+    const u32 index = (offset - 0x100) >> 4;
+    if (index >= m_timers.size()) return 0;
+    auto& timer = m_timers[index];
+
+    switch (offset & 0xc) {
+        case 0x0:
+            return counter(index);
+        case 0x4: {
+            // The reached flags clear when read
+            updateFlags(index);
+            const u32 mode = timer.mode.r;
+            timer.mode.reachedTarget = 0;
+            timer.mode.reachedOverflow = 0;
+            return mode;
+        }
+        case 0x8:
+            return timer.target;
+        default:
+            return 0;
+    }
+}
+
+void Timers::write(u32 offset, u32 value) {
+    const u32 index = (offset - 0x100) >> 4;
+    if (index >= m_timers.size()) return;
+    auto& timer = m_timers[index];
+    const u64 now = m_emulator.m_scheduler.now();
+
+    switch (offset & 0xc) {
+        case 0x0:
+            rebase(index);
+            timer.base = value & 0xffff;
+            break;
+        case 0x4:
+            // Writing the mode restarts the counter from 0 and re-arms one-shot IRQs
+            updateFlags(index);
+            timer.mode.r = (value & 0x3ff) | (timer.mode.r & 0x1800) | 0x400;
+            timer.base = 0;
+            timer.stamp = now;
+            timer.rate = clockRate(index);
+            timer.irqFired = false;
+            if (timer.mode.syncEnable && index != 2) {
+                m_emulator.log("Timer{}: Sync mode {} not supported, counting freely\n", index, timer.mode.syncMode);
+            }
+            break;
+        case 0x8:
+            rebase(index);
+            timer.target = value & 0xffff;
+            break;
+        default:
+            return;
+    }
+
+    scheduleIrq(index);
+}
+
+void Timers::onEvent(u32 index) {
+    auto& timer = m_timers[index];
+    updateFlags(index);
+
+    bool request = true;
+    if (timer.mode.irqToggle) {
+        timer.mode.irqFlag = !timer.mode.irqFlag;
+        request = !timer.mode.irqFlag;
+    } else {
+        timer.mode.irqFlag = 1;  // Pulse mode only drops the flag for a few cycles
+    }
+
+    if (request && (!timer.irqFired || timer.mode.irqRepeat)) {
+        m_emulator.m_irq.trigger(static_cast<IRQ>((u32)IRQ::Timer0 + index));
+        timer.irqFired = true;
+    }
+
+    scheduleIrq(index);
+}
+
+void Timers::updateVideoClocks() {
+    for (u32 index = 0; index < 2; index++) {
+        rebase(index);
+        m_timers[index].rate = clockRate(index);
+        scheduleIrq(index);
+    }
+}
+
+ClockRate Timers::clockRate(u32 index) const {
+    const auto& mode = m_timers[index].mode;
+    const u32 source = mode.clockSource;
+
+    switch (index) {
+        case 0:  // System clock or dot clock
+            if (source & 1) return {GPU_CLOCK_NUM, GPU_CLOCK_DEN * (u64)m_emulator.m_gpu.dotClockDivider()};
+            break;
+        case 1:  // System clock or HBlank
+            if (source & 1) return {GPU_CLOCK_NUM, GPU_CLOCK_DEN * (u64)m_emulator.m_gpu.cyclesPerScanline()};
+            break;
+        case 2:  // System clock or system clock / 8. Sync modes 0 and 3 stop the counter
+            if (mode.syncEnable && (mode.syncMode == 0 || mode.syncMode == 3)) return {0, 1};
+            if (source & 2) return {1, 8};
+            break;
+        default:
+            break;
+    }
+    return {1, 1};
+}
+
+u32 Timers::period(const Timer& timer) const { return timer.mode.resetAtTarget ? timer.target + 1 : 0x10000; }
+
+// Counter value after some ticks since the stamp. When reset at target is set and the counter starts above the
+// target, it first counts up to 0xffff and wraps
+u32 Timers::valueAfter(const Timer& timer, u64 ticks) const {
+    const u64 raw = timer.base + ticks;
+    const u32 p = period(timer);
+
+    if (timer.base < p) return raw % p;
+    if (raw < 0x10000) return raw;
+    return (raw - 0x10000) % p;
+}
+
+// Ticks after the stamp until the counter first steps onto a value
+u64 Timers::ticksToReach(const Timer& timer, u32 value) const {
+    const u32 p = period(timer);
+
+    if (timer.base < p) {
+        if (value >= p) return NEVER;
+        return value > timer.base ? value - timer.base : value + p - timer.base;
+    }
+
+    if (value > timer.base) return value - timer.base;
+    if (value >= p) return NEVER;
+    return 0x10000 - timer.base + value;
+}
+
+// Did the counter step onto a value for a tick count in (from, to]
+bool Timers::reachedBetween(const Timer& timer, u32 value, u64 from, u64 to) const {
+    const u64 first = ticksToReach(timer, value);
+    if (first == NEVER || first > to) return false;
+    if (first > from) return true;
+
+    const u32 p = period(timer);
+    if (value >= p) return false;
+    const u64 next = first + ((from - first) / p + 1) * p;
+    return next <= to;
+}
+
+u32 Timers::counter(u32 index) {
+    const auto& timer = m_timers[index];
+    const u64 ticks = timer.rate.ticksAt(m_emulator.m_scheduler.now()) - timer.rate.ticksAt(timer.stamp);
+    return valueAfter(timer, ticks);
+}
+
+// Fold the elapsed time into the counter value, so the rate or count can change from here on
+void Timers::rebase(u32 index) {
+    auto& timer = m_timers[index];
+    updateFlags(index);
+    timer.base = counter(index);
+    timer.stamp = m_emulator.m_scheduler.now();
+}
+
+void Timers::updateFlags(u32 index) {
+    auto& timer = m_timers[index];
+    const u64 now = m_emulator.m_scheduler.now();
+    const u64 start = timer.rate.ticksAt(timer.stamp);
+    const u64 from = timer.rate.ticksAt(timer.flagStamp) - start;
+    const u64 to = timer.rate.ticksAt(now) - start;
+
+    if (to > from) {
+        if (reachedBetween(timer, timer.target, from, to)) timer.mode.reachedTarget = 1;
+        if (reachedBetween(timer, 0xffff, from, to)) timer.mode.reachedOverflow = 1;
+    }
+    timer.flagStamp = now;
+}
+
+void Timers::scheduleIrq(u32 index) {
+    auto& timer = m_timers[index];
+    auto& scheduler = m_emulator.m_scheduler;
+    const auto event = static_cast<EVENT>((u32)EVENT::TIMER0 + index);
+
+    const bool armed = timer.mode.irqAtTarget || timer.mode.irqAtOverflow;
+    if (!armed || (timer.irqFired && !timer.mode.irqRepeat) || timer.rate.num == 0) {
+        scheduler.cancel(event);
+        return;
+    }
+
+    const u32 p = period(timer);
+    const u64 start = timer.rate.ticksAt(timer.stamp);
+    const u64 elapsed = timer.rate.ticksAt(scheduler.now()) - start;
+
+    // Next tick count, after the current one, at which an armed condition is met
+    u64 next = NEVER;
+    auto consider = [&](u32 value) {
+        u64 hit = ticksToReach(timer, value);
+        if (hit == NEVER) return;
+        if (hit <= elapsed) {
+            if (value >= p) return;
+            hit += ((elapsed - hit) / p + 1) * p;
+        }
+        next = std::min(next, hit);
+    };
+
+    if (timer.mode.irqAtTarget) consider(timer.target);
+    if (timer.mode.irqAtOverflow) consider(0xffff);
+
+    if (next == NEVER) {
+        scheduler.cancel(event);
+        return;
+    }
+
+    const u64 cycle = timer.rate.cycleOfTick(start + next);
+    scheduler.schedule(event, cycle - scheduler.now());
+}
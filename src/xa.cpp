@@ -0,0 +1,247 @@
+#include "xa.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numbers>
+
+#include "savestate.hpp"
+
+// Frames per sector at the SPU rate can't exceed 18.9 kHz mono
+#define XA_MAX_FRAMES (XA_SOUND_GROUPS * XA_GROUP_SAMPLES * XA_PHASES / 3)
+
+namespace XA {
+
+// Windowed sinc at XA_PHASES times the input rate, cut off a bit below the input Nyquist frequency. Each phase is
+// normalized to a gain of exactly 1 so silence and DC stay put
+const std::array<std::array<s16, XA_TAPS>, XA_PHASES> coefficients = [] {
+    constexpr u32 length = XA_TAPS * XA_PHASES;
+    constexpr double cutoff = 0.45 / XA_PHASES;
+    constexpr double center = (length - 1) / 2.0;
+    constexpr double pi = std::numbers::pi;
+
+    std::array<std::array<s16, XA_TAPS>, XA_PHASES> table{};
+    for (u32 phase = 0; phase < XA_PHASES; phase++) {
+        std::array<double, XA_TAPS> taps;
+        double sum = 0;
+        for (u32 tap = 0; tap < XA_TAPS; tap++) {
+            // Tap 0 multiplies the newest sample
+            const double n = tap * XA_PHASES + phase;
+            const double x = n - center;
+            const double sinc = x == 0 ? 1.0 : std::sin(2 * pi * cutoff * x) / (2 * pi * cutoff * x);
+            const double angle = 2 * pi * n / (length - 1);
+            const double window = 0.42 - 0.5 * std::cos(angle) + 0.08 * std::cos(2 * angle);  // Blackman
+            taps[tap] = sinc * window;
+            sum += taps[tap];
+        }
+
+        s32 total = 0;
+        for (u32 tap = 0; tap < XA_TAPS; tap++) {
+            const s16 value = s16(std::lround(taps[tap] / sum * 32768.0));
+            table[phase][XA_TAPS - 1 - tap] = value;
+            total += value;
+        }
+        table[phase][XA_TAPS / 2] += s16(32768 - total);
+    }
+    return table;
+}();
+
+u32 resampleScalar(const s16* input, u32 count, u32 position, u32 step, s16* output) {
+    u32 frames = 0;
+    for (; position < count * XA_PHASES; position += step) {
+        const s16* window = input + position / XA_PHASES;
+        const auto& taps = coefficients[position % XA_PHASES];
+
+        s32 sum = 0;
+        for (u32 tap = 0; tap < XA_TAPS; tap++) sum += window[tap] * taps[tap];
+        output[frames++ * 2] = s16(std::clamp((sum + 0x4000) >> 15, -0x8000, 0x7fff));
+    }
+    return frames;
+}
+
+}  // namespace XA
+
+static const s32 positiveTable[4] = {0, 60, 115, 98};
+static const s32 negativeTable[4] = {0, 0, -52, -55};
+
+// Frames the resampler produces for count new input samples, advancing position past them
+static u32 resampledFrames(u32& position, u32 step, u32 count) {
+    const u32 end = count * XA_PHASES;
+    const u32 frames = position < end ? (end - position + step - 1) / step : 0;
+    position = position + frames * step - end;
+    return frames;
+}
+
+static u32 samplesPerChannel(XaCoding coding) {
+    return XA_SOUND_GROUPS * XA_GROUP_SAMPLES / (coding.eightBit ? 2 : 1) / (coding.stereo ? 2 : 1);
+}
+
+XaDecoder::XaDecoder() {
+    m_resample = Helpers::avx2Supported() ? XA::resampleAVX2 : XA::resampleScalar;
+    m_thread = std::thread([this] { decoderLoop(); });
+}
+
+XaDecoder::~XaDecoder() {
+    XaSector stop;
+    stop.stop = true;
+    m_input.waitForSpace(1);
+    m_input.push(&stop, 1);
+    m_thread.join();
+}
+
+void XaDecoder::reset() {
+    // Once the input is empty the decoder thread is idle, its state can be touched from here
+    m_input.waitEmpty();
+    m_output.pop(m_output.available());
+    m_position = m_buffered = 0;
+    m_decoderPosition = 0;
+    std::memset(m_history, 0, sizeof(m_history));
+    for (auto& samples : m_samples) samples.fill(0);
+}
+
+void XaDecoder::serialize(Serializer& s) {
+    m_input.waitEmpty();
+
+    std::vector<s16> samples(m_output.available());
+    if (!s.loading()) m_output.read(0, samples.data(), samples.size());
+    s(samples);
+    if (s.loading()) {
+        m_output.pop(m_output.available());
+        m_output.push(samples.data(), std::min<size_t>(samples.size(), XA_OUTPUT_RING));
+    }
+
+    s(m_position);
+    s(m_buffered);
+    s(m_history);
+    s(m_samples);
+    s(m_decoderPosition);
+}
+
+bool XaDecoder::submit(XaCoding coding, const u8* data) {
+    u32 position = m_position;
+    const u32 frames = resampledFrames(position, coding.halfRate ? 3 : 6, samplesPerChannel(coding));
+    if ((m_buffered + frames) * 2 > XA_OUTPUT_RING) return false;
+
+    XaSector sector;
+    sector.coding = coding.r;
+    std::copy(data, data + sector.data.size(), sector.data.begin());
+    m_input.push(&sector, 1);
+
+    m_position = position;
+    m_buffered += frames;
+    return true;
+}
+
+void XaDecoder::read(s16* left, s16* right, u32 count) {
+    const u32 frames = std::min(count, m_buffered);
+    if (frames) {
+        // Submitted earlier, but the decoder thread may still be on it
+        while (m_output.available() < frames * 2) m_output.waitForData();
+
+        alignas(32) s16 samples[256];
+        for (u32 done = 0; done < frames;) {
+            const u32 chunk = std::min<u32>(frames - done, std::size(samples) / 2);
+            m_output.read(0, samples, chunk * 2);
+            m_output.pop(chunk * 2);
+            for (u32 i = 0; i < chunk; i++) {
+                left[done + i] = samples[i * 2];
+                right[done + i] = samples[i * 2 + 1];
+            }
+            done += chunk;
+        }
+        m_buffered -= frames;
+    }
+
+    std::fill(left + frames, left + count, 0);
+    std::fill(right + frames, right + count, 0);
+}
+
+void XaDecoder::decoderLoop() {
+    while (true) {
+        m_input.waitForData();
+        const XaSector& sector = m_input.peek(0);
+        if (sector.stop) return;
+
+        decode(sector);
+        m_input.pop(1);
+    }
+}
+
+// Expands the sound units of a sector in one pass, then runs the prediction filters over them. The filters are
+// recursive, the two channels of a stereo sector are interleaved to keep two chains in flight
+void XaDecoder::decode(const XaSector& sector) {
+    XaCoding coding;
+    coding.r = sector.coding;
+    const bool stereo = coding.stereo;
+    const bool eightBit = coding.eightBit;
+    const u32 units = eightBit ? 4 : 8;
+    const u32 perChannel = samplesPerChannel(coding);
+
+    // Shifted samples in sound unit order, then the filter of each unit
+    static thread_local s32 shifted[XA_SOUND_GROUPS * XA_GROUP_SAMPLES];
+    static thread_local u8 filters[XA_SOUND_GROUPS * 8];
+    for (u32 group = 0; group < XA_SOUND_GROUPS; group++) {
+        const u8* data = &sector.data[group * XA_GROUP_SIZE];
+        for (u32 unit = 0; unit < units; unit++) {
+            const u8 header = data[4 + unit];
+            const u32 shift = (header & 0xf) > 12 ? 9 : header & 0xf;
+            filters[group * units + unit] = (header >> 4) & 3;
+
+            s32* out = &shifted[(group * units + unit) * 28];
+            if (eightBit) {
+                for (u32 i = 0; i < 28; i++) out[i] = s32(s16(data[16 + i * 4 + unit] << 8)) >> shift;
+            } else {
+                for (u32 i = 0; i < 28; i++) {
+                    const u8 byte = data[16 + i * 4 + unit / 2];
+                    out[i] = s32(s16((unit & 1 ? byte >> 4 : byte & 0xf) << 12)) >> shift;
+                }
+            }
+        }
+    }
+
+    s16* samples[2] = {&m_samples[0][XA_TAPS - 1], &m_samples[1][XA_TAPS - 1]};
+    auto predict = [&](u32 channel, u32 filter, s32 input) {
+        s32* history = m_history[channel];
+        const s32 prediction = (history[0] * positiveTable[filter] + history[1] * negativeTable[filter] + 32) >> 6;
+        const s32 value = std::clamp(input + prediction, -0x8000, 0x7fff);
+        history[1] = history[0];
+        history[0] = value;
+        return s16(value);
+    };
+
+    const u32 totalUnits = XA_SOUND_GROUPS * units;
+    if (stereo) {
+        for (u32 unit = 0; unit < totalUnits; unit += 2) {
+            const s32* left = &shifted[unit * 28];
+            const s32* right = left + 28;
+            s16* outLeft = samples[0] + unit / 2 * 28;
+            s16* outRight = samples[1] + unit / 2 * 28;
+            for (u32 i = 0; i < 28; i++) {
+                outLeft[i] = predict(0, filters[unit], left[i]);
+                outRight[i] = predict(1, filters[unit + 1], right[i]);
+            }
+        }
+    } else {
+        for (u32 unit = 0; unit < totalUnits; unit++) {
+            for (u32 i = 0; i < 28; i++) samples[0][unit * 28 + i] = predict(0, filters[unit], shifted[unit * 28 + i]);
+        }
+    }
+
+    static thread_local s16 output[XA_MAX_FRAMES * 2];
+    const u32 step = coding.halfRate ? 3 : 6;
+    const u32 frames = m_resample(m_samples[0].data(), perChannel, m_decoderPosition, step, output);
+    if (stereo) {
+        m_resample(m_samples[1].data(), perChannel, m_decoderPosition, step, output + 1);
+    } else {
+        for (u32 i = 0; i < frames; i++) output[i * 2 + 1] = output[i * 2];
+    }
+    resampledFrames(m_decoderPosition, step, perChannel);
+
+    // Keep the newest samples as the history of the next sector
+    for (u32 channel = 0; channel < (stereo ? 2u : 1u); channel++) {
+        auto& buffer = m_samples[channel];
+        std::copy(buffer.begin() + perChannel, buffer.begin() + perChannel + XA_TAPS - 1, buffer.begin());
+    }
+
+    m_output.push(output, frames * 2);
+}
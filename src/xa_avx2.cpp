@@ -0,0 +1,47 @@
+#include "xa.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#define AVX2_TARGET
+#else
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
+namespace XA {
+
+// All 16 taps of a frame in one multiply-add, pairs of products are summed in 32 bits like the scalar path does
+AVX2_TARGET u32 resampleAVX2(const s16* input, u32 count, u32 position, u32 step, s16* output) {
+    static_assert(XA_TAPS == 16);
+    __m256i taps[XA_PHASES];
+    for (u32 phase = 0; phase < XA_PHASES; phase++) {
+        taps[phase] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(coefficients[phase].data()));
+    }
+
+    u32 frames = 0;
+    for (; position < count * XA_PHASES; position += step) {
+        const __m256i window = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(input + position / XA_PHASES));
+        const __m256i products = _mm256_madd_epi16(window, taps[position % XA_PHASES]);
+
+        __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(products), _mm256_extracti128_si256(products, 1));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4e));
+        sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb1));
+        sum = _mm_srai_epi32(_mm_add_epi32(sum, _mm_set1_epi32(0x4000)), 15);
+        output[frames++ * 2] = s16(_mm_cvtsi128_si32(_mm_packs_epi32(sum, sum)));
+    }
+    return frames;
+}
+
+}  // namespace XA
+
+#else
+
+namespace XA {
+
+u32 resampleAVX2(const s16* input, u32 count, u32 position, u32 step, s16* output) {
+    return resampleScalar(input, count, position, step, output);
+}
+
+}  // namespace XA
+
+#endif
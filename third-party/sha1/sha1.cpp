@@ -19,6 +19,7 @@
 #include <sstream>
 #include <iomanip>
 #include <fstream>
+#include <algorithm>
  
 /* Help macros */
 #define SHA1_ROL(value, bits) (((value) << (bits)) | (((value) & 0xffffffff) >> (32 - (bits))))
@@ -60,6 +61,45 @@ void SHA1::update(std::istream &is)
 }
  
  
+/*
+ * Hash a memory buffer, whole blocks are read in place without copying.
+ */
+
+void SHA1::update(const uint8_t *data, size_t size)
+{
+    /* Top up a partial block left from a previous update first */
+    size_t fill = std::min<size_t>(size, BLOCK_BYTES - buffer.size());
+    buffer.append(reinterpret_cast<const char *>(data), fill);
+    data += fill;
+    size -= fill;
+
+    if (buffer.size() < BLOCK_BYTES)
+    {
+        return;
+    }
+
+    uint32_t block[BLOCK_INTS];
+    buffer_to_block(buffer, block);
+    transform(block);
+
+    while (size >= BLOCK_BYTES)
+    {
+        for (unsigned int i = 0; i < BLOCK_INTS; i++)
+        {
+            block[i] = data[4*i+3]
+                       | data[4*i+2]<<8
+                       | data[4*i+1]<<16
+                       | (uint32_t)data[4*i+0]<<24;
+        }
+        transform(block);
+        data += BLOCK_BYTES;
+        size -= BLOCK_BYTES;
+    }
+
+    buffer.assign(reinterpret_cast<const char *>(data), size);
+}
+
+
 /*
  * Add padding and return the message digest.
  */
@@ -122,6 +162,13 @@ std::string SHA1::from_stream(std::ifstream &stream)
     return checksum.final();
 }
 
+std::string SHA1::from_buffer(const uint8_t *data, size_t size)
+{
+    SHA1 checksum;
+    checksum.update(data, size);
+    return checksum.final();
+}
+
 void SHA1::reset()
 {
     /* SHA1 initialization constants */
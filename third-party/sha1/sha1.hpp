@@ -29,9 +29,11 @@ public:
     SHA1();
     void update(const std::string &s);
     void update(std::istream &is);
+    void update(const uint8_t *data, size_t size);
     std::string final();
     static std::string from_file(const std::string &filename);
     static std::string from_stream(std::ifstream &stream);
+    static std::string from_buffer(const uint8_t *data, size_t size);
  
 //private:
     static const unsigned int DIGEST_INTS = 5;  /* number of 32bit integers per SHA1 digest */